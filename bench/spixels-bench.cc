@@ -0,0 +1,450 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Micro benchmarks of the encoding and output paths. Results are written
+ * as JSON to stdout, one result per line, so that they can be kept per
+ * Raspberry Pi model and compared with a previous run on the same model
+ * (-b). Baselines are named after the model (-m), see the Makefile.
+ *
+ * The encoding benchmarks use the recording outputs (see gpio-stream.h),
+ * which run the same encoders as the hardware outputs, so they work on any
+ * machine. The frame rate benchmark uses the output chosen with -O.
+ */
+
+#include "gpio-stream.h"
+#include "led-strip.h"
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+using namespace spixels;
+
+#define STRIP_LEDS 144
+
+static double GetTimeSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A benchmark does "ops_per_run" operations (e.g. pixels) per run.
+class Benchmark {
+public:
+    explicit Benchmark(int ops_per_run) : ops_per_run_(ops_per_run) {}
+    virtual ~Benchmark() {}
+    virtual void Run(int64_t runs) = 0;
+
+    // Operations per second, measured for at least "min_seconds". The best
+    // of "repeat" measurements is least disturbed by other processes.
+    double Measure(double min_seconds, int repeat) {
+        Run(1);  // Warm up.
+        int64_t runs = 1;
+        double best = 0;
+        while (repeat > 0) {
+            const double start = GetTimeSeconds();
+            Run(runs);
+            const double seconds = GetTimeSeconds() - start;
+            if (seconds >= min_seconds) {
+                const double rate = runs * ops_per_run_ / seconds;
+                if (rate > best) best = rate;
+                --repeat;
+                continue;
+            }
+            // Aim a bit over the minimum with the next attempt.
+            runs = (seconds > min_seconds / 100)
+                ? (int64_t)(runs * 1.2 * min_seconds / seconds) + 1
+                : runs * 100;
+        }
+        return best;
+    }
+
+private:
+    const int ops_per_run_;
+};
+
+class SetPixelBenchmark : public Benchmark {
+public:
+    explicit SetPixelBenchmark(LEDStrip *strip)
+        : Benchmark(strip->count()), strip_(strip) {}
+    virtual void Run(int64_t runs) {
+        const int count = strip_->count();
+        for (int64_t r = 0; r < runs; ++r) {
+            for (int i = 0; i < count; ++i) {
+                strip_->SetPixel(i, r + i, r - i, r ^ i);
+            }
+        }
+    }
+private:
+    LEDStrip *const strip_;
+};
+
+class SetPixelsBenchmark : public Benchmark {
+public:
+    explicit SetPixelsBenchmark(LEDStrip *strip)
+        : Benchmark(strip->count()), strip_(strip), colors_(strip->count()) {
+        for (size_t i = 0; i < colors_.size(); ++i) {
+            colors_[i] = RGBc(i, 255 - i, 3 * i);
+        }
+    }
+    virtual void Run(int64_t runs) {
+        for (int64_t r = 0; r < runs; ++r) {
+            colors_[r % colors_.size()].r++;
+            strip_->SetPixels(0, &colors_[0], colors_.size());
+        }
+    }
+private:
+    LEDStrip *const strip_;
+    std::vector<RGBc> colors_;
+};
+
+class BrightnessBenchmark : public Benchmark {
+public:
+    explicit BrightnessBenchmark(LEDStrip *strip)
+        : Benchmark(strip->count()), strip_(strip) {}
+    virtual void Run(int64_t runs) {
+        for (int64_t r = 0; r < runs; ++r) {
+            strip_->SetBrightness((r & 1) ? 255 : 128);
+        }
+    }
+private:
+    LEDStrip *const strip_;
+};
+
+// Bytes per second spread into the output buffer over "gpios" channels.
+class TransposeBenchmark : public Benchmark {
+public:
+    TransposeBenchmark(MultiSPI *spi, const std::vector<int> &gpios,
+                       int bytes)
+        : Benchmark(gpios.size() * bytes), spi_(spi), gpios_(gpios),
+          bytes_(bytes) {}
+    virtual void Run(int64_t runs) {
+        for (int64_t r = 0; r < runs; ++r) {
+            for (int pos = 0; pos < bytes_; ++pos) {
+                for (size_t g = 0; g < gpios_.size(); ++g) {
+                    spi_->SetBufferedByte(gpios_[g], pos, r + pos + g);
+                }
+            }
+        }
+    }
+private:
+    MultiSPI *const spi_;
+    const std::vector<int> gpios_;
+    const int bytes_;
+};
+
+// Bytes per second of copying the output buffer, the same copy as done
+// to the DMA memory before each transfer.
+class CopyBenchmark : public Benchmark {
+public:
+    explicit CopyBenchmark(MultiSPI *spi)
+        : Benchmark(spi->WireFrameSize()), spi_(spi),
+          buffer_(spi->WireFrameSize()) {}
+    virtual void Run(int64_t runs) {
+        for (int64_t r = 0; r < runs; ++r) {
+            spi_->GetWireFrame(&buffer_[0]);
+        }
+    }
+private:
+    MultiSPI *const spi_;
+    std::vector<uint8_t> buffer_;
+};
+
+class FrameBenchmark : public Benchmark {
+public:
+    explicit FrameBenchmark(MultiSPI *spi) : Benchmark(1), spi_(spi) {}
+    virtual void Run(int64_t runs) {
+        for (int64_t r = 0; r < runs; ++r) {
+            spi_->SendBuffers();
+        }
+    }
+private:
+    MultiSPI *const spi_;
+};
+
+struct Result {
+    std::string name;
+    std::string unit;
+    double value;
+};
+
+static void Report(std::vector<Result> *results, const std::string &name,
+                   const char *unit, double value) {
+    Result r;
+    r.name = name;
+    r.unit = unit;
+    r.value = value;
+    results->push_back(r);
+    fprintf(stderr, "%-40s %14.0f %s\n", name.c_str(), value, unit);
+}
+
+typedef LEDStrip *(*StripFactory)(MultiSPI *spi, int connector, int count);
+static const struct {
+    const char *name;
+    StripFactory create;
+} kStrips[] = {
+    { "WS2801",  CreateWS2801Strip },
+    { "LPD6803", CreateLPD6803Strip },
+    { "LPD8806", CreateLPD8806Strip },
+    { "APA102",  CreateAPA102Strip },
+};
+
+static MultiSPI *CreateOutput(const std::string &name, GPIOStream *stream) {
+    if (name == "direct") return CreateDirectMultiSPI();
+    if (name == "dma") return CreateDMAMultiSPI();
+    if (name == "simulated") return CreateSimulatedMultiSPI(0);
+    if (name == "recording-direct")
+        return CreateRecordingDirectMultiSPI(stream);
+    if (name == "recording-dma") return CreateRecordingDMAMultiSPI(stream);
+    return NULL;
+}
+
+// Raspberry Pi model or, on other machines, the architecture.
+static std::string MachineName() {
+    char buffer[256] = "";
+    FILE *f = fopen("/proc/device-tree/model", "r");
+    if (f) {
+        const size_t len = fread(buffer, 1, sizeof(buffer) - 1, f);
+        buffer[len] = '\0';
+        fclose(f);
+        if (len > 0) return buffer;
+    }
+    struct utsname u;
+    if (uname(&u) == 0) return u.machine;
+    return "unknown";
+}
+
+// Machine name usable as file name, e.g. "raspberry-pi-3-model-b-rev-1-2".
+static std::string MachineKey(const std::string &machine) {
+    std::string key;
+    for (size_t i = 0; i < machine.size(); ++i) {
+        if (isalnum(machine[i])) {
+            key += tolower(machine[i]);
+        } else if (!key.empty() && key[key.size() - 1] != '-') {
+            key += '-';
+        }
+    }
+    while (!key.empty() && key[key.size() - 1] == '-')
+        key.erase(key.size() - 1);
+    return key.empty() ? "unknown" : key;
+}
+
+// Read results in the format written by WriteJSON().
+static bool ReadJSON(const char *filename, std::string *machine,
+                     std::vector<Result> *results) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        perror(filename);
+        return false;
+    }
+    char line[512];
+    char name[256], unit[64];
+    double value;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, " \"machine\": \"%255[^\"]\"", name) == 1) {
+            *machine = name;
+        } else if (sscanf(line, " {\"name\": \"%255[^\"]\", \"unit\": "
+                          "\"%63[^\"]\", \"value\": %lf}",
+                          name, unit, &value) == 3) {
+            Result r;
+            r.name = name;
+            r.unit = unit;
+            r.value = value;
+            results->push_back(r);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static void WriteJSON(const std::string &machine,
+                      const std::vector<Result> &results) {
+    printf("{\n  \"benchmark\": \"spixels\",\n");
+    printf("  \"machine\": \"%s\",\n", machine.c_str());
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        printf("    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.0f}%s\n",
+               results[i].name.c_str(), results[i].unit.c_str(),
+               results[i].value, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+// Compare with the baseline; all values are rates, so lower is worse.
+// Returns the number of regressions beyond "tolerance", or -1 if the
+// baseline can't be read or is from a different machine: timings from
+// another model or host say nothing about regressions.
+static int Compare(const char *baseline_file, const std::string &machine,
+                   const std::vector<Result> &results, double tolerance) {
+    std::string baseline_machine;
+    std::vector<Result> baseline;
+    if (!ReadJSON(baseline_file, &baseline_machine, &baseline))
+        return -1;
+    if (baseline_machine != machine) {
+        fprintf(stderr, "Baseline %s is from '%s', this is '%s'; "
+                "not comparing.\n", baseline_file,
+                baseline_machine.c_str(), machine.c_str());
+        return -1;
+    }
+    int regressions = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (size_t b = 0; b < baseline.size(); ++b) {
+            if (baseline[b].name != results[i].name || baseline[b].value <= 0)
+                continue;
+            const double change = results[i].value / baseline[b].value - 1;
+            if (change < -tolerance) {
+                fprintf(stderr, "REGRESSION %-40s %+6.1f%%\n",
+                        results[i].name.c_str(), 100 * change);
+                ++regressions;
+            } else if (change > tolerance) {
+                fprintf(stderr, "improved   %-40s %+6.1f%%\n",
+                        results[i].name.c_str(), 100 * change);
+            }
+        }
+    }
+    fprintf(stderr, "%d regressions beyond %.0f%% compared to %s\n",
+            regressions, 100 * tolerance, baseline_file);
+    return regressions;
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options] > results.json\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-O <output>  : Output for the frame rate benchmark: direct, "
+            "dma,\n"
+            "\t               simulated, recording-direct, recording-dma\n"
+            "\t               (default recording-direct; hardware outputs "
+            "need a Pi).\n"
+            "\t-t <seconds> : Minimum time per measurement (default 0.1).\n"
+            "\t-n <count>   : Measurements per benchmark; the best counts "
+            "(default 3).\n"
+            "\t-b <file>    : Compare with baseline; exit 1 on regression.\n"
+            "\t-r <percent> : Tolerance for -b (default 10).\n"
+            "\t-m           : Print the baseline name of this machine and "
+            "exit.\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    std::string frame_output = "recording-direct";
+    double min_seconds = 0.1;
+    int repeat = 3;
+    const char *baseline_file = NULL;
+    double tolerance = 0.1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "O:t:n:b:r:m")) != -1) {
+        switch (opt) {
+        case 'O': frame_output = optarg; break;
+        case 't': min_seconds = atof(optarg); break;
+        case 'n': repeat = atoi(optarg); break;
+        case 'b': baseline_file = optarg; break;
+        case 'r': tolerance = atof(optarg) / 100; break;
+        case 'm':
+            printf("%s\n", MachineKey(MachineName()).c_str());
+            return 0;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (min_seconds <= 0 || repeat < 1 || tolerance < 0)
+        return usage(argv[0]);
+    GPIOStream check_stream;
+    MultiSPI *check = CreateOutput(frame_output, &check_stream);
+    if (check == NULL) return usage(argv[0]);
+    delete check;
+
+    std::vector<Result> results;
+    const char *kEncoders[] = { "recording-direct", "recording-dma" };
+    for (int e = 0; e < 2; ++e) {
+        const std::string encoder = kEncoders[e] + strlen("recording-");
+
+        // Per-pixel and bulk encoding of each strip type.
+        for (size_t s = 0; s < sizeof(kStrips) / sizeof(kStrips[0]); ++s) {
+            GPIOStream stream;
+            MultiSPI *spi = CreateOutput(kEncoders[e], &stream);
+            LEDStrip *strip = kStrips[s].create(spi, MultiSPI::SPI_P1,
+                                                STRIP_LEDS);
+            const std::string prefix = ("encode/" + encoder + "/"
+                                        + kStrips[s].name + "/");
+            SetPixelBenchmark set_pixel(strip);
+            Report(&results, prefix + "SetPixel", "pixels/s",
+                   set_pixel.Measure(min_seconds, repeat));
+            SetPixelsBenchmark set_pixels(strip);
+            Report(&results, prefix + "SetPixels", "pixels/s",
+                   set_pixels.Measure(min_seconds, repeat));
+            BrightnessBenchmark brightness(strip);
+            Report(&results, prefix + "SetBrightness", "pixels/s",
+                   brightness.Measure(min_seconds, repeat));
+            delete strip;
+            delete spi;
+        }
+
+        // Spreading bytes over 1 to 16 channels.
+        for (int channels = 1; channels <= 16; channels *= 2) {
+            GPIOStream stream;
+            MultiSPI *spi = CreateOutput(kEncoders[e], &stream);
+            std::vector<int> gpios;
+            for (int c = 0; c < channels; ++c) {
+                gpios.push_back(MultiSPI::SPIPinForConnector(c + 1));
+                spi->RegisterDataGPIO(gpios.back(), 4 * STRIP_LEDS);
+            }
+            TransposeBenchmark transpose(spi, gpios, 4 * STRIP_LEDS);
+            char name[64];
+            snprintf(name, sizeof(name), "transpose/%s/%02d-channels",
+                     encoder.c_str(), channels);
+            Report(&results, name, "bytes/s",
+                   transpose.Measure(min_seconds, repeat));
+            delete spi;
+        }
+    }
+
+    // Copy of the DMA output buffer to DMA memory: 16 APA102 strips.
+    {
+        GPIOStream stream;
+        MultiSPI *spi = CreateOutput("recording-dma", &stream);
+        std::vector<LEDStrip*> strips;
+        for (int c = 0; c < 16; ++c) {
+            strips.push_back(CreateAPA102Strip(
+                                 spi, MultiSPI::SPIPinForConnector(c + 1),
+                                 STRIP_LEDS));
+        }
+        CopyBenchmark copy(spi);
+        Report(&results, "copy/dma-shadow", "bytes/s",
+               copy.Measure(min_seconds, repeat));
+        for (size_t i = 0; i < strips.size(); ++i) delete strips[i];
+        delete spi;
+    }
+
+    // End to end: encode nothing, just send, with 16 APA102 strips.
+    for (int leds = 16; leds <= 1024; leds *= 2) {
+        GPIOStream stream;
+        MultiSPI *spi = CreateOutput(frame_output, &stream);
+        std::vector<LEDStrip*> strips;
+        for (int c = 0; c < 16; ++c) {
+            strips.push_back(CreateAPA102Strip(
+                                 spi, MultiSPI::SPIPinForConnector(c + 1),
+                                 leds));
+        }
+        spi->Prepare();
+        FrameBenchmark frames(spi);
+        char name[64];
+        snprintf(name, sizeof(name), "frames/%s/%04d-leds",
+                 frame_output.c_str(), leds);
+        Report(&results, name, "frames/s", frames.Measure(min_seconds, repeat));
+        for (size_t i = 0; i < strips.size(); ++i) delete strips[i];
+        delete spi;
+    }
+
+    const std::string machine = MachineName();
+    WriteJSON(machine, results);
+    if (baseline_file) {
+        return Compare(baseline_file, machine, results, tolerance) == 0 ? 0 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Receive E1.31 (sACN) and Art-Net and show it on LED strips. Each
+ * connector gets consecutive universes with 170 pixels each.
+ * Prints packet rate and frame latency every second.
+ *
+ * Test locally with dmx-generator.
+ */
+
+#include "dmx-receiver.h"
+#include "led-strip.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-D       : Use DMA instead of direct GPIO output.\n"
+            "\t-c <n>   : Number of connectors to use (default 16).\n"
+            "\t-l <n>   : LEDs per connector (default 144).\n"
+            "\t-u <n>   : First universe (default 1).\n");
+    return 1;
+}
+
+static void *ReceiverThread(void *receiver) {
+    ((DMXReceiver*)receiver)->Run();
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    bool use_dma = false;
+    int connectors = 16;
+    int leds = 144;
+    int universe = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "Dc:l:u:")) != -1) {
+        switch (opt) {
+        case 'D': use_dma = true; break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        case 'u': universe = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (connectors < 1 || connectors > MultiSPI::ConnectorCount() || leds < 1)
+        return usage(argv[0]);
+
+    MultiSPI *spi = use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI();
+    DMXReceiver receiver(spi);
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    for (int c = 0; c < connectors; ++c) {
+        strips[c] = CreateAPA102Strip(spi, MultiSPI::SPIPinForConnector(c+1),
+                                      leds);
+        const int first = universe;
+        universe = receiver.MapStrip(strips[c], universe);
+        printf("Connector %d: universe %d..%d\n", c+1, first, universe - 1);
+    }
+    spi->Prepare();
+    if (!receiver.Listen(DMXReceiver::E131)
+        || !receiver.Listen(DMXReceiver::ARTNET)) {
+        return 1;
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &ReceiverThread, &receiver);
+    DMXReceiver::Stats last = receiver.stats();
+    for (;;) {
+        sleep(1);
+        const DMXReceiver::Stats now = receiver.stats();
+        const int64_t frames = now.frames - last.frames;
+        printf("%6lld packets/s %5lld frames/s %5lld ignored; "
+               "latency avg %lld usec, max %lld usec\n",
+               (long long)(now.packets - last.packets), (long long)frames,
+               (long long)(now.ignored_packets - last.ignored_packets),
+               (long long)(frames ? (now.sum_latency_usec
+                                     - last.sum_latency_usec) / frames : 0),
+               (long long)now.max_latency_usec);
+        last = now;
+    }
+}
@@ -0,0 +1,166 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Send a moving color pattern as E1.31 (sACN) or Art-Net to test
+ * dmx-bridge or any other receiver. Prints the achieved packet rate.
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static int64_t GetMonotonicMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Fill E1.31 data packet for "universe" with 512 slots; returns size.
+static int FillE131(uint8_t *p, int universe, uint8_t seq, bool sync) {
+    bzero(p, 638);
+    p[1] = 0x10;                                      // Preamble size
+    memcpy(p + 4, "ASC-E1.17", 9);
+    p[16] = 0x72; p[17] = 0x6e;                       // Root flags/length
+    p[21] = 0x04;                                     // VECTOR_ROOT_E131_DATA
+    memcpy(p + 22, "spixels-generator", 16);          // CID
+    p[38] = 0x72; p[39] = 0x58;                       // Framing flags/len
+    p[43] = 0x02;                                     // E131_DATA_PACKET
+    strcpy((char*)p + 44, "spixels dmx-generator");   // Source name
+    p[108] = 100;                                     // Priority
+    if (sync) { p[109] = 0; p[110] = 1; }             // Sync address 1
+    p[111] = seq;
+    p[113] = universe >> 8; p[114] = universe & 0xff;
+    p[115] = 0x72; p[116] = 0x0b;                     // DMP flags/length
+    p[117] = 0x02; p[118] = 0xa1;
+    p[122] = 0x01;                                    // Address increment
+    p[123] = 0x02; p[124] = 0x01;                     // 513 values
+    return 638;
+}
+
+static int FillE131Sync(uint8_t *p, uint8_t seq) {
+    bzero(p, 49);
+    p[1] = 0x10;
+    memcpy(p + 4, "ASC-E1.17", 9);
+    p[16] = 0x70; p[17] = 0x21;
+    p[21] = 0x08;                                     // ROOT_E131_EXTENDED
+    memcpy(p + 22, "spixels-generator", 16);
+    p[38] = 0x70; p[39] = 0x0b;
+    p[43] = 0x01;                                     // EXTENDED_SYNC
+    p[44] = seq;
+    p[46] = 1;                                        // Sync address 1
+    return 49;
+}
+
+static int FillArtDmx(uint8_t *p, int universe, uint8_t seq) {
+    bzero(p, 530);
+    memcpy(p, "Art-Net", 8);
+    p[8] = 0x00; p[9] = 0x50;                         // OpDmx
+    p[11] = 14;                                       // Protocol version
+    p[12] = seq;
+    p[14] = universe & 0xff; p[15] = (universe >> 8) & 0x7f;
+    p[16] = 0x02; p[17] = 0x00;                       // 512 slots
+    return 530;
+}
+
+static int FillArtSync(uint8_t *p) {
+    bzero(p, 14);
+    memcpy(p, "Art-Net", 8);
+    p[8] = 0x00; p[9] = 0x52;                         // OpSync
+    p[11] = 14;
+    return 14;
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-a       : Send Art-Net instead of E1.31.\n"
+            "\t-h <ip>  : Destination host (default 127.0.0.1).\n"
+            "\t-u <n>   : Number of universes (default 16).\n"
+            "\t-U <n>   : First universe (default 1).\n"
+            "\t-f <fps> : Frames per second; 0 for as fast as possible "
+            "(default 40).\n"
+            "\t-s       : Send sync packet after each frame.\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    bool artnet = false;
+    const char *host = "127.0.0.1";
+    int universes = 16;
+    int first_universe = 1;
+    float fps = 40;
+    bool sync = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "ah:u:U:f:s")) != -1) {
+        switch (opt) {
+        case 'a': artnet = true; break;
+        case 'h': host = optarg; break;
+        case 'u': universes = atoi(optarg); break;
+        case 'U': first_universe = atoi(optarg); break;
+        case 'f': fps = atof(optarg); break;
+        case 's': sync = true; break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (universes < 1 || fps < 0) return usage(argv[0]);
+
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(artnet ? 6454 : 5568);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid address %s\n", host);
+        return 1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect()");
+        return 1;
+    }
+
+    uint8_t packet[638];
+    const int slot_offset = artnet ? 18 : 126;
+    const int64_t period = fps > 0 ? 1e6 / fps : 0;
+    int64_t next_frame = GetMonotonicMicros();
+    int64_t report = next_frame + 1000000;
+    int64_t packets = 0;
+    uint8_t seq = 1;
+    for (int frame = 0; /**/; ++frame) {
+        for (int u = 0; u < universes; ++u) {
+            const int len = artnet
+                ? FillArtDmx(packet, first_universe + u, seq)
+                : FillE131(packet, first_universe + u, seq, sync);
+            uint8_t *slots = packet + slot_offset;
+            for (int px = 0; px < 170; ++px) {
+                const int pos = (px + frame) % 170;
+                slots[3*px + 0] = pos * 255 / 170;
+                slots[3*px + 1] = 255 - pos * 255 / 170;
+                slots[3*px + 2] = (u * 16) & 0xff;
+            }
+            send(fd, packet, len, 0);
+            ++packets;
+        }
+        if (sync) {
+            const int len = artnet ? FillArtSync(packet)
+                                   : FillE131Sync(packet, seq);
+            send(fd, packet, len, 0);
+        }
+        seq = (seq == 255) ? 1 : seq + 1;  // Art-Net: 0 disables sequence.
+
+        const int64_t now = GetMonotonicMicros();
+        if (now >= report) {
+            printf("%lld packets/s\n", (long long)packets);
+            packets = 0;
+            report += 1000000;
+        }
+        next_frame += period;
+        if (next_frame > now) usleep(next_frame - now);
+    }
+}
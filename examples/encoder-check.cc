@@ -0,0 +1,209 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Verify the GPIO encoding of the direct and DMA output off-device: the
+ * GPIO operations they would write are recorded (see gpio-stream.h),
+ * decoded again and compared byte by byte with what the strips put into
+ * the buffers. Also times the encoding, so changes to it can be measured
+ * on any machine.
+ *
+ * The connectors get WS2801, LPD6803, LPD8806 and APA102 strips in turn.
+ */
+
+#include "gpio-stream.h"
+#include "led-strip.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+using namespace spixels;
+
+static const LEDStripProtocol kProtocols[] = {
+    PROTOCOL_WS2801, PROTOCOL_LPD6803, PROTOCOL_LPD8806, PROTOCOL_APA102
+};
+static const char *const kProtocolNames[] = {
+    "WS2801", "LPD6803", "LPD8806", "APA102"
+};
+
+static double GetTimeSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-c <n>   : Number of connectors to use (default 16).\n"
+            "\t-l <n>   : LEDs per connector (default 144).\n"
+            "\t-f <n>   : Frames to check (default 20).\n");
+    return 1;
+}
+
+static LEDStrip *CreateStrip(int protocol, MultiSPI *spi, int gpio, int leds) {
+    switch (kProtocols[protocol]) {
+    case PROTOCOL_WS2801:  return CreateWS2801Strip(spi, gpio, leds);
+    case PROTOCOL_LPD6803: return CreateLPD6803Strip(spi, gpio, leds);
+    case PROTOCOL_LPD8806: return CreateLPD8806Strip(spi, gpio, leds);
+    case PROTOCOL_APA102:  return CreateAPA102Strip(spi, gpio, leds);
+    }
+    return NULL;
+}
+
+// Bytes registered by the strip, see led-strip.cc
+static size_t StripBytes(int protocol, int leds) {
+    switch (kProtocols[protocol]) {
+    case PROTOCOL_WS2801:  return 3 * leds;
+    case PROTOCOL_LPD6803: return 4 + 2 * leds + 4;
+    case PROTOCOL_LPD8806: return 3 * leds + (leds + 31) / 32;
+    case PROTOCOL_APA102:  return 4 + 4 * leds + (leds + 15) / 16;
+    }
+    return 0;
+}
+
+// One MultiSPI with its strips.
+struct Output {
+    const char *name;
+    GPIOStream stream;
+    MultiSPI *spi;
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    double encode_seconds;
+    double send_seconds;
+    int errors;
+};
+
+int main(int argc, char *argv[]) {
+    int connectors = 16;
+    int leds = 144;
+    int frames = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:l:f:")) != -1) {
+        switch (opt) {
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        case 'f': frames = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (connectors < 1 || connectors > MultiSPI::ConnectorCount() || leds < 1
+        || frames < 1)
+        return usage(argv[0]);
+
+    // The simulated output keeps the plain bytes of each GPIO: that is
+    // what the others need to produce on the wire.
+    Output outputs[3];
+    outputs[0].name = "reference";
+    outputs[0].spi = CreateSimulatedMultiSPI(0);
+    outputs[1].name = "direct";
+    outputs[1].spi = CreateRecordingDirectMultiSPI(&outputs[1].stream);
+    outputs[2].name = "dma";
+    outputs[2].spi = CreateRecordingDMAMultiSPI(&outputs[2].stream);
+    for (int o = 0; o < 3; ++o) {
+        for (int c = 0; c < connectors; ++c) {
+            outputs[o].strips[c] = CreateStrip(
+                c % 4, outputs[o].spi, MultiSPI::SPIPinForConnector(c+1), leds);
+        }
+        outputs[o].encode_seconds = outputs[o].send_seconds = 0;
+        outputs[o].errors = 0;
+    }
+
+    // Offset of each GPIO in the reference wire frame, which has the
+    // bytes of all GPIOs in a row.
+    int connector_for_gpio[32];
+    for (int gpio = 0; gpio < 32; ++gpio) connector_for_gpio[gpio] = -1;
+    for (int c = 0; c < connectors; ++c)
+        connector_for_gpio[MultiSPI::SPIPinForConnector(c+1)] = c;
+    size_t offset[MultiSPI::MAX_CONNECTORS];
+    size_t total = 0;
+    for (int gpio = 0; gpio < 32; ++gpio) {
+        const int c = connector_for_gpio[gpio];
+        if (c < 0) continue;
+        offset[c] = total;
+        total += StripBytes(c % 4, leds);
+    }
+
+    std::vector<uint16_t> values(connectors * leds * 3);
+    std::vector<uint8_t> reference(total);
+    std::vector<LinearRGB> pixels;
+    int framing_errors = 0;
+    int max_error[4] = { 0, 0, 0, 0 };
+    srandom(42);
+    for (int f = 0; f < frames; ++f) {
+        for (size_t i = 0; i < values.size(); ++i) values[i] = random();
+        for (int o = 0; o < 3; ++o) {
+            const double start = GetTimeSeconds();
+            const uint16_t *v = &values[0];
+            for (int c = 0; c < connectors; ++c) {
+                LEDStrip *strip = outputs[o].strips[c];
+                for (int i = 0; i < leds; ++i, v += 3) {
+                    strip->SetLinearValues(i, v[0], v[1], v[2]);
+                }
+            }
+            const double encoded = GetTimeSeconds();
+            outputs[o].spi->SendBuffers();
+            outputs[o].encode_seconds += encoded - start;
+            outputs[o].send_seconds += GetTimeSeconds() - encoded;
+        }
+
+        outputs[0].spi->GetWireFrame(&reference[0]);
+        for (int o = 1; o < 3; ++o) {
+            for (int c = 0; c < connectors; ++c) {
+                const int gpio = MultiSPI::SPIPinForConnector(c+1);
+                const std::vector<uint8_t> bytes
+                    = outputs[o].stream.Decode(gpio);
+                // Shorter streams are padded to the longest one.
+                const size_t size = StripBytes(c % 4, leds);
+                if (bytes.size() < size
+                    || memcmp(&bytes[0], &reference[offset[c]], size) != 0) {
+                    outputs[o].errors++;
+                }
+            }
+        }
+
+        // What the strips show compared to the values set.
+        for (int c = 0; c < connectors; ++c) {
+            const std::vector<uint8_t> bytes(
+                reference.begin() + offset[c],
+                reference.begin() + offset[c] + StripBytes(c % 4, leds));
+            if (!DecodeStripPixels(kProtocols[c % 4], bytes, leds, &pixels)) {
+                ++framing_errors;
+                continue;
+            }
+            const uint16_t *v = &values[c * leds * 3];
+            for (int i = 0; i < leds; ++i, v += 3) {
+                const int diff[3] = { abs(pixels[i].r - v[0]),
+                                      abs(pixels[i].g - v[1]),
+                                      abs(pixels[i].b - v[2]) };
+                for (int k = 0; k < 3; ++k) {
+                    if (diff[k] > max_error[c % 4]) max_error[c % 4] = diff[k];
+                }
+            }
+        }
+    }
+
+    printf("%d frames of %d x %d LEDs\n", frames, connectors, leds);
+    printf("%-10s %14s %14s %8s %10s\n", "output", "encode usec/f",
+           "send usec/f", "errors", "GPIO ops");
+    int errors = framing_errors;
+    for (int o = 0; o < 3; ++o) {
+        printf("%-10s %14.1f %14.1f %8d %10d\n", outputs[o].name,
+               1e6 * outputs[o].encode_seconds / frames,
+               1e6 * outputs[o].send_seconds / frames, outputs[o].errors,
+               (int)outputs[o].stream.operations().size());
+        errors += outputs[o].errors;
+    }
+    printf("Largest difference of shown linear value to value set "
+           "(resolution of the protocol):\n");
+    for (int p = 0; p < 4 && p < connectors; ++p) {
+        printf("  %-8s %5d\n", kProtocolNames[p], max_error[p]);
+    }
+    if (framing_errors)
+        printf("%d strips with framing errors\n", framing_errors);
+    printf("%s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+}
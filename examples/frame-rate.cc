@@ -0,0 +1,101 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Measure how long SendBuffers() takes for different strip lengths and
+ * from that, the maximum frame rate and the fixed per-frame turnaround
+ * overhead of a MultiSPI implementation.
+ */
+
+#include "led-strip.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+using namespace spixels;
+
+static double GetTimeSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-D       : Use DMA instead of direct GPIO output.\n"
+            "\t-s <mhz> : Clock speed for direct output (default 4).\n"
+            "\t-a       : Use all 25 available GPIOs as connectors.\n"
+            "\t-c <n>   : Number of connectors to use (default: all).\n"
+            "\t-f <n>   : Frames to send per measurement (default 200).\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    bool use_dma = false;
+    float speed_mhz = 4;
+    int connectors = -1;
+    int frames = 200;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "Das:c:f:")) != -1) {
+        switch (opt) {
+        case 'D': use_dma = true; break;
+        case 'a': MultiSPI::SetPinMap(MultiSPI::kAllPinsPinMap); break;
+        case 's': speed_mhz = atof(optarg); break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'f': frames = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (connectors < 0) connectors = MultiSPI::ConnectorCount();
+    if (connectors < 1 || connectors > MultiSPI::ConnectorCount() || frames < 1)
+        return usage(argv[0]);
+
+    // Least-squares fit of time = overhead + count * per_led
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    int measurements = 0;
+
+    printf("%6s %12s %10s %8s %10s %10s\n", "LEDs", "usec/frame", "frames/s",
+           "MHz", "copy usec", "poll usec");
+    for (int count = 16; count <= 1024; count *= 2) {
+        MultiSPI *spi = use_dma
+            ? CreateDMAMultiSPI()
+            : CreateDirectMultiSPI(speed_mhz);
+        LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+        for (int c = 0; c < connectors; ++c) {
+            strips[c] = CreateAPA102Strip(spi,
+                                          MultiSPI::SPIPinForConnector(c+1),
+                                          count);
+        }
+
+        spi->SendBuffers();  // Warm-up; first call does setup work.
+        spi->ResetTransferStats();
+        const double start = GetTimeSeconds();
+        for (int f = 0; f < frames; ++f) {
+            spi->SendBuffers();
+        }
+        const double usec_per_frame = 1e6 * (GetTimeSeconds() - start) / frames;
+        // Where the time goes, as seen by the implementation.
+        const MultiSPI::TransferStats &stats = spi->transfer_stats();
+        printf("%6d %12.1f %10.1f %8.2f %10.1f %10.1f\n", count,
+               usec_per_frame, 1e6 / usec_per_frame,
+               stats.effective_clock_mhz(), stats.copy.average_nsec() / 1e3,
+               stats.poll.average_nsec() / 1e3);
+
+        sum_x += count; sum_y += usec_per_frame;
+        sum_xx += (double)count * count; sum_xy += count * usec_per_frame;
+        ++measurements;
+
+        for (int c = 0; c < connectors; ++c) delete strips[c];
+        delete spi;
+    }
+
+    const double per_led = ((measurements * sum_xy - sum_x * sum_y)
+                            / (measurements * sum_xx - sum_x * sum_x));
+    const double overhead = (sum_y - per_led * sum_x) / measurements;
+    printf("Per LED: %.3f usec; fixed turnaround per frame: %.1f usec "
+           "(frame-rate ceiling %.0f frames/s)\n",
+           per_led, overhead, overhead > 0 ? 1e6 / overhead : 0.0);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Load generator for FlaschenTaschen servers such as ft-server: sends a
+ * moving pattern as PPM datagrams as fast as possible, optionally as
+ * tiles, on a given layer.
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+static double GetTimeSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// PPM with footer for the tile at x, y on layer z.
+static void CreatePacket(int x, int y, int z, int w, int h, int frame,
+                         std::vector<uint8_t> *out) {
+    char header[64];
+    const int header_len = snprintf(header, sizeof(header),
+                                    "P6\n%d %d\n255\n", w, h);
+    out->assign(header, header + header_len);
+    for (int row = 0; row < h; ++row) {
+        for (int col = 0; col < w; ++col) {
+            out->push_back((x + col + frame) & 0xff);
+            out->push_back((y + row + frame) & 0xff);
+            out->push_back(z ? 0 : 64);  // Black in layer 0 is not visible.
+        }
+    }
+    char footer[64];
+    const int footer_len = snprintf(footer, sizeof(footer),
+                                    "\n%d %d %d\n", x, y, z);
+    out->insert(out->end(), footer, footer + footer_len);
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-h <ip>  : Server (default 127.0.0.1).\n"
+            "\t-p <port>: Port (default 1337).\n"
+            "\t-g <WxH> : Display size (default 16x144).\n"
+            "\t-T <WxH> : Send in tiles of this size (default: whole display).\n"
+            "\t-z <n>   : Layer (default 0).\n"
+            "\t-r <fps> : Frames per second (default: as fast as possible).\n"
+            "\t-t <sec> : Seconds to run (default 5).\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    int port = 1337;
+    int width = 16, height = 144;
+    int tile_w = -1, tile_h = -1;
+    int layer = 0;
+    float fps = 0;
+    int seconds = 5;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:g:T:z:r:t:")) != -1) {
+        switch (opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'g':
+            if (sscanf(optarg, "%dx%d", &width, &height) != 2)
+                return usage(argv[0]);
+            break;
+        case 'T':
+            if (sscanf(optarg, "%dx%d", &tile_w, &tile_h) != 2)
+                return usage(argv[0]);
+            break;
+        case 'z': layer = atoi(optarg); break;
+        case 'r': fps = atof(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (tile_w < 0) { tile_w = width; tile_h = height; }
+    if (width < 1 || height < 1 || tile_w < 1 || tile_h < 1
+        || 3 * tile_w * tile_h > 65000)
+        return usage(argv[0]);
+
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &addr.sin_addr);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect()");
+        return 1;
+    }
+
+    std::vector<uint8_t> packet;
+    int64_t frames = 0, packets = 0;
+    const double start = GetTimeSeconds();
+    const double end = start + seconds;
+    for (int frame = 0; GetTimeSeconds() < end; ++frame) {
+        for (int y = 0; y < height; y += tile_h) {
+            for (int x = 0; x < width; x += tile_w) {
+                CreatePacket(x, y, layer, tile_w, tile_h, frame, &packet);
+                // Server busy: just drop, as a display would.
+                if (send(fd, &packet[0], packet.size(), 0) > 0)
+                    ++packets;
+            }
+        }
+        ++frames;
+        if (fps > 0) {
+            const double next = start + frames / fps;
+            const double wait = next - GetTimeSeconds();
+            if (wait > 0) usleep(wait * 1e6);
+        }
+    }
+    close(fd);
+    printf("%.1f frames/s, %.1f packets/s\n",
+           (double)frames / seconds, (double)packets / seconds);
+    return 0;
+}
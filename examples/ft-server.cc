@@ -0,0 +1,94 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * FlaschenTaschen server: a display of one column per connector, receiving
+ * PPM images via UDP. Prints packet and frame rates every second.
+ *
+ * Send images e.g. with ft-send, or with the FlaschenTaschen tools:
+ *   bash$ cat image.ppm | socat STDIO UDP-SENDTO:localhost:1337
+ */
+
+#include "canvas.h"
+#include "flaschen-taschen-server.h"
+#include "led-strip.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-D       : Use DMA instead of direct GPIO output.\n"
+            "\t-c <n>   : Number of connectors (=columns) (default 16).\n"
+            "\t-l <n>   : LEDs per connector (=rows) (default 144).\n"
+            "\t-L <n>   : Columns per strip, zig-zag wired (default 1).\n"
+            "\t-t <sec> : Layer timeout (default 15).\n"
+            "\t-p <port>: UDP port to listen on (default 1337).\n");
+    return 1;
+}
+
+static void *ServerThread(void *server) {
+    ((FlaschenTaschenServer*)server)->Run();
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    bool use_dma = false;
+    int connectors = 16;
+    int leds = 144;
+    int lines_per_strip = 1;
+    int timeout = 15;
+    int port = FlaschenTaschenServer::DEFAULT_PORT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "Dc:l:L:t:p:")) != -1) {
+        switch (opt) {
+        case 'D': use_dma = true; break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        case 'L': lines_per_strip = atoi(optarg); break;
+        case 't': timeout = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (connectors < 1 || connectors > MultiSPI::ConnectorCount()
+        || lines_per_strip < 1 || leds < lines_per_strip)
+        return usage(argv[0]);
+
+    MultiSPI *spi = use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI();
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    for (int c = 0; c < connectors; ++c) {
+        strips[c] = CreateAPA102Strip(spi, MultiSPI::SPIPinForConnector(c+1),
+                                      leds);
+    }
+    spi->Prepare();
+
+    Canvas::Layout layout;
+    layout.width = connectors * lines_per_strip;
+    layout.height = leds / lines_per_strip;
+    layout.lines_per_strip = lines_per_strip;
+    Canvas canvas(strips, connectors, layout);
+    printf("Display is %dx%d\n", canvas.width(), canvas.height());
+
+    FlaschenTaschenServer server(spi, &canvas, timeout);
+    if (!server.Listen(port))
+        return 1;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &ServerThread, &server);
+    FlaschenTaschenServer::Stats last = server.stats();
+    for (;;) {
+        sleep(1);
+        const FlaschenTaschenServer::Stats now = server.stats();
+        printf("%6lld packets/s (%lld bad) %5lld frames/s\n",
+               (long long)(now.packets - last.packets),
+               (long long)(now.bad_packets - last.bad_packets),
+               (long long)(now.frames - last.frames));
+        last = now;
+    }
+}
@@ -0,0 +1,79 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Open Pixel Control server: shows OPC channel 1..n on connector 1..n.
+ * Prints throughput every second.
+ *
+ * Test locally with opc-load.
+ */
+
+#include "led-strip.h"
+#include "opc-server.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-D       : Use DMA instead of direct GPIO output.\n"
+            "\t-c <n>   : Number of connectors to use (default 16).\n"
+            "\t-l <n>   : LEDs per connector (default 144).\n"
+            "\t-p <port>: TCP port to listen on (default 7890).\n");
+    return 1;
+}
+
+static void *ServerThread(void *server) {
+    ((OPCServer*)server)->Run();
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    bool use_dma = false;
+    int connectors = 16;
+    int leds = 144;
+    int port = OPCServer::DEFAULT_PORT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "Dc:l:p:")) != -1) {
+        switch (opt) {
+        case 'D': use_dma = true; break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (connectors < 1 || connectors > MultiSPI::ConnectorCount() || leds < 1)
+        return usage(argv[0]);
+
+    MultiSPI *spi = use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI();
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    for (int c = 0; c < connectors; ++c) {
+        strips[c] = CreateAPA102Strip(spi, MultiSPI::SPIPinForConnector(c+1),
+                                      leds);
+    }
+    spi->Prepare();
+
+    OPCServer server(spi);
+    server.MapStrips(strips, connectors);
+    if (!server.Listen(port))
+        return 1;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &ServerThread, &server);
+    OPCServer::Stats last = server.stats();
+    for (;;) {
+        sleep(1);
+        const OPCServer::Stats now = server.stats();
+        printf("%6lld messages/s %8.3f MB/s %5lld frames/s\n",
+               (long long)(now.messages - last.messages),
+               (now.bytes - last.bytes) / 1e6,
+               (long long)(now.frames - last.frames));
+        last = now;
+    }
+}
@@ -0,0 +1,171 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Load generator for Open Pixel Control servers such as opc-bridge.
+ * Multiple clients send frames as fast as possible, either complete frames
+ * or, with -d, delta frames with only a fraction of the pixels changed.
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+struct ClientConfig {
+    const char *host;
+    int port;
+    int channels;
+    int pixels;          // per channel
+    int delta_percent;   // 0: full frames.
+    int seconds;
+    int64_t frames;      // Result
+    int64_t bytes;
+};
+
+static double GetTimeSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void AppendBE16(std::vector<uint8_t> *out, int value) {
+    out->push_back(value >> 8);
+    out->push_back(value & 0xff);
+}
+
+// Message for one channel; either all pixels or a delta of "changed" runs.
+static void CreateMessage(int channel, int pixels, int frame,
+                          int delta_percent, std::vector<uint8_t> *out) {
+    out->clear();
+    out->push_back(channel);
+    if (delta_percent == 0) {
+        out->push_back(0);
+        AppendBE16(out, 3 * pixels);
+        for (int i = 0; i < pixels; ++i) {
+            out->push_back((i + frame) & 0xff);
+            out->push_back((i * 2 + frame) & 0xff);
+            out->push_back((i * 3 + frame) & 0xff);
+        }
+        return;
+    }
+    out->push_back(255);
+    AppendBE16(out, 0);   // Length filled in below.
+    AppendBE16(out, 0x7370);
+    out->push_back(0x01);
+    // One run of changed pixels at a moving position.
+    const int changed = pixels * delta_percent / 100;
+    const int offset = (frame * 7) % (pixels - changed + 1);
+    AppendBE16(out, offset);
+    AppendBE16(out, changed);
+    for (int i = 0; i < changed; ++i) {
+        out->push_back(frame & 0xff);
+        out->push_back((frame * 2) & 0xff);
+        out->push_back(i & 0xff);
+    }
+    const int payload = out->size() - 4;
+    (*out)[2] = payload >> 8;
+    (*out)[3] = payload & 0xff;
+}
+
+static void *ClientMain(void *arg) {
+    ClientConfig *config = (ClientConfig*) arg;
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port);
+    inet_pton(AF_INET, config->host, &addr.sin_addr);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect()");
+        return NULL;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    std::vector<uint8_t> frame_data, message;
+    const double end = GetTimeSeconds() + config->seconds;
+    for (int frame = 0; GetTimeSeconds() < end; ++frame) {
+        frame_data.clear();
+        for (int c = 1; c <= config->channels; ++c) {
+            CreateMessage(c, config->pixels, frame, config->delta_percent,
+                          &message);
+            frame_data.insert(frame_data.end(), message.begin(), message.end());
+        }
+        if (write(fd, &frame_data[0], frame_data.size())
+            != (ssize_t)frame_data.size()) {
+            perror("write()");
+            break;
+        }
+        config->frames++;
+        config->bytes += frame_data.size();
+    }
+    close(fd);
+    return NULL;
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-h <ip>  : Server (default 127.0.0.1).\n"
+            "\t-p <port>: Port (default 7890).\n"
+            "\t-n <n>   : Number of clients (default 1).\n"
+            "\t-c <n>   : Channels per frame (default 16).\n"
+            "\t-l <n>   : Pixels per channel (default 144).\n"
+            "\t-d <pct> : Send delta frames with this percentage of pixels "
+            "changed.\n"
+            "\t-t <sec> : Seconds to run (default 5).\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    ClientConfig config;
+    bzero(&config, sizeof(config));
+    config.host = "127.0.0.1";
+    config.port = 7890;
+    config.channels = 16;
+    config.pixels = 144;
+    config.seconds = 5;
+    int clients = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:n:c:l:d:t:")) != -1) {
+        switch (opt) {
+        case 'h': config.host = optarg; break;
+        case 'p': config.port = atoi(optarg); break;
+        case 'n': clients = atoi(optarg); break;
+        case 'c': config.channels = atoi(optarg); break;
+        case 'l': config.pixels = atoi(optarg); break;
+        case 'd': config.delta_percent = atoi(optarg); break;
+        case 't': config.seconds = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (clients < 1 || config.channels < 1 || config.channels > 255
+        || config.pixels < 1 || config.pixels > 21845
+        || config.delta_percent < 0 || config.delta_percent > 100)
+        return usage(argv[0]);
+
+    std::vector<ClientConfig> configs(clients, config);
+    std::vector<pthread_t> threads(clients);
+    for (int i = 0; i < clients; ++i) {
+        pthread_create(&threads[i], NULL, &ClientMain, &configs[i]);
+    }
+    int64_t frames = 0, bytes = 0;
+    for (int i = 0; i < clients; ++i) {
+        pthread_join(threads[i], NULL);
+        frames += configs[i].frames;
+        bytes += configs[i].bytes;
+    }
+    printf("%d clients: %.1f frames/s, %.3f MB/s\n", clients,
+           (double)frames / config.seconds, bytes / 1e6 / config.seconds);
+    return 0;
+}
@@ -3,8 +3,7 @@
  */
 
 #include "led-strip.h"
-
-#include <unistd.h>  // for usleep()
+#include "frame-clock.h"
 
 #define FRAME_RATE 60
 
@@ -25,6 +24,10 @@ int main() {
     LEDStrip *strip2 = CreateAPA102Strip(spi, MultiSPI::SPI_P2, 144);
     // ... register more strips here. They can be of different types
 
+    // Sends frames at a steady rate. See include/frame-clock.h
+    FrameClock frame_clock(spi, FRAME_RATE);
+    int64_t deadline = FrameClock::Now();
+
     for (unsigned int i = 0; /**/; ++i) {
 	const int pos = i % strip1->count();
         strip1->SetPixel(pos, 0x000000);   // clear previous pixel.
@@ -44,8 +47,9 @@ int main() {
         // A Blue pixel on the second strip.
         strip2->SetPixel(pos+1, 0, 0, 255);
     
-        spi->SendBuffers();  // Send all pixels out at once.
-        usleep(1000000 / FRAME_RATE);
+        // Send all pixels out at once, at the time the next frame is due.
+        deadline = frame_clock.NextDeadline(deadline);
+        frame_clock.SendBuffersAt(deadline);
     }
 
     delete strip1;
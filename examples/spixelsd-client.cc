@@ -0,0 +1,82 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Client for spixelsd: draws a moving rainbow, or with -d a single moving
+ * dot, on one layer of the daemon. Run multiple of these on different
+ * layers to see them composed.
+ */
+
+#include "shared-frame-client.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace spixels;
+
+static RGBc Wheel(int pos) {
+    pos &= 0xff;
+    if (pos < 85) return RGBc(255 - pos * 3, pos * 3, 0);
+    pos -= 85;
+    if (pos < 85) return RGBc(0, 255 - pos * 3, pos * 3);
+    pos -= 85;
+    return RGBc(pos * 3, 0, 255 - pos * 3);
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-z <layer> : Layer to draw on (default 0).\n"
+            "\t-d         : Draw a dot on black, blended with 'lighten'.\n"
+            "\t-o <0..255>: Layer opacity (default 255).\n"
+            "\t-r <fps>   : Frames to publish per second (default 60).\n"
+            "\t-s <path>  : Socket (default /tmp/spixelsd.socket).\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int layer = 0;
+    bool dot = false;
+    int opacity = 255;
+    float fps = 60;
+    const char *socket_path = "/tmp/spixelsd.socket";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "z:do:r:s:")) != -1) {
+        switch (opt) {
+        case 'z': layer = atoi(optarg); break;
+        case 'd': dot = true; break;
+        case 'o': opacity = atoi(optarg); break;
+        case 'r': fps = atof(optarg); break;
+        case 's': socket_path = optarg; break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (opacity < 0 || opacity > 255 || fps <= 0)
+        return usage(argv[0]);
+
+    SharedFrameClient client;
+    if (!client.Connect(socket_path, layer,
+                        dot ? Compositor::BLEND_LIGHTEN
+                            : Compositor::BLEND_NORMAL,
+                        opacity))
+        return 1;
+    printf("Connected: %d strips\n", client.strip_count());
+
+    for (int frame = 0; /**/; ++frame) {
+        for (int s = 0; s < client.strip_count(); ++s) {
+            RGBc *const pixels = client.pixels(s);
+            const int length = client.strip_length(s);
+            for (int i = 0; i < length; ++i) {
+                if (dot) {
+                    pixels[i] = (i == frame % length) ? RGBc(255, 255, 255)
+                                                      : RGBc(0, 0, 0);
+                } else {
+                    pixels[i] = Wheel(i + s * 16 + frame);
+                }
+            }
+        }
+        client.PublishFrame();
+        usleep(1e6 / fps);
+    }
+}
@@ -0,0 +1,98 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Daemon that owns the hardware and lets other programs draw on the strips
+ * via shared memory (see shared-frame-client.h, and spixelsd-client for an
+ * example). Each client draws on its own layer; the daemon composes them
+ * and sends at a fixed frame rate.
+ *
+ * With -S, no hardware is used, so the daemon and clients can be tried
+ * out on any Linux machine.
+ */
+
+#include "frame-clock.h"
+#include "led-strip.h"
+#include "shared-frame-server.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-D         : Use DMA instead of direct GPIO output.\n"
+            "\t-S         : Simulate: don't access any hardware.\n"
+            "\t-c <n>     : Number of connectors to use (default 16).\n"
+            "\t-l <n>     : LEDs per connector (default 144).\n"
+            "\t-r <fps>   : Frame rate (default 60).\n"
+            "\t-L <n>     : Number of layers = clients (default 8).\n"
+            "\t-s <path>  : Socket (default /tmp/spixelsd.socket).\n");
+    return 1;
+}
+
+static void *ServerThread(void *arg) {
+    void **args = (void**) arg;
+    ((SharedFrameServer*)args[0])->Run((FrameClock*)args[1]);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    bool use_dma = false;
+    bool simulate = false;
+    int connectors = 16;
+    int leds = 144;
+    float fps = 60;
+    int layers = 8;
+    const char *socket_path = "/tmp/spixelsd.socket";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "DSc:l:r:L:s:")) != -1) {
+        switch (opt) {
+        case 'D': use_dma = true; break;
+        case 'S': simulate = true; break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        case 'r': fps = atof(optarg); break;
+        case 'L': layers = atoi(optarg); break;
+        case 's': socket_path = optarg; break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (connectors < 1 || connectors > MultiSPI::ConnectorCount() || leds < 1
+        || fps <= 0 || layers < 1)
+        return usage(argv[0]);
+
+    MultiSPI *spi = simulate
+        ? CreateSimulatedMultiSPI()
+        : (use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI());
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    for (int c = 0; c < connectors; ++c) {
+        strips[c] = CreateAPA102Strip(spi, MultiSPI::SPIPinForConnector(c+1),
+                                      leds);
+    }
+    spi->Prepare();
+
+    SharedFrameServer server(strips, connectors, layers);
+    if (!server.Listen(socket_path))
+        return 1;
+
+    FrameClock clock(spi, fps);
+    void *args[2] = { &server, &clock };
+    pthread_t thread;
+    pthread_create(&thread, NULL, &ServerThread, args);
+    SharedFrameServer::Stats last = server.stats();
+    for (;;) {
+        sleep(1);
+        const SharedFrameServer::Stats now = server.stats();
+        printf("%3lld clients connected, %5lld client frames/s, "
+               "%4lld frames/s\n",
+               (long long)now.clients,
+               (long long)(now.client_frames - last.client_frames),
+               (long long)(now.frames - last.frames));
+        last = now;
+    }
+}
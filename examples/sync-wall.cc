@@ -0,0 +1,173 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Show an animation in sync on several Raspberry Pis (see frame-sync.h).
+ * Start one master (-m), which announces the frames and reports the skew
+ * between nodes, and a node on each Pi.
+ *
+ * To try it on a single Linux machine, run a master and a few simulated
+ * nodes with different clock offsets on the loopback interface:
+ *   sync-wall -m -i 127.0.0.1 &
+ *   sync-wall -S -i 127.0.0.1 -o 50 &
+ *   sync-wall -S -i 127.0.0.1 -o -30 &
+ */
+
+#include "frame-sync.h"
+#include "led-strip.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options]\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-m         : Master: announce frames, report skew.\n"
+            "\t-r <fps>   : Frame rate, for the master (default 60).\n"
+            "\t-g <group> : Multicast group (default %s).\n"
+            "\t-p <port>  : Port (default %d).\n"
+            "\t-i <addr>  : Local address of the interface to use.\n"
+            "\t-D         : Use DMA instead of direct GPIO output.\n"
+            "\t-S         : Simulate: don't access any hardware.\n"
+            "\t-o <msec>  : Simulated clock offset of this node.\n"
+            "\t-c <n>     : Number of connectors to use (default 16).\n"
+            "\t-l <n>     : LEDs per connector (default 144).\n",
+            FRAME_SYNC_DEFAULT_GROUP, FRAME_SYNC_DEFAULT_PORT);
+    return 1;
+}
+
+// A rainbow moving along the strips; the same on all nodes.
+class Rainbow : public FrameRenderer {
+public:
+    Rainbow(LEDStrip **strips, int count) : strips_(strips), count_(count) {}
+
+    virtual bool RenderFrame(int64_t frame, int64_t deadline_nsec) {
+        for (int s = 0; s < count_; ++s) {
+            LEDStrip *strip = strips_[s];
+            for (int i = 0; i < strip->count(); ++i) {
+                const int pos = (i + s * 8 + frame) % 768;
+                const int v = pos % 256;
+                if (pos < 256)      strip->SetPixel(i, 255 - v, v, 0);
+                else if (pos < 512) strip->SetPixel(i, 0, 255 - v, v);
+                else                strip->SetPixel(i, v, 0, 255 - v);
+            }
+        }
+        return true;
+    }
+
+private:
+    LEDStrip **const strips_;
+    const int count_;
+};
+
+static void *MasterThread(void *arg) {
+    void **args = (void**) arg;
+    ((FrameSyncMaster*)args[0])->Run(*(float*)args[1]);
+    return NULL;
+}
+
+static void *NodeThread(void *arg) {
+    void **args = (void**) arg;
+    ((FrameSyncNode*)args[0])->Run((FrameRenderer*)args[1]);
+    return NULL;
+}
+
+static int RunMaster(const char *group, int port, const char *interface,
+                     float fps) {
+    FrameSyncMaster master;
+    if (!master.Open(group, port, interface))
+        return 1;
+    void *args[2] = { &master, &fps };
+    pthread_t thread;
+    pthread_create(&thread, NULL, &MasterThread, args);
+    FrameSyncMaster::Stats last = master.stats();
+    for (;;) {
+        sleep(1);
+        const FrameSyncMaster::Stats now = master.stats();
+        const int64_t frames = now.skew_frames - last.skew_frames;
+        if (frames > 0) {
+            printf("%d nodes, %4lld frames; skew avg %7.1f usec, "
+                   "max %7.1f usec (host clock: avg %7.1f, max %7.1f)\n",
+                   now.nodes, (long long)frames,
+                   (now.sum_skew_nsec - last.sum_skew_nsec) / 1e3 / frames,
+                   now.max_skew_nsec / 1e3,
+                   (now.sum_host_skew_nsec - last.sum_host_skew_nsec)
+                   / 1e3 / frames,
+                   now.max_host_skew_nsec / 1e3);
+        } else {
+            printf("%d nodes, no frames shown by more than one node\n",
+                   now.nodes);
+        }
+        last = now;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool is_master = false;
+    float fps = 60;
+    const char *group = FRAME_SYNC_DEFAULT_GROUP;
+    int port = FRAME_SYNC_DEFAULT_PORT;
+    const char *interface = NULL;
+    bool use_dma = false;
+    bool simulate = false;
+    float offset_msec = 0;
+    int connectors = 16;
+    int leds = 144;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "mr:g:p:i:DSo:c:l:")) != -1) {
+        switch (opt) {
+        case 'm': is_master = true; break;
+        case 'r': fps = atof(optarg); break;
+        case 'g': group = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'i': interface = optarg; break;
+        case 'D': use_dma = true; break;
+        case 'S': simulate = true; break;
+        case 'o': offset_msec = atof(optarg); break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (connectors < 1 || connectors > MultiSPI::ConnectorCount() || leds < 1
+        || fps <= 0)
+        return usage(argv[0]);
+
+    if (is_master)
+        return RunMaster(group, port, interface, fps);
+
+    MultiSPI *spi = simulate
+        ? CreateSimulatedMultiSPI()
+        : (use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI());
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    for (int c = 0; c < connectors; ++c) {
+        strips[c] = CreateAPA102Strip(spi, MultiSPI::SPIPinForConnector(c+1),
+                                      leds);
+    }
+    spi->Prepare();
+
+    FrameSyncNode node(spi);
+    node.set_simulated_clock_offset((int64_t)(offset_msec * 1e6));
+    if (!node.Join(group, port, interface))
+        return 1;
+    Rainbow rainbow(strips, connectors);
+    void *args[2] = { &node, &rainbow };
+    pthread_t thread;
+    pthread_create(&thread, NULL, &NodeThread, args);
+    FrameSyncNode::Stats last = node.stats();
+    for (;;) {
+        sleep(1);
+        const FrameSyncNode::Stats now = node.stats();
+        printf("%4lld frames/s, %lld missed; clock offset %9.3f msec "
+               "(round trip %5.1f usec), latest latch %5.1f usec\n",
+               (long long)(now.frames_presented - last.frames_presented),
+               (long long)(now.frames_missed - last.frames_missed),
+               now.clock_offset_nsec / 1e6, now.round_trip_nsec / 1e3,
+               now.max_late_nsec / 1e3);
+        last = now;
+    }
+}
@@ -0,0 +1,144 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Show raw video on a display of one column per connector. The video is
+ * scaled to the display size. Prints the throughput of each stage every
+ * second.
+ *
+ * Example:
+ *   ffmpeg -i movie.mp4 -f rawvideo -pix_fmt rgb24 -s 160x144 - \
+ *      | sudo ./video-pipe -g 160x144 -r 25
+ */
+
+#include "canvas.h"
+#include "frame-clock.h"
+#include "frame-trace.h"
+#include "led-strip.h"
+#include "video-pipeline.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options] [<raw-video-file>]\n", progname);
+    fprintf(stderr, "Reads rgb24 frames from the file or stdin.\n"
+            "Options:\n"
+            "\t-g <WxH> : Size of the video frames (required).\n"
+            "\t-r <fps> : Frame rate (default: as fast as possible).\n"
+            "\t-D       : Use DMA instead of direct GPIO output.\n"
+            "\t-S       : Simulate: don't access any hardware.\n"
+            "\t-c <n>   : Number of connectors (=columns) (default 16).\n"
+            "\t-l <n>   : LEDs per connector (=rows) (default 144).\n"
+            "\t-L <n>   : Columns per strip, zig-zag wired (default 1).\n"
+            "\t-q <n>   : Frames queued between stages (default 4).\n"
+            "\t-T <file>: Write a frame timeline trace (Chrome JSON).\n");
+    return 1;
+}
+
+static void PrintStats(const VideoPipeline &pipeline,
+                       VideoPipeline::StageStats *last, double seconds) {
+    static const char *const names[] = { "read", "map", "send" };
+    for (int s = 0; s < VideoPipeline::STAGE_COUNT; ++s) {
+        const VideoPipeline::StageStats &now
+            = pipeline.stats((VideoPipeline::Stage)s);
+        const int64_t busy = now.busy_nsec - last[s].busy_nsec;
+        const int64_t wait = now.wait_nsec - last[s].wait_nsec;
+        printf("%s %6.1f fps %7.2f MB/s %3.0f%% busy   ", names[s],
+               (now.frames - last[s].frames) / seconds,
+               (now.bytes - last[s].bytes) / 1e6 / seconds,
+               busy + wait > 0 ? 100.0 * busy / (busy + wait) : 0.0);
+        last[s] = now;
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int video_width = -1, video_height = -1;
+    float fps = 0;
+    bool use_dma = false;
+    bool simulate = false;
+    int connectors = 16;
+    int leds = 144;
+    int lines_per_strip = 1;
+    int queue_frames = 4;
+    const char *trace_file = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:r:DSc:l:L:q:T:")) != -1) {
+        switch (opt) {
+        case 'g':
+            if (sscanf(optarg, "%dx%d", &video_width, &video_height) != 2)
+                return usage(argv[0]);
+            break;
+        case 'r': fps = atof(optarg); break;
+        case 'D': use_dma = true; break;
+        case 'S': simulate = true; break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        case 'L': lines_per_strip = atoi(optarg); break;
+        case 'q': queue_frames = atoi(optarg); break;
+        case 'T': trace_file = optarg; break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (video_width < 1 || video_height < 1 || connectors < 1
+        || connectors > MultiSPI::ConnectorCount()
+        || lines_per_strip < 1 || leds < lines_per_strip || queue_frames < 1)
+        return usage(argv[0]);
+
+    int fd = STDIN_FILENO;
+    if (optind < argc) {
+        fd = open(argv[optind], O_RDONLY);
+        if (fd < 0) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    MultiSPI *spi = simulate
+        ? CreateSimulatedMultiSPI()
+        : (use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI());
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    for (int c = 0; c < connectors; ++c) {
+        strips[c] = CreateAPA102Strip(spi, MultiSPI::SPIPinForConnector(c+1),
+                                      leds);
+    }
+    spi->Prepare();
+
+    Canvas::Layout layout;
+    layout.width = connectors * lines_per_strip;
+    layout.height = leds / lines_per_strip;
+    layout.lines_per_strip = lines_per_strip;
+    Canvas canvas(strips, connectors, layout);
+
+    if (trace_file && !StartFrameTrace()) {
+        fprintf(stderr, "Can't allocate trace.\n");
+        return 1;
+    }
+    FrameClock *clock = fps > 0 ? new FrameClock(spi, fps) : NULL;
+    VideoPipeline pipeline(spi, &canvas, video_width, video_height,
+                           queue_frames);
+    pipeline.Start(fd, clock);
+
+    VideoPipeline::StageStats last[VideoPipeline::STAGE_COUNT] = {};
+    int64_t last_time = FrameClock::Now();
+    while (pipeline.running()) {
+        usleep(100000);
+        const int64_t now = FrameClock::Now();
+        if (now - last_time >= 1000000000LL || !pipeline.running()) {
+            PrintStats(pipeline, last, (now - last_time) / 1e9);
+            last_time = now;
+        }
+    }
+    pipeline.Wait();
+    if (trace_file) {
+        StopFrameTrace();
+        if (!WriteFrameTrace(trace_file)) return 1;
+    }
+    delete clock;
+    return 0;
+}
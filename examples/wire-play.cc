@@ -0,0 +1,65 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Play a recording of pre-encoded frames (see wire-record). The frames are
+ * sent straight from the file, without any pixel operations or encoding.
+ * Use the same output option (-D, -S or none) as used when recording.
+ */
+
+#include "frame-clock.h"
+#include "wire-recording.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options] <recording-file>\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-D         : Use DMA instead of direct GPIO output.\n"
+            "\t-S         : Simulate: don't access any hardware.\n"
+            "\t-s <speed> : Playback speed; 0 for as fast as possible "
+            "(default 1).\n"
+            "\t-l         : Loop forever.\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    bool use_dma = false;
+    bool simulate = false;
+    float speed = 1.0;
+    bool loop = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "DSs:l")) != -1) {
+        switch (opt) {
+        case 'D': use_dma = true; break;
+        case 'S': simulate = true; break;
+        case 's': speed = atof(optarg); break;
+        case 'l': loop = true; break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || speed < 0)
+        return usage(argv[0]);
+
+    MultiSPI *spi = simulate
+        ? CreateSimulatedMultiSPI()
+        : (use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI());
+    WirePlayer player(spi);
+    if (!player.Open(argv[optind]))
+        return 1;
+    printf("%d frames, %.1f seconds\n", player.frame_count(),
+           player.duration_usec() / 1e6);
+
+    const int64_t start = FrameClock::Now();
+    player.Play(speed, loop);
+    const double seconds = (FrameClock::Now() - start) / 1e9;
+    const WirePlayer::Stats &stats = player.stats();
+    printf("Sent %lld frames in %.2f seconds (%.1f frames/s); "
+           "latest frame start %lld usec\n",
+           (long long)stats.frames_sent, seconds,
+           stats.frames_sent / seconds, (long long)stats.max_late_usec);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+ * Record an animation as pre-encoded frames, to be played with wire-play.
+ * With -n, the animation is only rendered to the file, as fast as
+ * possible, not shown.
+ */
+
+#include "led-strip.h"
+#include "wire-recording.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace spixels;
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options] <recording-file>\n", progname);
+    fprintf(stderr, "Options:\n"
+            "\t-D       : Use DMA instead of direct GPIO output.\n"
+            "\t-S       : Simulate: don't access any hardware.\n"
+            "\t-c <n>   : Number of connectors to use (default 16).\n"
+            "\t-l <n>   : LEDs per connector (default 144).\n"
+            "\t-r <fps> : Frame rate (default 60).\n"
+            "\t-t <sec> : Length of the recording (default 10).\n"
+            "\t-n       : Don't show while recording.\n");
+    return 1;
+}
+
+static RGBc Wheel(int pos) {
+    pos &= 0xff;
+    if (pos < 85) return RGBc(255 - pos * 3, pos * 3, 0);
+    pos -= 85;
+    if (pos < 85) return RGBc(0, 255 - pos * 3, pos * 3);
+    pos -= 85;
+    return RGBc(pos * 3, 0, 255 - pos * 3);
+}
+
+int main(int argc, char *argv[]) {
+    bool use_dma = false;
+    bool simulate = false;
+    int connectors = 16;
+    int leds = 144;
+    float fps = 60;
+    int seconds = 10;
+    bool show = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "DSc:l:r:t:n")) != -1) {
+        switch (opt) {
+        case 'D': use_dma = true; break;
+        case 'S': simulate = true; break;
+        case 'c': connectors = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        case 'r': fps = atof(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'n': show = false; break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || connectors < 1
+        || connectors > MultiSPI::ConnectorCount() || leds < 1 || fps <= 0)
+        return usage(argv[0]);
+
+    MultiSPI *spi = simulate
+        ? CreateSimulatedMultiSPI()
+        : (use_dma ? CreateDMAMultiSPI() : CreateDirectMultiSPI());
+    WireRecorder recorder(spi);
+    if (!recorder.Open(argv[optind]))
+        return 1;
+    recorder.set_send(show);
+
+    // The strips are on the recorder, which passes everything on to spi.
+    LEDStrip *strips[MultiSPI::MAX_CONNECTORS];
+    for (int c = 0; c < connectors; ++c) {
+        strips[c] = CreateAPA102Strip(&recorder,
+                                      MultiSPI::SPIPinForConnector(c+1), leds);
+    }
+
+    const int frames = seconds * fps;
+    for (int f = 0; f < frames; ++f) {
+        for (int c = 0; c < connectors; ++c) {
+            for (int i = 0; i < leds; ++i) {
+                strips[c]->SetPixel(i, Wheel(i + 16 * c + f));
+            }
+        }
+        recorder.RecordFrame(f * 1e6 / fps);
+        if (show) spi->SendBuffers();  // Recorded already.
+    }
+    if (!recorder.Close())
+        return 1;
+    printf("Recorded %d frames\n", recorder.frames());
+    return 0;
+}
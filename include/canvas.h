@@ -0,0 +1,110 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_CANVAS_H
+#define SPIXELS_CANVAS_H
+
+#include <vector>
+
+#include "led-strip.h"
+
+namespace spixels {
+// A 2D display made of LED strips, each strip covering one or more lines
+// (columns or rows) of the display, like in FlaschenTaschen.
+//
+// The mapping from (x, y) to strip and LED index is calculated once, so
+// setting a whole image with Blit() only needs a few memory copies per
+// strip before the pixels are encoded.
+class Canvas {
+public:
+    struct Layout {
+        Layout() : width(0), height(0), strips_are_columns(true),
+                   lines_per_strip(1), serpentine(true),
+                   start_at_far_end(false) {}
+
+        int width;
+        int height;
+
+        // If true, strips run vertically along columns; otherwise
+        // horizontally along rows.
+        bool strips_are_columns;
+
+        // Number of columns (or rows) covered by each strip.
+        // The strips passed to the Canvas cover the lines in order, so with
+        // columns, the first strip covers x = [0 .. lines_per_strip).
+        int lines_per_strip;
+
+        // If a strip covers multiple lines: when set, it zig-zags, i.e.
+        // every other line runs in the opposite direction. Otherwise all
+        // lines of the strip run in the same direction.
+        bool serpentine;
+
+        // The first LED of each strip is at the bottom (columns) or at the
+        // right (rows) instead of at the top or left.
+        bool start_at_far_end;
+    };
+
+    // Create a canvas on the given strips, which need to be in order
+    // of the lines they cover. Does not take ownership. Pixels of the
+    // layout that are not covered by any strip are ignored.
+    Canvas(LEDStrip *const *strips, int strip_count, const Layout &layout);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    void SetPixel(int x, int y, const RGBc &c);
+
+    // Set the whole canvas from an image with width() x height() pixels,
+    // row by row. "stride" is the number of pixels from the start of
+    // one row to the next in "image"; 0 means width().
+    void Blit(const RGBc *image, int stride = 0);
+
+    // Set a rectangle of "w" x "h" pixels at (x, y) from "image", which
+    // has "stride" pixels per row. Parts outside the canvas are ignored.
+    void BlitRect(int x, int y, int w, int h, const RGBc *image, int stride);
+
+private:
+    // Consecutive LEDs of a strip that are consecutive pixels in a row of
+    // the image, possibly in reverse.
+    struct Run {
+        int x, y;       // Image position of the first LED of the run.
+        int led;        // Index of first LED in the strip.
+        int length;
+        bool reversed;  // Image x decreases with increasing LED index.
+    };
+
+    struct StripMap {
+        LEDStrip *strip;
+        int leds;       // LEDs used by the canvas.
+        std::vector<Run> runs;
+    };
+
+    // Strip and LED index for each pixel; strip -1 if not covered.
+    struct Location {
+        int strip;
+        int led;
+    };
+
+    const int width_;
+    const int height_;
+    std::vector<StripMap> strips_;
+    std::vector<Location> locations_;  // width_ * height_
+    std::vector<RGBc> staging_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_CANVAS_H
@@ -0,0 +1,98 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_COMPOSITOR_H
+#define SPIXELS_COMPOSITOR_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "led-strip.h"
+
+namespace spixels {
+// Merges several independent layers of content (e.g. background animation,
+// overlays, alerts) into the same set of strips.
+//
+// Each layer has a color and an alpha value per pixel, an opacity for the
+// whole layer, and a blend mode. Layer 0 is at the bottom, on black.
+// Compose() blends all layers and writes the result to the strips.
+//
+// Only what changed is recalculated: the intermediate result below each
+// layer is kept, so changing a layer only re-blends that layer and the ones
+// above it. If nothing changed, Compose() does nothing.
+class Compositor {
+public:
+    enum BlendMode {
+        BLEND_NORMAL,     // Layer color on top.
+        BLEND_ADD,        // Sum, saturating at full brightness.
+        BLEND_MULTIPLY,   // Darkens; white is neutral.
+        BLEND_SCREEN,     // Brightens; black is neutral.
+        BLEND_LIGHTEN,    // Brighter of both, per color channel.
+    };
+
+    // Composite onto the given strips. Does not take ownership.
+    // All layers start out fully transparent, with opacity 255.
+    Compositor(LEDStrip *const *strips, int strip_count, int layers);
+    ~Compositor();
+
+    int layers() const { return (int)layers_.size(); }
+
+    // Set pixel of the given layer. "alpha" is its coverage: 0 is fully
+    // transparent, 255 covers what is below completely.
+    void SetPixel(int layer, int strip, int pos, const RGBc &c,
+                  uint8_t alpha = 255);
+    void SetPixels(int layer, int strip, int pos, const RGBc *colors,
+                   int count, uint8_t alpha = 255);
+
+    // Make the whole layer transparent.
+    void ClearLayer(int layer);
+
+    // Opacity of the whole layer, multiplied with the pixel alpha. A layer
+    // with opacity 0 is skipped.
+    void SetLayerOpacity(int layer, uint8_t opacity);
+    void SetLayerBlendMode(int layer, BlendMode mode);
+
+    // Blend all layers and send the result to the strips. Returns 'false'
+    // if nothing changed since the last call and the strips were left alone.
+    bool Compose();
+
+private:
+    struct Layer {
+        uint8_t *colors;     // RGB bytes, all strips consecutive.
+        uint8_t *alpha;      // Same layout; alpha repeated for r, g, b.
+        uint8_t *result;     // All layers up to this one blended.
+        uint8_t opacity;
+        BlendMode mode;
+    };
+
+    // Index of the first byte of the given pixel in the layer buffers or -1.
+    int ByteOffset(int strip, int pos) const;
+    void MarkChanged(int layer);
+
+    LEDStrip **const strips_;
+    int *const offsets_;      // Start of each strip in the buffers (pixels).
+    const int strip_count_;
+    const int bytes_;         // Size of each buffer.
+    uint8_t *black_;
+    uint8_t *scratch_;
+    std::vector<Layer> layers_;
+    int first_changed_;       // Lowest layer changed since last Compose().
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_COMPOSITOR_H
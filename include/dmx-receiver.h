@@ -0,0 +1,123 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_DMX_RECEIVER_H
+#define SPIXELS_DMX_RECEIVER_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "led-strip.h"
+
+namespace spixels {
+// Receives DMX universes via E1.31 (sACN) and/or Art-Net over UDP and
+// writes them directly to the LED strips they are mapped to. Each pixel
+// is three consecutive DMX slots: red, green, blue.
+//
+// A frame is sent with MultiSPI::SendBuffers() when a sync packet arrives
+// (E1.31 universe synchronization for the sync address of our universes,
+// or ArtSync). Senders that don't use sync packets send frames without
+// gaps; so without sync, a frame is sent as soon as all mapped universes
+// have been received, or a universe arrives a second time. If no sync
+// arrives for 4 seconds, we go back to that, per protocol.
+class DMXReceiver {
+public:
+    enum Protocol {
+        E131,     // UDP port 5568
+        ARTNET,   // UDP port 6454
+    };
+
+    struct Stats {
+        int64_t packets;         // Valid DMX data packets received.
+        int64_t sync_packets;
+        int64_t ignored_packets; // Not understood, not mapped or out of order
+        int64_t frames;          // Number of SendBuffers()
+        // Time from receiving the first packet of a frame until it is sent.
+        int64_t sum_latency_usec;
+        int64_t max_latency_usec;
+    };
+
+    explicit DMXReceiver(MultiSPI *spi);
+    ~DMXReceiver();
+
+    // Show "pixel_count" pixels from "universe", starting at slot
+    // "first_slot" (0 based), on "strip" starting at "first_pixel".
+    // A universe can be mapped multiple times, e.g. to the end of one strip
+    // and the beginning of another. Art-Net universes are the 15 bit
+    // port-address (net, sub-net, universe).
+    void MapUniverse(int universe, int first_slot,
+                     LEDStrip *strip, int first_pixel, int pixel_count);
+
+    // Convenience: map consecutive universes, starting with "universe",
+    // to all pixels of the strip, 170 pixels per universe. Returns the
+    // next free universe.
+    int MapStrip(LEDStrip *strip, int universe);
+
+    // Open socket for the given protocol. Port 0 is the default port of the
+    // protocol. Both protocols can be received at the same time.
+    // Returns 'false' on failure (and prints the reason).
+    bool Listen(Protocol protocol, int port = 0);
+
+    // Receive and process all packets that arrive within "timeout_ms".
+    // Returns as soon as packets were handled or the timeout expired.
+    void ProcessPackets(int timeout_ms);
+
+    // Process packets until Stop() is called from another thread.
+    void Run();
+    void Stop() { running_ = false; }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Mapping {
+        int universe;
+        int first_slot;
+        LEDStrip *strip;
+        int first_pixel;
+        int pixel_count;
+    };
+
+    struct UniverseState {
+        int universe;
+        int last_sequence;        // -1: nothing received yet.
+        int sync_address;         // E1.31 sync universe; 0: none.
+        bool in_frame;            // Received since last send.
+    };
+
+    void HandlePacket(const uint8_t *data, int len, int64_t now);
+    void HandleDMX(int universe, int sequence, int sync_address,
+                   bool wait_for_sync, const uint8_t *slots, int slot_count,
+                   int64_t now);
+    void SendFrame();
+    UniverseState *FindUniverse(int universe);
+
+    MultiSPI *const spi_;
+    std::vector<Mapping> mappings_;
+    std::vector<UniverseState> universes_;
+    std::vector<int> fds_;
+    int universes_in_frame_;
+    int64_t frame_start_usec_;   // 0: no data in frame yet.
+    int64_t artnet_sync_usec_;   // Last sync packet; 0: never.
+    int64_t e131_sync_usec_;
+    volatile bool running_;
+    std::vector<uint8_t> receive_buffer_;
+    Stats stats_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_DMX_RECEIVER_H
@@ -0,0 +1,97 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_FLASCHEN_TASCHEN_SERVER_H
+#define SPIXELS_FLASCHEN_TASCHEN_SERVER_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "canvas.h"
+
+namespace spixels {
+// Receives frames in the FlaschenTaschen UDP protocol and shows them on
+// a Canvas.
+//
+// Each datagram is a binary PPM image (P6), optionally positioned with
+// an "x y z" footer after the pixel data or a "#FT: x y z" comment in the
+// header. "z" is the layer: layer 0 is the background, higher layers are
+// on top, with black pixels being transparent. Layers above 0 are cleared
+// if they don't receive updates for a while, so abandoned overlays go
+// away.
+//
+// The PPM header is parsed in place and the pixel rows are taken straight
+// from the datagram.
+class FlaschenTaschenServer {
+public:
+    enum { DEFAULT_PORT = 1337, MAX_LAYERS = 16 };
+
+    struct Stats {
+        int64_t packets;
+        int64_t bad_packets;     // Not a valid PPM.
+        int64_t frames;          // Number of SendBuffers()
+    };
+
+    // Show on "canvas", whose strips are on "spi". Does not take ownership.
+    FlaschenTaschenServer(MultiSPI *spi, Canvas *canvas,
+                          int layer_timeout_sec = 15);
+    ~FlaschenTaschenServer();
+
+    // Listen on the given UDP port. Returns 'false' on error (and prints
+    // the reason).
+    bool Listen(int port = DEFAULT_PORT);
+
+    // Wait up to "timeout_ms" for packets, handle all that are queued,
+    // then send the buffers once if anything changed.
+    void ProcessPackets(int timeout_ms);
+
+    // Process packets until Stop() is called from another thread.
+    void Run();
+    void Stop() { running_ = false; }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Layer {
+        std::vector<RGBc> pixels;
+        int64_t last_update_usec;   // 0: not active.
+    };
+
+    bool HandlePacket(const uint8_t *data, int len, int64_t now);
+    void SetLayerRect(int z, int x, int y, int w, int h,
+                      const RGBc *image, int stride);
+    void ComposeRect(int x, int y, int w, int h);
+    void ExpireLayers(int64_t now);
+
+    MultiSPI *const spi_;
+    Canvas *const canvas_;
+    const int64_t layer_timeout_usec_;
+    const int width_;
+    const int height_;
+    Layer layers_[MAX_LAYERS];
+    int top_layer_;                 // Highest active layer.
+    std::vector<RGBc> row_;         // Composed row.
+    std::vector<uint8_t> receive_buffer_;
+    int fd_;
+    bool changed_;
+    volatile bool running_;
+    Stats stats_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_FLASCHEN_TASCHEN_SERVER_H
@@ -0,0 +1,118 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_FRAME_CLOCK_H
+#define SPIXELS_FRAME_CLOCK_H
+
+#include <stdint.h>
+
+namespace spixels {
+class MultiSPI;
+
+// Implement this to be called by FrameClock::Run() for each frame.
+class FrameRenderer {
+public:
+    virtual ~FrameRenderer() {}
+
+    // Fill the buffers (e.g. via LEDStrip::SetPixel()) for the given frame.
+    // The frame will be sent at "deadline_nsec" (see FrameClock::Now()).
+    // The frame number counts frame slots since start, including dropped
+    // ones, so frame / fps is the time an animation should show.
+    // Return 'false' to stop the loop.
+    virtual bool RenderFrame(int64_t frame, int64_t deadline_nsec) = 0;
+};
+
+// Sends frames at absolute deadlines, so that the frame rate does not drift
+// with the time needed to render and transmit, as it does with a plain
+// usleep() between frames.
+//
+// Deadlines are in nanoseconds on the monotonic clock. The frame clock
+// sleeps until the deadline and then starts SendBuffers().
+class FrameClock {
+public:
+    // What to do if the renderer only finishes after the deadline.
+    enum LatePolicy {
+        SEND_LATE,   // Send anyway, as soon as possible.
+        DROP_LATE,   // Don't send, keep the previous frame shown.
+    };
+
+    // Timing of one frame.
+    struct FrameTiming {
+        int64_t deadline_nsec;
+        int64_t slack_nsec;   // Time left between render done and deadline.
+                              // Negative, if rendering was late.
+        int64_t late_nsec;    // How late sending actually started.
+        bool dropped;
+    };
+
+    // Accumulated since start or the last ResetStats().
+    struct Stats {
+        int64_t frames_sent;
+        int64_t frames_dropped;   // Dropped due to the late policy.
+        int64_t frames_skipped;   // Frame slots skipped to catch up.
+        int64_t min_slack_nsec;
+        int64_t sum_slack_nsec;   // Divide by sent + dropped for average.
+        int64_t max_late_nsec;
+        int64_t sum_late_nsec;    // Divide by frames_sent for average.
+    };
+
+    // Create a frame clock sending on "spi" with the given frame rate.
+    // With DROP_LATE, a frame is dropped if it is more than "tolerance_usec"
+    // past its deadline.
+    FrameClock(MultiSPI *spi, float frames_per_second,
+               LatePolicy policy = DROP_LATE, int tolerance_usec = 500);
+
+    // Current time on the clock deadlines are measured with.
+    static int64_t Now();
+
+    int64_t frame_period_nsec() const { return period_nsec_; }
+
+    // Wait until the deadline, then send the buffers. If the deadline has
+    // already passed, behaves according to the late policy. Returns 'true'
+    // if the frame was sent, 'false' if it was dropped.
+    bool SendBuffersAt(int64_t deadline_nsec);
+
+    // The deadline one frame period after "previous_deadline". If that is
+    // already in the past, skip ahead to the next frame slot that is still
+    // in the future, so that we stay in phase with the frame rate instead of
+    // trying to catch up with a burst of late frames. Skipped slots are
+    // counted in the stats.
+    int64_t NextDeadline(int64_t previous_deadline);
+
+    // Render and send frames at the frame rate until the renderer returns
+    // 'false'. If rendering plus sending takes longer than a frame period,
+    // frame slots are skipped (see NextDeadline()).
+    void Run(FrameRenderer *renderer);
+
+    // Timing of the last frame passed to SendBuffersAt().
+    const FrameTiming &last_frame() const { return last_; }
+
+    const Stats &stats() const { return stats_; }
+    void ResetStats();
+
+private:
+    MultiSPI *const spi_;
+    const int64_t period_nsec_;
+    const LatePolicy policy_;
+    const int64_t tolerance_nsec_;
+
+    FrameTiming last_;
+    Stats stats_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_FRAME_CLOCK_H
@@ -0,0 +1,94 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_FRAME_INTERPOLATOR_H
+#define SPIXELS_FRAME_INTERPOLATOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "frame-clock.h"
+#include "led-strip.h"
+
+namespace spixels {
+// Shows content that arrives at a low frame rate (e.g. 25fps video or
+// network data) smoothly at the much higher frame rate the LED strips
+// can do, by blending between the last two source frames.
+//
+// The producer writes source frames with SetPixel()/SetPixels() and
+// finishes each with PublishFrame(). The output side is a FrameRenderer
+// for a FrameClock, typically running in a background thread with Start().
+//
+// Output is one source frame behind: after a frame is published, the output
+// fades from the previous source frame to it within the time that passed
+// between the last two PublishFrame() calls.
+class FrameInterpolator : public FrameRenderer {
+public:
+    enum Easing {
+        LINEAR,        // Constant speed of change.
+        EASE_IN_OUT,   // Smoothstep; softer at the start and end of fades.
+    };
+
+    // Interpolate for the given strips. Does not take ownership.
+    FrameInterpolator(LEDStrip *const *strips, int strip_count,
+                      Easing easing = LINEAR);
+    virtual ~FrameInterpolator();
+
+    // -- Producer side. Writes go to the next source frame, which starts
+    // out as copy of the last published one.
+    void SetPixel(int strip, int pos, const RGBc &c);
+    void SetPixels(int strip, int pos, const RGBc *colors, int count);
+
+    // Make the frame written so far the newest source frame.
+    void PublishFrame();
+
+    // -- Output side.
+    // Calculate the frame to be shown at "deadline_nsec" and write it to the
+    // strips. Returns 'false' once Stop() has been called.
+    virtual bool RenderFrame(int64_t frame, int64_t deadline_nsec);
+
+    // Run "clock" with this renderer in a background thread.
+    bool Start(FrameClock *clock);
+
+    // Stop the background thread.
+    void Stop();
+
+private:
+    static void *ThreadMain(void *self);
+
+    LEDStrip **const strips_;
+    int *const offsets_;         // Start of each strip in the buffers.
+    const int strip_count_;
+    const int total_pixels_;
+    const Easing easing_;
+
+    pthread_mutex_t mutex_;
+    RGBc *write_;                // Producer is writing here.
+    RGBc *previous_;             // Fading from this ...
+    RGBc *current_;              // ... to this.
+    RGBc *output_;
+    int64_t previous_publish_;   // Time of the last two PublishFrame() calls.
+    int64_t current_publish_;
+    int last_alpha_;             // Output of last frame; -1 if outdated.
+
+    FrameClock *clock_;
+    pthread_t thread_;
+    volatile bool running_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_FRAME_INTERPOLATOR_H
@@ -0,0 +1,175 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_FRAME_SYNC_H
+#define SPIXELS_FRAME_SYNC_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "frame-clock.h"
+#include "multi-spi.h"
+
+namespace spixels {
+// Synchronized presentation of frames on multiple Raspberry Pis, e.g. the
+// segments of a large wall, so that they all switch to the next frame at
+// the same time.
+//
+// The FrameSyncMaster sends frame numbers with the time they are to be
+// presented via UDP multicast, a few frames ahead. Each FrameSyncNode keeps
+// an estimate of the offset between its clock and that of the master (with
+// NTP-style round trips), renders announced frames into a queue and sends
+// them at the announced time, converted to its own clock. Nodes report when
+// they actually presented each frame, so the master can report the
+// achieved skew between nodes.
+//
+// All can be tested on a single machine with multiple processes, using the
+// simulated MultiSPI (see set_simulated_clock_offset()).
+
+// Defaults: an address in the administratively scoped multicast range.
+#define FRAME_SYNC_DEFAULT_GROUP "239.255.73.80"
+#define FRAME_SYNC_DEFAULT_PORT  7380
+
+class FrameSyncMaster {
+public:
+    // Skew of frames reported by at least two nodes.
+    struct Stats {
+        int64_t frames_announced;
+        int64_t reports;              // Presentations reported by nodes.
+        int nodes;                    // Nodes that synced their clock.
+        int64_t skew_frames;          // Frames with a known skew.
+        int64_t max_skew_nsec;
+        int64_t sum_skew_nsec;        // Divide by skew_frames for average.
+
+        // Same, but from the local clock of the nodes. Only meaningful if
+        // all nodes run on the same host as the master, e.g. for testing.
+        int64_t max_host_skew_nsec;
+        int64_t sum_host_skew_nsec;
+    };
+
+    FrameSyncMaster();
+    ~FrameSyncMaster();
+
+    // Open the socket to announce to the multicast "group". "interface"
+    // is the local address of the network interface to use; NULL for
+    // the default route. Returns 'false' on error (and prints the reason).
+    bool Open(const char *group = FRAME_SYNC_DEFAULT_GROUP,
+              int port = FRAME_SYNC_DEFAULT_PORT,
+              const char *interface = NULL);
+
+    // Announce frames at "fps", each "lead_frames" before its presentation
+    // time, and answer the nodes until Stop() is called from another
+    // thread.
+    void Run(float fps, int lead_frames = 3);
+    void Stop() { running_ = false; }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct FrameReports;
+
+    void Announce(int64_t frame, int64_t present_nsec);
+    void HandleMessages();
+    bool IsNode(const struct sockaddr_in &from) const;
+    void AddNode(const struct sockaddr_in &from);
+    void AddReport(const struct sockaddr_in &from, int64_t frame,
+                   int64_t present_nsec, int64_t host_nsec);
+    void FinishFrame(FrameReports *reports);
+
+    int fd_;
+    struct sockaddr_in group_addr_;
+    std::vector<struct sockaddr_in> nodes_;
+    std::vector<FrameReports> recent_;   // Indexed by frame % size.
+    volatile bool running_;
+    Stats stats_;
+};
+
+class FrameSyncNode {
+public:
+    struct Stats {
+        int64_t frames_presented;
+        int64_t frames_missed;        // Announced too late or lost.
+        int64_t clock_offset_nsec;    // Local clock minus master clock.
+        int64_t round_trip_nsec;      // Of the offset estimate.
+        int64_t max_late_nsec;        // Latest latch after the deadline.
+    };
+
+    // Present on "spi", pre-rendering up to "queue_frames" frames if the
+    // implementation supports wire frames (see MultiSPI::WireFormat()).
+    // Otherwise frames are rendered right before they are due.
+    explicit FrameSyncNode(MultiSPI *spi, int queue_frames = 4);
+    ~FrameSyncNode();
+
+    // Listen to the master on the multicast "group". "interface" is the
+    // local address of the interface to receive on; NULL for any.
+    // Returns 'false' on error (and prints the reason).
+    bool Join(const char *group = FRAME_SYNC_DEFAULT_GROUP,
+              int port = FRAME_SYNC_DEFAULT_PORT,
+              const char *interface = NULL);
+
+    // For testing on a single host: pretend that our clock is "offset_nsec"
+    // ahead of the real one.
+    void set_simulated_clock_offset(int64_t offset_nsec) {
+        simulated_offset_ = offset_nsec;
+    }
+
+    // Render announced frames with "renderer" and present them at their
+    // time until Stop() is called from another thread. The deadline passed
+    // to the renderer is in FrameClock::Now() time.
+    void Run(FrameRenderer *renderer);
+    void Stop() { running_ = false; }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct QueuedFrame;
+    struct ClockSample {
+        int64_t offset_nsec;
+        int64_t round_trip_nsec;
+    };
+
+    int64_t Now() const { return FrameClock::Now() + simulated_offset_; }
+    void HandleMessages(FrameRenderer *renderer);
+    void RequestClock();
+    void AddClockSample(int64_t offset, int64_t round_trip);
+    void Enqueue(FrameRenderer *renderer, int64_t frame, int64_t deadline);
+    void Present(FrameRenderer *renderer);
+
+    MultiSPI *const spi_;
+    const int queue_frames_;
+    const bool pre_render_;
+    int multicast_fd_;
+    int control_fd_;               // Unicast to the master.
+    struct sockaddr_in master_;
+    bool have_master_;
+    int64_t simulated_offset_;
+    int64_t next_clock_request_;
+    int clock_requests_;
+    std::vector<ClockSample> clock_samples_;   // Most recent ones.
+    bool have_offset_;
+    int64_t render_nsec_;          // Last render time, if not pre-rendering.
+    int64_t last_frame_;
+    std::vector<QueuedFrame*> queue_;          // Sorted by deadline.
+    std::vector<QueuedFrame*> free_frames_;
+    volatile bool running_;
+    Stats stats_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_FRAME_SYNC_H
@@ -0,0 +1,70 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef SPIXELS_FRAME_TRACE_H
+#define SPIXELS_FRAME_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace spixels {
+// Timeline of what happens for each frame, to find out why a frame was
+// late: the application, encoding, the copy to DMA memory or the transfer.
+// While tracing, the library records spans into an in-memory ring, which
+// can be written out for chrome://tracing or https://ui.perfetto.dev
+//
+// Tracing is off by default; then each traced place costs one load and a
+// branch. Recording a span does not take locks, so it is safe from
+// multiple threads.
+
+// The kinds of spans recorded.
+enum FrameTraceSpan {
+    TRACE_APP,            // Recorded by the application, see below.
+    TRACE_RENDER,         // Rendering a frame, e.g. in FrameClock::Run().
+    TRACE_ENCODE,         // LEDStrip bulk operation, e.g. SetPixels().
+    TRACE_DEADLINE_WAIT,  // FrameClock waiting for the frame deadline.
+    TRACE_SEND,           // All of SendBuffers() in FrameClock.
+    TRACE_COPY,           // MultiSPI: copying the buffers to DMA memory.
+    TRACE_TRANSMIT,       // MultiSPI: sending until done.
+    TRACE_POLL,           // MultiSPI: busy-polling for the end of DMA.
+};
+
+// Start recording. The ring keeps the last "capacity" spans (rounded up to
+// a power of two). It is allocated on the first call and then kept, so
+// starting again continues in the same ring. Returns 'false' if the memory
+// could not be allocated.
+bool StartFrameTrace(size_t capacity = 65536);
+
+// Stop recording. The spans recorded so far stay in the ring.
+void StopFrameTrace();
+
+// Frame number recorded with the following spans; FrameClock::Run() sets
+// this, applications with their own loop can do the same.
+void SetFrameTraceFrame(int64_t frame);
+
+// Record a span of the application from "start_nsec" to "end_nsec"
+// (FrameClock::Now() time), if tracing.
+void AddFrameTraceSpan(FrameTraceSpan span, int64_t start_nsec,
+                       int64_t end_nsec);
+
+// Write the spans in the ring as Chrome trace event JSON, which also
+// opens in Perfetto. Can be called while tracing. Returns 'false' on error.
+bool WriteFrameTrace(const char *filename);
+}  // namespace spixels
+
+#endif  // SPIXELS_FRAME_TRACE_H
@@ -0,0 +1,110 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef SPIXELS_GPIO_STREAM_H
+#define SPIXELS_GPIO_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "multi-spi.h"
+
+namespace spixels {
+// The exact sequence of writes to the GPIO set and clear registers that
+// CreateDirectMultiSPI() or CreateDMAMultiSPI() would do, recorded in
+// memory instead (see CreateRecordingDirectMultiSPI() below). This does not
+// need a Raspberry Pi, so changes to the encoding can be verified bit by
+// bit and timed on any machine.
+class GPIOStream {
+public:
+    // One write cycle: the bits written to the set and clear registers.
+    // Bits that are zero in both are left unchanged.
+    struct Operation {
+        uint32_t set;
+        uint32_t clr;
+    };
+
+    GPIOStream() : output_bits_(0), sends_(0) {}
+
+    // The operations of the last SendBuffers() or SendWireFrame().
+    const std::vector<Operation> &operations() const { return ops_; }
+
+    // Number of transfers recorded so far.
+    int64_t sends() const { return sends_; }
+
+    // Decode the SPI stream received by a device on "data_gpio" that
+    // samples on the rising edge of "clock_gpio", i.e. the data after the
+    // operation in which the clock goes high. Bits are assembled into
+    // bytes MSB first; incomplete trailing bits are dropped.
+    std::vector<uint8_t> Decode(int data_gpio,
+                                int clock_gpio = MultiSPI::SPI_CLOCK) const;
+
+    // -- Same interface as the GPIO access of the MultiSPI implementations,
+    // so that they can write to this instead of the registers.
+    bool AddOutput(int gpio);
+    void Write(uint32_t value) {
+        Operation op = { value & output_bits_, ~value & output_bits_ };
+        ops_.push_back(op);
+    }
+    void Append(uint32_t set, uint32_t clr) {
+        Operation op = { set, clr };
+        ops_.push_back(op);
+    }
+    void StartSend() { ops_.clear(); ++sends_; }
+
+private:
+    uint32_t output_bits_;
+    int64_t sends_;
+    std::vector<Operation> ops_;
+};
+
+// Protocols of the LED strips in led-strip.h that use a clock.
+enum LEDStripProtocol {
+    PROTOCOL_WS2801,
+    PROTOCOL_LPD6803,
+    PROTOCOL_LPD8806,
+    PROTOCOL_APA102,
+};
+
+// Linear values of a pixel as shown by the strip, in the range of
+// LEDStrip::SetLinearValues(), i.e. [0 .. 0xFFFF].
+struct LinearRGB {
+    uint16_t r, g, b;
+};
+
+// Decode "count" pixels from the bytes received by a strip of the given
+// protocol (see GPIOStream::Decode()). Returns 'false' if the bytes don't
+// follow the protocol, e.g. missing start frames or start bits.
+bool DecodeStripPixels(LEDStripProtocol protocol,
+                       const std::vector<uint8_t> &bytes, int count,
+                       std::vector<LinearRGB> *pixels);
+
+// Factories for MultiSPI implementations that encode exactly like
+// CreateDirectMultiSPI() and CreateDMAMultiSPI(), but instead of accessing
+// the hardware, record the GPIO operations of each transfer to "stream".
+// Timed frame sequences (QueueFrame()) are not supported.
+MultiSPI *CreateRecordingDirectMultiSPI(GPIOStream *stream,
+                                        float speed_mhz = 4,
+                                        int clock_gpio = MultiSPI::SPI_CLOCK);
+MultiSPI *CreateRecordingDMAMultiSPI(GPIOStream *stream,
+                                     int clock_gpio = MultiSPI::SPI_CLOCK);
+}  // namespace spixels
+
+#endif  // SPIXELS_GPIO_STREAM_H
@@ -23,6 +23,7 @@
 #include <stdint.h>
 
 #include "multi-spi.h"
+#include "timing-stats.h"
 
 namespace spixels {
 
@@ -49,6 +50,14 @@ struct RGBc {
 // Simplest possible way for a LED strip.
 class LEDStrip {
 public:
+    // Where the time to encode pixels goes, see encode_stats().
+    struct EncodeStats {
+        int64_t pixels_encoded;   // By any of the operations below.
+        TimingStat bulk;          // Each call of a bulk operation, such as
+                                  // SetPixels(), Fill() or SetBrightness().
+        EncodeStats() : pixels_encoded(0) {}
+    };
+
     virtual ~LEDStrip();
 
     // Return number of attached LEDs.
@@ -64,6 +73,55 @@ public:
         SetPixel(pos, RGBc(r, g, b));
     }
 
+    // Set "count" pixels starting at "pos" from the "colors" array.
+    // Same as calling SetPixel() for each, but faster for bulk updates.
+    // Pixels outside the strip are ignored.
+    void SetPixels(int pos, const RGBc *colors, int count);
+
+    // -- Bulk operations on all pixels. These are much faster than calling
+    // SetPixel() for each pixel.
+
+    // Set all pixels to the same color.
+    void Fill(const RGBc &c);
+
+    // Scale all pixel colors by factor/255, e.g. to fade to black by
+    // calling repeatedly with a factor less than 255.
+    void Fade(uint8_t factor);
+
+    // Move all pixels by "n" positions towards the end of the strip (or
+    // towards the start if n is negative). Pixels moved past the end are
+    // lost and the vacated pixels black, unless "rotate" is set, in which
+    // case they come back in at the other end.
+    void Shift(int n, bool rotate = false);
+
+    // Blend the pixels towards "color" or the pixels of "other", which
+    // needs to have at least as many pixels. With alpha = 0, the strip is
+    // unchanged, with 255 it is completely replaced.
+    void Blend(const RGBc &color, uint8_t alpha);
+    void Blend(const LEDStrip &other, uint8_t alpha);
+
+    // -- Palette mode. For effects with up to 256 colors, pixels can be set
+    // by index into a palette. The palette entries are encoded for the LED
+    // strip once, so setting a pixel by index does not need any
+    // calculations; changing a palette entry only encodes that entry and
+    // updates the pixels that use it, e.g. for color cycling.
+
+    // Set palette entry "index" and all pixels set to that index.
+    // All entries are black initially.
+    void SetPaletteColor(uint8_t index, const RGBc &c);
+
+    // Set "count" palette entries starting at "first", then update all
+    // pixels using any of them in a single pass. Use this if many entries
+    // change at once, e.g. when cycling colors.
+    void SetPaletteColors(uint8_t first, const RGBc *colors, int count);
+    RGBc GetPaletteColor(uint8_t index) const;
+
+    // Set pixel(s) to the color of the given palette entry.
+    // Note: pixels remember their palette index until set with SetPixel() or
+    // any of the other operations above.
+    void SetPixelIndex(int pos, uint8_t index);
+    void SetPixelIndices(int pos, const uint8_t *indices, int count);
+
     // Set overall brightness for all pixels. Range of [0 .. 255].
     // This scales the brightness so that it looks linear luminance corrected
     // for the eye.
@@ -74,6 +132,11 @@ public:
     void SetBrightness(uint8_t brigthness);
     inline uint8_t brightness() const { return brightness_; }
 
+    // Accumulated since creation or ResetEncodeStats(). To keep them cheap,
+    // single pixel operations are only counted, not timed.
+    const EncodeStats &encode_stats() const { return encode_stats_; }
+    void ResetEncodeStats() { encode_stats_ = EncodeStats(); }
+
     // Set the raw, linear RGB value as provided by the LED strip, normalized
     // to the range [0 .. 0xFFFF]. This is LED-Strip dependent.
     //
@@ -90,9 +153,50 @@ public:
 protected:
     LEDStrip(int count);
 
+    // Maximum of encoded_bytes() over all strips.
+    enum { kMaxEncodedBytes = 4 };
+
+    // Number of bytes a pixel is encoded in for this strip or 0 if the
+    // following two functions are not supported.
+    virtual int encoded_bytes() const { return 0; }
+
+    // Encode linear values (see SetLinearValues()) as bytes sent to the
+    // strip. "bytes" has room for encoded_bytes().
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {}
+
+    // Set pixel from encoded bytes.
+    virtual void SetEncodedPixel(int pos, const uint8_t *bytes) {}
+
+    // Move "count" already encoded pixels in the output buffer from "from"
+    // to "to", like memmove(). Returns 'false' if not possible, in which
+    // case the caller needs to set the pixels again. Used by Shift().
+    virtual bool MoveEncodedPixels(int from, int to, int count) {
+        return false;
+    }
+
+    // Encode values_[pos .. pos+count) for the output. The default calls
+    // SetLinearValues() for each pixel; strips made of other strips hand
+    // whole runs to them.
+    virtual void EncodeValues(int pos, int count);
+
     const int count_;
     RGBc *const values_;
     uint8_t brightness_;
+
+private:
+    friend class SegmentedLedStrip;   // Forwards to the strips it is made of.
+    struct Palette;
+
+    // Update the output buffer from values_ for the given range.
+    void EncodePixels(int pos, int count);
+
+    Palette *palette();
+    void EncodePaletteEntry(int index);
+    void SetIndexedPixel(int pos, uint8_t index);
+
+    Palette *palette_;   // Only allocated if palette mode is used.
+    EncodeStats encode_stats_;
 };
 
 // Factories for various LED strips.
@@ -104,6 +208,30 @@ LEDStrip *CreateWS2801Strip(MultiSPI *spi, int connector, int count);
 LEDStrip *CreateLPD6803Strip(MultiSPI *spi, int connector, int count);
 LEDStrip *CreateLPD8806Strip(MultiSPI *spi, int connector, int count);
 LEDStrip *CreateAPA102Strip(MultiSPI *spi, int connector, int count);
+
+// A segment of a logical strip, see CreateSegmentedStrip().
+struct StripSegment {
+    LEDStrip *strip;   // Physical strip on some connector.
+    bool reversed;     // Data is injected at the far end of this segment.
+};
+
+// Create a logical strip that maps one pixel index space onto multiple
+// physical strips. Segment i covers the pixels following segment i-1.
+// A long run of LEDs can so be split and fed from multiple connectors at
+// the segment boundaries: the transfer time goes down with the number of
+// segments, as they are all sent in parallel.
+// If "reversed" is set, the segment is fed from its end, i.e. its last LED
+// is at the segment boundary.
+//
+// Takes ownership of the segment strips. Brightness is set on the
+// segmented strip only.
+LEDStrip *CreateSegmentedStrip(const StripSegment *segments, int count);
+
+// Clock-less one-wire LED strips; "spi" needs to be created with
+// CreateWS2812MultiSPI().
+LEDStrip *CreateWS2812Strip(MultiSPI *spi, int connector, int count);
+// RGBW strip. The white LED is used for the part common to all colors.
+LEDStrip *CreateSK6812RGBWStrip(MultiSPI *spi, int connector, int count);
 }
 
 #endif // SPIXELS_LED_STRIP_H
@@ -21,12 +21,16 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "timing-stats.h"
+
 namespace spixels {
 // MultiSPI outputs multiple SPI streams in parallel on different GPIOs.
-// The clock is on a single GPIO-pin. This way, we can transmit 25-ish
-// SPI streams in parallel on a Pi with 40 IO pins.
-// Current implementation assumes that all streams have the same amount
-// of data.
+// By default, the clock is on a single GPIO-pin. This way, we can transmit
+// 25-ish SPI streams in parallel on a Pi with 40 IO pins.
+// All streams sharing a clock form a clock group and are padded to the
+// length of the longest stream in it. Streams of very different length or
+// speed can get their own clock GPIO and divider (see SetDataGPIOClock()),
+// so short or slow strips don't cost the others transfer time.
 // Also, there is no chip-select at this point (not needed for the LED strips).
 //
 // This can be used of course of LED strips (see led-strip.h for the API), but
@@ -57,31 +61,167 @@ public:
         SPI_P16 = 20,
     };
 
-    // A function that maps the connector number (P1..P16) to the value of
-    // the corresponding SPI Pin SPI_P1..SPI_P16 constant.
+    // Maximum number of data connectors in a pin map: all GPIOs on the
+    // 40 pin header but the clock.
+    enum { MAX_CONNECTORS = 27 };
+
+    // Mapping of connector numbers to data GPIOs.
+    struct PinMap {
+        int connectors;                   // Number of connectors used.
+        int data_gpio[MAX_CONNECTORS];    // GPIO for connector 1..connectors
+    };
+
+    // Layout of the 16 connector breakout board: SPI_P1..SPI_P16. Default.
+    static const PinMap kAdapter16PinMap;
+
+    // 25 data GPIOs, using all pins of a 40 pin Raspberry Pi except the
+    // clock on SPI_CLOCK and the ID EEPROM pins (GPIO 0, 1). The first 16
+    // connectors are the same as kAdapter16PinMap.
+    static const PinMap kAllPinsPinMap;
+
+    // Set the pin map used by SPIPinForConnector(), e.g. for a custom
+    // adapter board. Returns 'false' and leaves the current map unchanged
+    // if it contains GPIOs that are not available on the Raspberry Pi
+    // header, duplicates or the common clock SPI_CLOCK.
+    static bool SetPinMap(const PinMap &pin_map);
+    static const PinMap &GetPinMap();
+
+    // Number of connectors in the current pin map.
+    static int ConnectorCount();
+
+    // A function that maps the connector number (1..ConnectorCount()) to
+    // the data GPIO in the current pin map. With the default map, these are
+    // the SPI_P1..SPI_P16 constants. Returns -1 for an invalid connector.
     static int SPIPinForConnector(int connector);
 
+    // Where the time of the transfers goes, see transfer_stats().
+    struct TransferStats {
+        int64_t frames_sent;
+        int64_t bits_sent;     // Bit slots of the transfers timed below.
+        TimingStat copy;       // Copying the buffers to DMA memory.
+        TimingStat transmit;   // Sending, from start until done.
+        TimingStat poll;       // Part of transmit spent busy-polling for
+                               // the end of a DMA transfer.
+
+        TransferStats() : frames_sent(0), bits_sent(0) {}
+
+        // Bits per microsecond per data line, over all timed transfers.
+        double effective_clock_mhz() const {
+            return transmit.sum_nsec ? 1e3 * bits_sent / transmit.sum_nsec : 0;
+        }
+    };
+
     virtual ~MultiSPI() {}
 
     // Register a new data stream for the given GPIO. The SPI data is
     // sent with the common clock and this gpio pin. The gpio must be one
     // of the above SPI_xx constants or the return value of
-    // SPIPinForConnector().
+    // SPIPinForConnector(). Returns 'false' if the GPIO is not usable.
     //
     // Note, each channel might receive more bytes because they share the
-    // same clock with everyone and it depends on what is the longest requested
-    // length.
+    // same clock with everyone in its clock group (see SetDataGPIOClock())
+    // and it depends on what is the longest requested length.
     // Overlength transmission bytes are all zero.
+    //
+    // Registering a GPIO again changes the length of its stream. This, and
+    // UnregisterDataGPIO(), can be done at any time, e.g. to reconfigure
+    // fixtures without restarting. The next SendBuffers() then pays for
+    // setting up the new layout unless Prepare() is called.
     virtual bool RegisterDataGPIO(int gpio, size_t serial_byte_size) = 0;
 
+    // Stop sending data on the given GPIO. Its buffered data is cleared.
+    virtual void UnregisterDataGPIO(int gpio) = 0;
+
+    // Send the given data GPIO with a separate clock on "clock_gpio"
+    // instead of the common clock. All data GPIOs that share a clock form
+    // a clock group, which is only as long as its longest stream.
+    //
+    // All clock groups are sent at the same time, so the total transfer
+    // time is that of the longest group, not the sum. The clock of the group
+    // runs at the base speed of the implementation divided by "clock_divider",
+    // so strips with slow chips don't slow down the others.
+    //
+    // Needs to be called before RegisterDataGPIO() for that data GPIO, i.e.
+    // before the LED strip is created on it (or after it has been
+    // unregistered). All calls for the same clock_gpio need the same divider.
+    // Returns 'false' if not possible or not supported by the implementation.
+    virtual bool SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                  int clock_divider = 1) { return false; }
+
     // Set data byte for given gpio channel at given position in the
     // stream. "pos" needs to be in range [0 .. serial_bytes_per_stream)
     // Data is sent with next Send().
     virtual void SetBufferedByte(int data_gpio, size_t pos, uint8_t data) = 0;
 
-    // Send data for all streams. Wait for completion. After SendBuffers()
-    // has been called once, no new GPIOs can be registered.
+    // Move "count" buffered bytes of "data_gpio" from position "from" to
+    // position "to", like memmove(); the ranges may overlap. Bytes at the
+    // source that are not overwritten keep their value.
+    // This is much faster than setting each byte again.
+    // Returns 'false' if not supported by the implementation.
+    virtual bool MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                   size_t count) { return false; }
+
+    // Do the expensive setup work for the currently registered streams,
+    // such as allocating and touching DMA memory, now instead of in the
+    // first SendBuffers(), which would show as latency spike. Optional.
+    virtual void Prepare() {}
+
+    // Send data for all streams. Wait for completion.
     virtual void SendBuffers() = 0;
+
+    // -- Timed frame sequences.
+    // Pre-rendered sequences can be handed to the implementation as a whole,
+    // which then plays them without being subject to the scheduling
+    // of the operating system. Only supported by implementations that can
+    // output without CPU involvement (DMA); others return false.
+
+    // Append the current content of the buffers as frame to the sequence.
+    // After that frame is sent, wait "delay_usec" before the next frame
+    // in the sequence is started. So the time between the start of two
+    // frames is the (constant) transfer time plus the delay.
+    // Returns 'false' if not supported or if the delay is longer than the
+    // implementation can time in one go (about 268 seconds for DMA).
+    virtual bool QueueFrame(uint32_t delay_usec) { return false; }
+
+    // Play all frames queued with QueueFrame() and wait until the sequence
+    // is finished. The queue is empty afterwards.
+    virtual bool SendQueuedFrames() { return false; }
+
+    // -- Pre-encoded frames.
+    // The buffers can be copied out in the layout the implementation sends
+    // them, e.g. GPIO words, and such a "wire frame" can be sent later
+    // without any encoding (see wire-recording.h). Wire frames are only
+    // valid with the same implementation and the same registered GPIOs,
+    // lengths and clocks. Not all implementations support this.
+
+    // Identifies the implementation and the current layout; wire frames can
+    // only be sent if this is the same as when they were copied.
+    // 0 if not supported.
+    virtual uint32_t WireFormat() const { return 0; }
+
+    // Size of a wire frame in bytes with the current layout.
+    virtual size_t WireFrameSize() const { return 0; }
+
+    // Copy the current buffers as wire frame to "out", which needs to have
+    // room for WireFrameSize() bytes.
+    virtual bool GetWireFrame(void *out) const { return false; }
+
+    // Send a wire frame like SendBuffers() sends the buffers. The buffers
+    // are not changed. "frame" needs to have been copied with the same
+    // WireFormat().
+    virtual bool SendWireFrame(const void *frame) { return false; }
+
+    // -- Statistics.
+    // Accumulated since creation or ResetTransferStats(). Implementations
+    // fill in what applies to them. This costs a few clock reads per
+    // transfer, so it is always on.
+    virtual const TransferStats &transfer_stats() const {
+        return transfer_stats_;
+    }
+    virtual void ResetTransferStats() { transfer_stats_ = TransferStats(); }
+
+protected:
+    TransferStats transfer_stats_;
 };
 
 // Factory to create a MultiSPI implementation that directly writes to
@@ -102,11 +242,31 @@ MultiSPI *CreateDirectMultiSPI(float speed_mhz = 4,
 // Advantages:
 //   - Does not use CPU
 //   - Jitter does not exceed several 10 usec. Needed for WS2801.
+//   - Supports timed frame sequences (QueueFrame()), played with
+//     microsecond accuracy. This uses the PWM peripheral as timer, so
+//     it can't be used for audio at the same time.
 // Disadvantage:
 //   - Limited speed (1-2Mhz). Good for WS2801 which can't go faster
 //     anyway, but wasting potential with LPD6803 or APA102 that can go
 //     much faster.
 MultiSPI *CreateDMAMultiSPI(int clock_gpio = MultiSPI::SPI_CLOCK);
+
+// Factory to create a MultiSPI implementation for clock-less LED strips
+// such as WS2812 or SK6812 ("NeoPixel"). Instead of a clock, each bit is
+// encoded as timed high/low pulse on the data line at 800kHz. All data
+// GPIOs are sent in parallel using DMA, paced by the PWM peripheral.
+// Use with CreateWS2812Strip() or CreateSK6812RGBWStrip(); the
+// SPI_CLOCK pin is not used.
+//
+// Note, this uses the same DMA channel as CreateDMAMultiSPI(), so you can't
+// use both at the same time. It also uses the PWM, so no audio output.
+MultiSPI *CreateWS2812MultiSPI();
+
+// Factory to create a MultiSPI implementation that does not access any
+// hardware, e.g. to test programs on a development machine or to run them
+// without LEDs attached. SendBuffers() takes as long as sending at
+// "speed_mhz" would take; with 0, it returns right away.
+MultiSPI *CreateSimulatedMultiSPI(float speed_mhz = 4);
 }
 
 #endif  // SPIXELS_MULTI_SPI_H
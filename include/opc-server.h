@@ -0,0 +1,113 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_OPC_SERVER_H
+#define SPIXELS_OPC_SERVER_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "led-strip.h"
+
+namespace spixels {
+// Open Pixel Control (http://openpixelcontrol.org/) server, accepting any
+// number of clients over TCP.
+//
+// Supported are "set pixel colors" (command 0) and, as extension, delta
+// frames that only contain the changed pixels: a system exclusive message
+// (command 255) with system id 0x7370 ('sp'), followed by a 0x01 and
+// any number of records:
+//   offset (16 bit) : first pixel of the channel the record applies to.
+//   count (16 bit)  : number of pixels. If bit 15 is set, one RGB triple
+//                     follows that is repeated (count & 0x7fff) times,
+//                     otherwise "count" RGB triples follow.
+// All 16 bit values are big endian, like the OPC header. Pixels not
+// mentioned keep their color.
+//
+// All data received in one go is applied, then sent with a single
+// SendBuffers().
+class OPCServer {
+public:
+    enum { DEFAULT_PORT = 7890 };
+
+    struct Stats {
+        int64_t connections;     // Accepted in total.
+        int64_t messages;        // Pixel and delta messages.
+        int64_t bytes;           // Received payload.
+        int64_t frames;          // Number of SendBuffers()
+    };
+
+    explicit OPCServer(MultiSPI *spi);
+    ~OPCServer();
+
+    // Map "strip" to OPC "channel" (1..255). Pixel "first_pixel" of the
+    // channel is the first pixel of the strip, so multiple strips can
+    // be mapped to one channel. Channel 0 messages go to all channels.
+    void MapChannel(int channel, LEDStrip *strip, int first_pixel = 0);
+
+    // Convenience: map strips on consecutive channels, starting with
+    // channel 1.
+    void MapStrips(LEDStrip *const *strips, int count);
+
+    // Start listening. Returns 'false' on error (and prints the reason).
+    bool Listen(int port = DEFAULT_PORT);
+
+    // Handle connections and data arriving within "timeout_ms".
+    void ProcessEvents(int timeout_ms);
+
+    // Process events until Stop() is called from another thread.
+    void Run();
+    void Stop() { running_ = false; }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Mapping {
+        int channel;
+        LEDStrip *strip;
+        int first_pixel;
+    };
+
+    struct Client {
+        int fd;
+        std::vector<uint8_t> buffer;
+        size_t fill;
+    };
+
+    bool ListenFailed(const char *what);  // Clean up after error; 'false'.
+    void Accept();
+    bool ReadClient(Client *client);   // 'false' on disconnect.
+    void CloseClient(Client *client);
+    // Handle all complete messages in buffer; return bytes consumed.
+    size_t HandleMessages(const uint8_t *data, size_t len);
+    void HandleDelta(int channel, const uint8_t *data, size_t len);
+    void SetPixels(int channel, int pos, const RGBc *colors, int count);
+    void FillPixels(int channel, int pos, const RGBc &color, int count);
+
+    MultiSPI *const spi_;
+    std::vector<Mapping> mappings_;
+    std::vector<Client*> clients_;
+    int listen_fd_;
+    int epoll_fd_;
+    bool changed_;
+    volatile bool running_;
+    Stats stats_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_OPC_SERVER_H
@@ -0,0 +1,121 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_POSITION_MAPPER_H
+#define SPIXELS_POSITION_MAPPER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "led-strip.h"
+
+namespace spixels {
+// Samples the color of LEDs at arbitrary positions from a video frame.
+//
+// Each LED of a strip gets a position in space. The positions are projected
+// onto a plane, scaled so that the bounding box of all LEDs covers the
+// source image, and the color of each LED is sampled with bilinear
+// interpolation.
+//
+// All of the geometry is done once in Prepare(): it results in a flat table
+// with four pixel offsets and weights per LED. MapFrame() then only needs to
+// gather and weigh the pixels, which can be spread over multiple threads.
+class PositionMapper {
+public:
+    struct Point {
+        float x, y, z;
+    };
+
+    // Which coordinates to use as image x and y. The image y axis points
+    // down, so for positions with y (or z) pointing up, use the _FLIP
+    // variants.
+    enum Projection {
+        PROJECT_XY, PROJECT_XY_FLIP,
+        PROJECT_XZ, PROJECT_XZ_FLIP,
+        PROJECT_ZY, PROJECT_ZY_FLIP,
+    };
+
+    // "threads" is the number of threads used in MapFrame(), including
+    // the calling one.
+    explicit PositionMapper(Projection projection = PROJECT_XY,
+                            int threads = 1);
+    ~PositionMapper();
+
+    // Add a strip with positions for its first "count" LEDs. Does not
+    // take ownership of the strip.
+    void AddStrip(LEDStrip *strip, const Point *positions, int count);
+
+    // Same, reading positions from a text file with one LED per line:
+    // "x y" or "x y z". Empty lines and lines starting with '#' are skipped.
+    // Returns 'false' if the file can't be read.
+    bool AddStripFromFile(LEDStrip *strip, const char *filename);
+
+    // Calculate the sampling table for images of the given size. Needs to
+    // be called after all strips are added and before MapFrame().
+    void Prepare(int source_width, int source_height);
+
+    // Sample the LED colors from "image", which has the size given in
+    // Prepare(), and set them on the strips. "stride" is the number of
+    // pixels from one row to the next; 0 means the width.
+    void MapFrame(const RGBc *image, int stride = 0);
+
+private:
+    struct StripPositions {
+        LEDStrip *strip;
+        int first;      // Index of first LED in the flat tables.
+        int count;
+    };
+
+    // Bilinear sample: four pixel offsets (at stride 0) and their weights,
+    // summing up to 256. The row offsets are applied in MapFrame().
+    struct Sample {
+        int32_t col[2];
+        int32_t row[2];
+        uint16_t weight[4];  // col0/row0, col1/row0, col0/row1, col1/row1
+    };
+
+    struct Worker {
+        PositionMapper *mapper;
+        int index;
+        pthread_t thread;
+    };
+
+    static void *WorkerMain(void *worker);
+    void Gather(int part);   // Part [0 .. threads) of all LEDs.
+
+    const Projection projection_;
+    std::vector<StripPositions> strips_;
+    std::vector<Point> positions_;
+    std::vector<Sample> samples_;
+    std::vector<RGBc> colors_;
+    int width_;
+
+    // Current frame, for the worker threads.
+    const RGBc *image_;
+    int stride_;
+
+    const int threads_;
+    std::vector<Worker> workers_;
+    pthread_barrier_t start_;
+    pthread_barrier_t done_;
+    volatile bool exit_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_POSITION_MAPPER_H
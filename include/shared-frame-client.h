@@ -0,0 +1,79 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_SHARED_FRAME_CLIENT_H
+#define SPIXELS_SHARED_FRAME_CLIENT_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "compositor.h"
+#include "led-strip.h"
+
+namespace spixels {
+struct SharedFrameHeader;
+
+// Draw on the strips of another process that runs a SharedFrameServer,
+// e.g. the spixelsd daemon.
+//
+// Pixels are written straight into memory shared with the server.
+// PublishFrame() hands the frame over with a single atomic operation;
+// the server always shows the latest published frame and never waits for
+// the client, nor the client for the server.
+class SharedFrameClient {
+public:
+    SharedFrameClient();
+    ~SharedFrameClient();
+
+    // Connect to the server listening at "socket_path" and draw on the given
+    // layer, which no other client may be using. Higher layers are on
+    // top of lower ones, combined with "mode" and "opacity".
+    // Returns 'false' on error (and prints the reason).
+    bool Connect(const char *socket_path, int layer,
+                 Compositor::BlendMode mode = Compositor::BLEND_NORMAL,
+                 uint8_t opacity = 255);
+
+    // Layout of the strips on the server. Valid after Connect().
+    int strip_count() const;
+    int strip_length(int strip) const;
+
+    // Set pixel in the frame being drawn.
+    void SetPixel(int strip, int pos, const RGBc &c);
+
+    // Direct access to the pixels of a strip in the frame being drawn,
+    // for the fastest possible rendering. Only valid until PublishFrame().
+    RGBc *pixels(int strip);
+
+    // Hand over the frame to the server. Afterwards, drawing starts on a
+    // buffer that contains some earlier frame, so all pixels need to be
+    // drawn again.
+    void PublishFrame();
+
+private:
+    void Disconnect();
+
+    int socket_fd_;
+    SharedFrameHeader *header_;
+    size_t mapped_size_;
+    int back_;                      // The buffer we are drawing on.
+    RGBc *back_pixels_;
+    std::vector<int> offsets_;      // Start of each strip in the buffer.
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_SHARED_FRAME_CLIENT_H
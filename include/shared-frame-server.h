@@ -0,0 +1,98 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_SHARED_FRAME_SERVER_H
+#define SPIXELS_SHARED_FRAME_SERVER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "compositor.h"
+#include "led-strip.h"
+
+namespace spixels {
+class FrameClock;
+
+// Lets other processes draw on the strips of the process that owns the
+// hardware.
+//
+// Clients (see SharedFrameClient) connect via a unix socket and get a
+// shared memory region with frame buffers for all strips. They render
+// directly into that memory and publish a frame with a single atomic
+// operation; no data goes through the socket. Each client draws on its own
+// Compositor layer. The server picks up the latest frame of each client,
+// composes and sends at the rate of its FrameClock.
+//
+// If a client disconnects, its layer is cleared.
+class SharedFrameServer {
+public:
+    struct Stats {
+        int64_t clients;           // Currently connected.
+        int64_t connections;       // Accepted in total.
+        int64_t rejected;          // Bad request, layer in use or
+                                   // broken shared state.
+        int64_t client_frames;     // Frames picked up from clients.
+        int64_t frames;            // Frames sent.
+    };
+
+    // Serve the given strips with up to "layers" clients, each on its own
+    // layer. Does not take ownership of the strips.
+    SharedFrameServer(LEDStrip *const *strips, int strip_count,
+                      int layers = 8);
+    ~SharedFrameServer();
+
+    // Listen on a unix socket at the given path, replacing any stale socket
+    // there. The socket is accessible to all users. Returns 'false' on
+    // error (and prints the reason).
+    bool Listen(const char *socket_path);
+
+    // Handle connections until "deadline_nsec" (see FrameClock::Now()), then
+    // compose the latest frames of all clients. Returns 'true' if the
+    // strips changed and need to be sent.
+    bool ProcessUntil(int64_t deadline_nsec);
+
+    // Compose and send at the rate of the clock until Stop() is called from
+    // another thread. Frames are only sent if anything changed.
+    void Run(FrameClock *clock);
+    void Stop() { running_ = false; }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Client;
+
+    void Accept();
+    void HandleHello(Client *client);
+    void CloseClient(Client *client);
+    bool FetchFrames();
+
+    LEDStrip **const strips_;
+    const int strip_count_;
+    int pixel_count_;
+    Compositor compositor_;
+    std::vector<Client*> clients_;
+    std::vector<bool> layer_used_;
+    std::string socket_path_;
+    int listen_fd_;
+    volatile bool running_;
+    Stats stats_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_SHARED_FRAME_SERVER_H
@@ -0,0 +1,58 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef SPIXELS_TIMING_STATS_H
+#define SPIXELS_TIMING_STATS_H
+
+#include <stdint.h>
+
+namespace spixels {
+// Count, sum, maximum and a histogram of durations. Adding costs a few
+// instructions, so this can stay on in production, e.g. to be exported
+// to monitoring.
+struct TimingStat {
+    // Bucket 0 counts durations below 1 usec, bucket i the ones in
+    // [2^(i-1), 2^i) usec; the last bucket also all longer ones.
+    enum { kBuckets = 16 };
+
+    int64_t count;
+    int64_t sum_nsec;
+    int64_t max_nsec;
+    int64_t histogram[kBuckets];
+
+    TimingStat() { Reset(); }
+
+    void Add(int64_t nsec) {
+        ++count;
+        sum_nsec += nsec;
+        if (nsec > max_nsec) max_nsec = nsec;
+        const uint64_t usec = nsec > 0 ? nsec / 1000 : 0;
+        const int bucket = usec ? 64 - __builtin_clzll(usec) : 0;
+        histogram[bucket < kBuckets ? bucket : kBuckets - 1]++;
+    }
+
+    void Reset() {
+        count = sum_nsec = max_nsec = 0;
+        for (int i = 0; i < kBuckets; ++i) histogram[i] = 0;
+    }
+
+    int64_t average_nsec() const { return count ? sum_nsec / count : 0; }
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_TIMING_STATS_H
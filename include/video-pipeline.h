@@ -0,0 +1,112 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_VIDEO_PIPELINE_H
+#define SPIXELS_VIDEO_PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "canvas.h"
+
+namespace spixels {
+class FrameClock;
+
+// Shows a stream of raw video frames (rgb24, e.g. the output of
+// "ffmpeg -f rawvideo -pix_fmt rgb24 -") on a Canvas.
+//
+// The work is split in three stages, each running in its own thread, so
+// that they overlap on different cores:
+//   READ: read frames from the file descriptor.
+//   MAP:  scale them to the size of the canvas (averaging all pixels that
+//         fall on each LED).
+//   SEND: copy to the strips and send.
+// Between the stages are queues of a fixed number of frames. If a stage
+// is slower than the one before, the queue fills up and the stage before
+// waits, so in the end, the input is read at the rate of the slowest stage.
+class VideoPipeline {
+public:
+    enum Stage { READ, MAP, SEND, STAGE_COUNT };
+
+    // Accumulated per stage.
+    struct StageStats {
+        int64_t frames;
+        int64_t bytes;        // Processed, i.e. read, mapped or sent.
+        int64_t busy_nsec;    // Doing actual work.
+        int64_t wait_nsec;    // Waiting for input or for room for output.
+    };
+
+    // Frames of "video_width" x "video_height" pixels, shown on "canvas",
+    // whose strips are on "spi". "queue_frames" is the capacity of each
+    // queue between stages. Does not take ownership.
+    VideoPipeline(MultiSPI *spi, Canvas *canvas,
+                  int video_width, int video_height, int queue_frames = 4);
+    ~VideoPipeline();
+
+    // Start reading frames from "fd". If "clock" is given, frames are sent
+    // at its frame rate, otherwise as fast as the strips allow.
+    // Returns 'false' if already running.
+    bool Start(int fd, FrameClock *clock = NULL);
+
+    // Wait until the input ends and all frames have been sent.
+    void Wait();
+
+    // Stop all stages, dropping frames still in the queues.
+    void Stop();
+
+    // Number of stages that are still running.
+    bool running() const { return running_stages_ > 0; }
+
+    const StageStats &stats(Stage stage) const { return stats_[stage]; }
+
+private:
+    class FrameQueue;
+
+    static void *ReadThread(void *self);
+    static void *MapThread(void *self);
+    static void *SendThread(void *self);
+    void Read();
+    void Map();
+    void Send();
+    void Scale(const uint8_t *in, uint8_t *out);
+
+    MultiSPI *const spi_;
+    Canvas *const canvas_;
+    const int video_width_;
+    const int video_height_;
+    const size_t video_bytes_;
+    const size_t canvas_bytes_;
+    const bool needs_scaling_;
+
+    // Source range for each output column and row.
+    int *const x_begin_, *const x_end_;
+    int *const y_begin_, *const y_end_;
+    uint32_t *const sums_;
+
+    FrameQueue *read_queue_;
+    FrameQueue *map_queue_;
+    int fd_;
+    const int stop_fd_;  // eventfd signaled by Stop() to wake up the reader.
+    FrameClock *clock_;
+    pthread_t threads_[STAGE_COUNT];
+    volatile int running_stages_;
+    bool started_;
+    StageStats stats_[STAGE_COUNT];
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_VIDEO_PIPELINE_H
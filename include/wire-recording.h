@@ -0,0 +1,201 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_WIRE_RECORDING_H
+#define SPIXELS_WIRE_RECORDING_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "multi-spi.h"
+
+namespace spixels {
+// Recording and playback of pre-encoded frames.
+//
+// A recording stores each frame as wire frame (see
+// MultiSPI::WireFormat()), i.e. in the layout the MultiSPI implementation
+// sends it, together with a timestamp and the registered GPIOs. Playing it
+// back needs no pixel operations or encoding at all: frames are sent
+// straight from the memory mapped file.
+//
+// Recordings can only be played with the same MultiSPI implementation they
+// have been recorded with.
+
+// File format, in the native byte order:
+//   WireFileHeader at the start.
+//   Frames of "frame_size" bytes, each 64 byte aligned.
+//   "frame_count" WireFileIndexEntry, at "index_offset".
+//   "layout_count" WireFileLayoutEntry, at "layout_offset".
+struct WireFileHeader {
+    char magic[8];             // "SPXWIRE\0"
+    uint32_t version;
+    uint32_t wire_format;      // MultiSPI::WireFormat()
+    uint32_t frame_size;
+    uint32_t frame_count;
+    uint32_t layout_count;
+    uint32_t reserved;
+    uint64_t index_offset;
+    uint64_t layout_offset;
+};
+
+struct WireFileIndexEntry {
+    uint64_t offset;           // Frame data. Repeated frames share it.
+    int64_t timestamp_usec;    // Since the first frame.
+};
+
+// Registered data GPIO.
+struct WireFileLayoutEntry {
+    int32_t gpio;
+    int32_t bytes;
+    int32_t clock_gpio;        // -1 for the default clock.
+    int32_t clock_divider;
+};
+
+// A MultiSPI that records all frames sent through it, e.g. from a live
+// session, and passes everything on to the actual implementation.
+//
+//   MultiSPI *spi = CreateDirectMultiSPI();
+//   WireRecorder recorder(spi);
+//   recorder.Open("show.spx");
+//   LEDStrip *strip = CreateAPA102Strip(&recorder, ...)
+//   ... use as usual; each SendBuffers() is recorded ...
+//   recorder.Close();
+//
+// Consecutive identical frames are only stored once.
+class WireRecorder : public MultiSPI {
+public:
+    // Record what is sent on "backend". Does not take ownership.
+    explicit WireRecorder(MultiSPI *backend);
+    virtual ~WireRecorder();   // Closes the file.
+
+    // Start recording to the given file. The layout (all registered GPIOs)
+    // must not change during the recording. Returns 'false' on error.
+    bool Open(const char *filename);
+
+    // If 'false', SendBuffers() only records, e.g. to render a show faster
+    // than real time. Default 'true'.
+    void set_send(bool send) { send_ = send; }
+
+    // Record the current buffers as frame to be shown at "timestamp_usec"
+    // after the start of the recording. SendBuffers() calls this with the
+    // time since the first frame.
+    bool RecordFrame(int64_t timestamp_usec);
+
+    // Finish the file. Returns 'false' on error. Also called by destructor.
+    bool Close();
+
+    int frames() const { return (int)index_.size(); }
+
+    virtual bool RegisterDataGPIO(int gpio, size_t serial_byte_size);
+    virtual void UnregisterDataGPIO(int gpio);
+    virtual bool SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                  int clock_divider);
+    virtual void SetBufferedByte(int data_gpio, size_t pos, uint8_t data) {
+        backend_->SetBufferedByte(data_gpio, pos, data);
+    }
+    virtual bool MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                   size_t count) {
+        return backend_->MoveBufferedBytes(data_gpio, from, to, count);
+    }
+    virtual void Prepare() { backend_->Prepare(); }
+    virtual void SendBuffers();
+
+    // Timed frame sequences are passed on, but not recorded.
+    virtual bool QueueFrame(uint32_t delay_usec) {
+        return backend_->QueueFrame(delay_usec);
+    }
+    virtual bool SendQueuedFrames() { return backend_->SendQueuedFrames(); }
+
+    virtual uint32_t WireFormat() const { return backend_->WireFormat(); }
+    virtual size_t WireFrameSize() const { return backend_->WireFrameSize(); }
+    virtual bool GetWireFrame(void *out) const {
+        return backend_->GetWireFrame(out);
+    }
+    virtual bool SendWireFrame(const void *frame) {
+        return backend_->SendWireFrame(frame);
+    }
+    virtual const TransferStats &transfer_stats() const {
+        return backend_->transfer_stats();
+    }
+    virtual void ResetTransferStats() { backend_->ResetTransferStats(); }
+
+private:
+    bool Fail(const char *msg);
+
+    MultiSPI *const backend_;
+    int fd_;
+    bool send_;
+    uint32_t wire_format_;     // Of the first frame.
+    int64_t first_frame_usec_;
+    uint64_t file_pos_;        // Where the next frame goes.
+    std::vector<uint8_t> frame_;
+    std::vector<uint8_t> previous_frame_;
+    std::vector<WireFileIndexEntry> index_;
+    WireFileLayoutEntry layout_[32];
+};
+
+// Plays a recording made with WireRecorder.
+class WirePlayer {
+public:
+    struct Stats {
+        int64_t frames_sent;
+        int64_t max_late_usec;    // Latest start of a frame.
+    };
+
+    // Play on "spi", which needs to be the same MultiSPI implementation
+    // the recording was made with and must not have any GPIOs registered.
+    // Does not take ownership.
+    explicit WirePlayer(MultiSPI *spi);
+    ~WirePlayer();
+
+    // Map the file and register the GPIOs of the recording on the MultiSPI.
+    // Returns 'false' (and prints the reason) if the file is not valid or
+    // does not fit the MultiSPI.
+    bool Open(const char *filename);
+
+    int frame_count() const;
+    int64_t duration_usec() const;   // Timestamp of the last frame.
+
+    // Send frame "index" right away.
+    bool SendFrame(int index);
+
+    // Play all frames at their recorded time, "speed" times faster. With
+    // speed 0, frames are sent as fast as the MultiSPI allows. With "loop",
+    // keeps playing from the start until Stop() is called from another
+    // thread.
+    void Play(float speed = 1.0, bool loop = false);
+    void Stop() { running_ = false; }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    void Close();
+    const uint8_t *Frame(int index) const;
+    void Prefetch(int index) const;
+
+    MultiSPI *const spi_;
+    uint8_t *mapped_;
+    size_t mapped_size_;
+    const WireFileHeader *header_;
+    const WireFileIndexEntry *index_;
+    volatile bool running_;
+    Stats stats_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_WIRE_RECORDING_H
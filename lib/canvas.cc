@@ -0,0 +1,142 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "canvas.h"
+
+#include <string.h>
+
+namespace spixels {
+Canvas::Canvas(LEDStrip *const *strips, int strip_count, const Layout &layout)
+    : width_(layout.width), height_(layout.height) {
+    const int line_length = layout.strips_are_columns ? height_ : width_;
+    const int lines = layout.strips_are_columns ? width_ : height_;
+    Location not_covered = { -1, -1 };
+    locations_.resize(width_ * height_, not_covered);
+
+    int line = 0;
+    size_t longest = 0;
+    for (int s = 0; s < strip_count; ++s) {
+        StripMap map;
+        map.strip = strips[s];
+        map.leds = 0;
+        for (int j = 0; j < layout.lines_per_strip && line < lines;
+             ++j, ++line) {
+            const bool reversed = (layout.start_at_far_end
+                                   ^ (layout.serpentine && j % 2 == 1));
+            for (int p = 0; p < line_length; ++p) {
+                const int led = j * line_length + p;
+                if (led >= map.strip->count()) break;
+                const int along = reversed ? line_length - 1 - p : p;
+                const int x = layout.strips_are_columns ? line : along;
+                const int y = layout.strips_are_columns ? along : line;
+                Location &loc = locations_[y * width_ + x];
+                loc.strip = s;
+                loc.led = led;
+                map.leds = led + 1;
+
+                // Extend the previous run if this LED continues it in the
+                // same image row.
+                if (!map.runs.empty()) {
+                    Run &r = map.runs.back();
+                    const int next_x = r.reversed ? r.x - r.length
+                                                  : r.x + r.length;
+                    if (r.y == y && r.led + r.length == led
+                        && (next_x == x
+                            || (r.length == 1 && r.x - 1 == x))) {
+                        if (r.length == 1) r.reversed = (x < r.x);
+                        r.length++;
+                        continue;
+                    }
+                }
+                Run run = { x, y, led, 1, false };
+                map.runs.push_back(run);
+            }
+        }
+        if ((size_t)map.leds > longest) longest = map.leds;
+        strips_.push_back(map);
+    }
+    staging_.resize(longest);
+}
+
+void Canvas::SetPixel(int x, int y, const RGBc &c) {
+    if (x < 0 || x >= width_ || y < 0 || y >= height_) return;
+    const Location &loc = locations_[y * width_ + x];
+    if (loc.strip < 0) return;
+    strips_[loc.strip].strip->SetPixel(loc.led, c);
+}
+
+void Canvas::Blit(const RGBc *image, int stride) {
+    if (staging_.empty()) return;  // No strip has LEDs.
+    if (stride == 0) stride = width_;
+    RGBc *const staging = &staging_[0];
+    for (size_t s = 0; s < strips_.size(); ++s) {
+        const StripMap &map = strips_[s];
+        // Gather the pixels in LED order, then encode the strip in one go.
+        for (size_t i = 0; i < map.runs.size(); ++i) {
+            const Run &r = map.runs[i];
+            const RGBc *src = image + r.y * stride + r.x;
+            RGBc *dst = staging + r.led;
+            if (r.length == 1) {
+                *dst = *src;  // Typical for strips in columns.
+            } else if (r.reversed) {
+                for (int k = 0; k < r.length; ++k) dst[k] = *(src - k);
+            } else {
+                memcpy(dst, src, r.length * sizeof(RGBc));
+            }
+        }
+        map.strip->SetPixels(0, staging, map.leds);
+    }
+}
+
+void Canvas::BlitRect(int x, int y, int w, int h,
+                      const RGBc *image, int stride) {
+    if (x == 0 && y == 0 && w == width_ && h == height_) {
+        Blit(image, stride);
+        return;
+    }
+    // Clip to canvas.
+    if (x < 0) { image -= x; w += x; x = 0; }
+    if (y < 0) { image -= y * stride; h += y; y = 0; }
+    if (x + w > width_) w = width_ - x;
+    if (y + h > height_) h = height_ - y;
+    if (w <= 0 || h <= 0 || staging_.empty()) return;
+
+    RGBc *const staging = &staging_[0];
+    for (size_t s = 0; s < strips_.size(); ++s) {
+        const StripMap &map = strips_[s];
+        for (size_t i = 0; i < map.runs.size(); ++i) {
+            const Run &r = map.runs[i];
+            if (r.y < y || r.y >= y + h) continue;
+            // Image columns covered by the run, and the part in the rect.
+            const int run_min = r.reversed ? r.x - r.length + 1 : r.x;
+            const int from = run_min > x ? run_min : x;
+            const int to = (run_min + r.length < x + w) ? run_min + r.length
+                                                        : x + w;
+            if (from >= to) continue;
+            const RGBc *src = image + (r.y - y) * stride + (from - x);
+            const int len = to - from;
+            if (!r.reversed) {
+                // Straight from the image, no copy.
+                map.strip->SetPixels(r.led + (from - r.x), src, len);
+            } else {
+                for (int k = 0; k < len; ++k) staging[k] = src[len - 1 - k];
+                map.strip->SetPixels(r.led + (r.x - (to - 1)), staging, len);
+            }
+        }
+    }
+}
+}  // namespace spixels
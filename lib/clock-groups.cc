@@ -0,0 +1,136 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "clock-groups.h"
+
+#include "wire-format.h"
+
+#include <stdio.h>
+
+namespace spixels {
+ClockGroups::ClockGroups(int default_clock_gpio) {
+    Group g = { default_clock_gpio, 1, 0 };
+    groups_.push_back(g);
+    for (int i = 0; i < 32; ++i) {
+        gpio_group_[i] = 0;
+        gpio_bytes_[i] = 0;
+    }
+}
+
+int ClockGroups::FindGroup(int clock_gpio) const {
+    for (size_t i = 0; i < groups_.size(); ++i) {
+        if (groups_[i].clock_gpio == clock_gpio) return i;
+    }
+    return -1;
+}
+
+bool ClockGroups::SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                   int divider) {
+    if (data_gpio < 0 || data_gpio >= 32 || clock_gpio < 0 || clock_gpio >= 32
+        || data_gpio == clock_gpio || divider < 1) {
+        return false;
+    }
+    if (gpio_bytes_[data_gpio] != 0) {
+        fprintf(stderr, "Clock for GPIO %d must be chosen before it is "
+                "registered.\n", data_gpio);
+        return false;
+    }
+    if (gpio_bytes_[clock_gpio] != 0) {
+        fprintf(stderr, "GPIO %d is already used for data.\n", clock_gpio);
+        return false;
+    }
+    int group = FindGroup(clock_gpio);
+    if (group < 0) {
+        Group g = { clock_gpio, divider, 0 };
+        groups_.push_back(g);
+        group = groups_.size() - 1;
+    } else if (groups_[group].divider != divider) {
+        fprintf(stderr, "Clock GPIO %d already used with divider %d.\n",
+                clock_gpio, groups_[group].divider);
+        return false;
+    }
+    gpio_group_[data_gpio] = group;
+    return true;
+}
+
+bool ClockGroups::Register(int data_gpio, size_t bytes) {
+    if (data_gpio < 0 || data_gpio >= 32 || FindGroup(data_gpio) >= 0)
+        return false;
+    gpio_bytes_[data_gpio] = bytes;
+    UpdateGroupLength();
+    return true;
+}
+
+void ClockGroups::Unregister(int data_gpio) {
+    if (data_gpio < 0 || data_gpio >= 32) return;
+    gpio_bytes_[data_gpio] = 0;
+    gpio_group_[data_gpio] = 0;
+    UpdateGroupLength();
+}
+
+void ClockGroups::UpdateGroupLength() {
+    for (size_t i = 0; i < groups_.size(); ++i) {
+        groups_[i].bytes = 0;
+    }
+    for (int gpio = 0; gpio < 32; ++gpio) {
+        Group &g = groups_[gpio_group_[gpio]];
+        if (gpio_bytes_[gpio] > g.bytes) g.bytes = gpio_bytes_[gpio];
+    }
+}
+
+size_t ClockGroups::bit_slots() const {
+    size_t result = 0;
+    for (size_t i = 0; i < groups_.size(); ++i) {
+        const size_t slots = groups_[i].bytes * 8 * groups_[i].divider;
+        if (slots > result) result = slots;
+    }
+    return result;
+}
+
+uint32_t ClockGroups::clock_mask() const {
+    uint32_t result = 0;
+    for (size_t i = 0; i < groups_.size(); ++i) {
+        result |= (1 << groups_[i].clock_gpio);
+    }
+    return result;
+}
+
+uint32_t ClockGroups::ClockHighMask(size_t half_clock) const {
+    uint32_t result = 0;
+    for (size_t i = 0; i < groups_.size(); ++i) {
+        const Group &g = groups_[i];
+        if (half_clock >= 2 * g.divider * 8 * g.bytes)
+            continue;   // This group is done.
+        if ((half_clock / g.divider) % 2 == 1)
+            result |= (1 << g.clock_gpio);
+    }
+    return result;
+}
+
+uint32_t ClockGroups::HashLayout(uint32_t hash) const {
+    hash = HashWireFormat(hash, groups_[0].clock_gpio);
+    for (int gpio = 0; gpio < 32; ++gpio) {
+        if (gpio_bytes_[gpio] == 0) continue;
+        const Group &g = groups_[gpio_group_[gpio]];
+        hash = HashWireFormat(hash, gpio);
+        hash = HashWireFormat(hash, gpio_bytes_[gpio]);
+        hash = HashWireFormat(hash, g.clock_gpio);
+        hash = HashWireFormat(hash, g.divider);
+    }
+    return hash;
+}
+}  // namespace spixels
@@ -0,0 +1,88 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_CLOCK_GROUPS_H
+#define SPIXELS_CLOCK_GROUPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+namespace spixels {
+// Bookkeeping for MultiSPI implementations: which data GPIO is clocked by
+// which clock GPIO, at what divider, and how many bytes each stream has.
+//
+// The output is a sequence of 'half-clocks' at the base speed. A group with
+// divider d sends one bit every 2*d half-clocks: the clock is low for
+// the first d half-clocks (data is set at the first of them) and high for
+// the remaining d. After its last bit, the clock of a group stays low.
+class ClockGroups {
+public:
+    explicit ClockGroups(int default_clock_gpio);
+
+    // See MultiSPI::SetDataGPIOClock()
+    bool SetDataGPIOClock(int data_gpio, int clock_gpio, int divider);
+
+    // Record "bytes" to be sent on "data_gpio", replacing a previous
+    // registration of that GPIO. Returns 'false' if the GPIO is a clock.
+    bool Register(int data_gpio, size_t bytes);
+
+    // Forget about the given data GPIO.
+    void Unregister(int data_gpio);
+
+    // Number of bytes registered for the given data GPIO.
+    size_t bytes(int data_gpio) const { return gpio_bytes_[data_gpio]; }
+
+    // Clock divider used for the given data GPIO.
+    int divider(int data_gpio) const {
+        return groups_[gpio_group_[data_gpio]].divider;
+    }
+
+    // Number of bit-slots at base speed needed to send all groups. A bit
+    // slot consists of two half-clocks.
+    size_t bit_slots() const;
+
+    // Bitmask of all clock GPIOs.
+    uint32_t clock_mask() const;
+
+    // Bitmask of the clock GPIOs that are high in the given half-clock.
+    uint32_t ClockHighMask(size_t half_clock) const;
+
+    // Add the layout, i.e. everything that determines the output besides
+    // the data, to the MultiSPI::WireFormat() hash (see wire-format.h).
+    uint32_t HashLayout(uint32_t hash) const;
+
+    // Returns 'true' if there are any clock groups beyond the default.
+    bool has_multiple_groups() const { return groups_.size() > 1; }
+
+private:
+    struct Group {
+        int clock_gpio;
+        int divider;
+        size_t bytes;   // Longest stream.
+    };
+    int FindGroup(int clock_gpio) const;
+    void UpdateGroupLength();
+
+    std::vector<Group> groups_;  // First one is the default group.
+    int gpio_group_[32];
+    size_t gpio_bytes_[32];
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_CLOCK_GROUPS_H
@@ -0,0 +1,162 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "compositor.h"
+
+#include "pixel-ops.h"
+
+#include <string.h>
+
+namespace spixels {
+static int SumCount(LEDStrip *const *strips, int count) {
+    int result = 0;
+    for (int i = 0; i < count; ++i) result += strips[i]->count();
+    return result;
+}
+
+Compositor::Compositor(LEDStrip *const *strips, int strip_count, int layers)
+    : strips_(new LEDStrip*[strip_count]), offsets_(new int[strip_count]),
+      strip_count_(strip_count), bytes_(3 * SumCount(strips, strip_count)),
+      black_(new uint8_t[bytes_]), scratch_(new uint8_t[bytes_]),
+      first_changed_(0) {
+    int offset = 0;
+    for (int i = 0; i < strip_count; ++i) {
+        strips_[i] = strips[i];
+        offsets_[i] = offset;
+        offset += strips[i]->count();
+    }
+    bzero(black_, bytes_);
+    for (int i = 0; i < layers; ++i) {
+        Layer l;
+        l.colors = new uint8_t[bytes_];
+        l.alpha = new uint8_t[bytes_];
+        l.result = new uint8_t[bytes_];
+        bzero(l.colors, bytes_);
+        bzero(l.alpha, bytes_);
+        l.opacity = 255;
+        l.mode = BLEND_NORMAL;
+        layers_.push_back(l);
+    }
+}
+
+Compositor::~Compositor() {
+    for (size_t i = 0; i < layers_.size(); ++i) {
+        delete [] layers_[i].colors;
+        delete [] layers_[i].alpha;
+        delete [] layers_[i].result;
+    }
+    delete [] scratch_;
+    delete [] black_;
+    delete [] offsets_;
+    delete [] strips_;
+}
+
+int Compositor::ByteOffset(int strip, int pos) const {
+    if (strip < 0 || strip >= strip_count_) return -1;
+    if (pos < 0 || pos >= strips_[strip]->count()) return -1;
+    return 3 * (offsets_[strip] + pos);
+}
+
+void Compositor::MarkChanged(int layer) {
+    if (layer < first_changed_) first_changed_ = layer;
+}
+
+void Compositor::SetPixel(int layer, int strip, int pos, const RGBc &c,
+                          uint8_t alpha) {
+    SetPixels(layer, strip, pos, &c, 1, alpha);
+}
+
+void Compositor::SetPixels(int layer, int strip, int pos, const RGBc *colors,
+                           int count, uint8_t alpha) {
+    if (layer < 0 || layer >= layers()) return;
+    if (strip < 0 || strip >= strip_count_) return;
+    if (pos < 0) {
+        colors -= pos;
+        count += pos;
+        pos = 0;
+    }
+    const int strip_count = strips_[strip]->count();
+    if (pos + count > strip_count) count = strip_count - pos;
+    if (count <= 0) return;
+    const int offset = ByteOffset(strip, pos);
+    Layer &l = layers_[layer];
+    memcpy(l.colors + offset, colors, 3 * count);
+    memset(l.alpha + offset, alpha, 3 * count);
+    MarkChanged(layer);
+}
+
+void Compositor::ClearLayer(int layer) {
+    if (layer < 0 || layer >= layers()) return;
+    bzero(layers_[layer].alpha, bytes_);
+    MarkChanged(layer);
+}
+
+void Compositor::SetLayerOpacity(int layer, uint8_t opacity) {
+    if (layer < 0 || layer >= layers()) return;
+    if (layers_[layer].opacity == opacity) return;
+    layers_[layer].opacity = opacity;
+    MarkChanged(layer);
+}
+
+void Compositor::SetLayerBlendMode(int layer, BlendMode mode) {
+    if (layer < 0 || layer >= layers()) return;
+    if (layers_[layer].mode == mode) return;
+    layers_[layer].mode = mode;
+    MarkChanged(layer);
+}
+
+bool Compositor::Compose() {
+    if (first_changed_ >= layers())
+        return false;
+    for (int i = first_changed_; i < layers(); ++i) {
+        const uint8_t *below = (i == 0) ? black_ : layers_[i-1].result;
+        Layer &l = layers_[i];
+        if (l.opacity == 0) {
+            memcpy(l.result, below, bytes_);
+            continue;
+        }
+        const uint8_t *top = l.colors;
+        switch (l.mode) {
+        case BLEND_NORMAL: break;
+        case BLEND_ADD:
+            AddBytes(below, l.colors, scratch_, bytes_);
+            top = scratch_;
+            break;
+        case BLEND_MULTIPLY:
+            MultiplyBytes(below, l.colors, scratch_, bytes_);
+            top = scratch_;
+            break;
+        case BLEND_SCREEN:
+            ScreenBytes(below, l.colors, scratch_, bytes_);
+            top = scratch_;
+            break;
+        case BLEND_LIGHTEN:
+            LightenBytes(below, l.colors, scratch_, bytes_);
+            top = scratch_;
+            break;
+        }
+        MixBytesWeighted(below, top, l.alpha, l.opacity, l.result, bytes_);
+    }
+    first_changed_ = layers();
+
+    const RGBc *result = (const RGBc*) layers_.back().result;
+    for (int i = 0; i < strip_count_; ++i) {
+        strips_[i]->SetPixels(0, result + offsets_[i], strips_[i]->count());
+    }
+    return true;
+}
+}  // namespace spixels
@@ -17,7 +17,11 @@
 
 #include "multi-spi.h"
 
+#include "clock-groups.h"
 #include "ft-gpio.h"
+#include "gpio-stream.h"
+#include "stats-clock.h"
+#include "wire-format.h"
 
 #include <math.h>
 #include <assert.h>
@@ -28,105 +32,232 @@
 
 namespace spixels {
 
-// This should be in a multi-spi.cc, but that would be the only function. So
-// here is good as well.
-int MultiSPI::SPIPinForConnector(int connector) {
-    switch (connector) {
-    case 1:  return SPI_P1;
-    case 2:  return SPI_P2;
-    case 3:  return SPI_P3;
-    case 4:  return SPI_P4;
-    case 5:  return SPI_P5;
-    case 6:  return SPI_P6;
-    case 7:  return SPI_P7;
-    case 8:  return SPI_P8;
-
-    case 9:  return SPI_P9;
-    case 10: return SPI_P10;
-    case 11: return SPI_P11;
-    case 12: return SPI_P12;
-    case 13: return SPI_P13;
-    case 14: return SPI_P14;
-    case 15: return SPI_P15;
-    case 16: return SPI_P16;
-    }
-    return -1;
-}
-
 namespace {
 class DirectMultiSPI : public MultiSPI {
 public:
-    explicit DirectMultiSPI(float speed_mhz, int clock_gpio);
+    // If "stream" is given, the GPIO operations are recorded there instead
+    // of written to the hardware.
+    DirectMultiSPI(float speed_mhz, int clock_gpio, GPIOStream *stream);
     virtual ~DirectMultiSPI();
 
     virtual bool RegisterDataGPIO(int gpio, size_t serial_byte_size);
+    virtual void UnregisterDataGPIO(int gpio);
+    virtual bool SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                  int clock_divider);
     virtual void SetBufferedByte(int data_gpio, size_t pos, uint8_t data);
+    virtual bool MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                   size_t count);
     virtual void SendBuffers();
 
+    virtual uint32_t WireFormat() const;
+    virtual size_t WireFrameSize() const { return size_ * sizeof(uint32_t); }
+    virtual bool GetWireFrame(void *out) const;
+    virtual bool SendWireFrame(const void *frame);
+
 private:
+    bool AddOutput(int gpio) {
+        return stream_ ? stream_->AddOutput(gpio) : gpio_.AddOutput(gpio);
+    }
+    void UpdateLayout();
+    void ClearData(int gpio, size_t from_slot);
+    void Send(const uint32_t *gpio_data);
+
+    // Output is either ft::GPIO or GPIOStream.
+    template <class Output>
+    void SendTo(Output *out, const uint32_t *gpio_data);
+    template <class Output>
+    void SendSingleClock(Output *out, const uint32_t *gpio_data);
+    template <class Output>
+    void SendClockGroups(Output *out, const uint32_t *gpio_data);
+
     const int clock_gpio_;
     const int write_repeat_;  // how often write operations to repeat to slowdown
     ft::GPIO gpio_;
-    size_t size_;
-    uint32_t *gpio_data_;
+    GPIOStream *const stream_;
+    ClockGroups groups_;
+    size_t size_;         // Number of bit slots.
+    size_t capacity_;     // Allocated bit slots.
+    uint32_t *gpio_data_; // Data bits for each bit slot.
+
+    // Only with multiple clock groups: clock bits for each half-clock.
+    uint32_t *clock_data_;
 };
 }  // end anonymous namespace
 
-DirectMultiSPI::DirectMultiSPI(float speed_mhz, int clock_gpio)
+DirectMultiSPI::DirectMultiSPI(float speed_mhz, int clock_gpio,
+                               GPIOStream *stream)
     : clock_gpio_(clock_gpio),
       write_repeat_(std::max(2, (int)roundf(30.0 / speed_mhz))),
-      size_(0), gpio_data_(NULL) {
-    bool success = gpio_.Init();
+      stream_(stream), groups_(clock_gpio), size_(0), capacity_(0),
+      gpio_data_(NULL), clock_data_(NULL) {
+    bool success = stream_ || gpio_.Init();
     assert(success);  // gpio couldn't be initialized
-    success = gpio_.AddOutput(clock_gpio);
+    success = AddOutput(clock_gpio);
     assert(success);  // clock pin not valid
 }
 
 DirectMultiSPI::~DirectMultiSPI() {
     free(gpio_data_);
+    free(clock_data_);
 }
 
-bool DirectMultiSPI::RegisterDataGPIO(int gpio, size_t serial_byte_size) {
-    if (serial_byte_size > size_) {
-        const int prev_size = size_ * 8 * sizeof(uint32_t);
-        const int new_size = serial_byte_size * 8 * sizeof(uint32_t);
-        size_ = serial_byte_size;
-	if (gpio_data_ == NULL) {
-            gpio_data_ = (uint32_t*)malloc(new_size);
-        } else {
-            gpio_data_ = (uint32_t*)realloc(gpio_data_, new_size);
+bool DirectMultiSPI::SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                      int clock_divider) {
+    return (groups_.SetDataGPIOClock(data_gpio, clock_gpio, clock_divider)
+            && AddOutput(clock_gpio));
+}
+
+void DirectMultiSPI::UpdateLayout() {
+    const size_t slots = groups_.bit_slots();
+    if (slots > capacity_) {
+        gpio_data_ = (uint32_t*)realloc(gpio_data_, slots * sizeof(uint32_t));
+        bzero(gpio_data_ + capacity_, (slots - capacity_) * sizeof(uint32_t));
+        capacity_ = slots;
+    } else if (slots < size_) {
+        // Keep unused part zero, so that it is clean when growing again.
+        bzero(gpio_data_ + slots, (size_ - slots) * sizeof(uint32_t));
+    }
+    size_ = slots;
+
+    if (groups_.has_multiple_groups()) {
+        // The clock pattern depends on the length of each group, so
+        // needs to be re-created whenever a group changes.
+        clock_data_ = (uint32_t*)realloc(clock_data_,
+                                         2 * size_ * sizeof(uint32_t));
+        for (size_t i = 0; i < 2 * size_; ++i) {
+            clock_data_[i] = groups_.ClockHighMask(i);
         }
-        bzero(gpio_data_ + prev_size, new_size-prev_size);
     }
+}
 
-    return gpio_.AddOutput(gpio);
+void DirectMultiSPI::ClearData(int gpio, size_t from_slot) {
+    for (size_t i = from_slot; i < size_; ++i) {
+        gpio_data_[i] &= ~(1 << gpio);
+    }
+}
+
+bool DirectMultiSPI::RegisterDataGPIO(int gpio, size_t serial_byte_size) {
+    if (!groups_.Register(gpio, serial_byte_size))
+        return false;
+    UpdateLayout();
+    // If re-registered shorter, the old data at the end is not to be sent.
+    ClearData(gpio, serial_byte_size * 8 * groups_.divider(gpio));
+    return AddOutput(gpio);
+}
+
+void DirectMultiSPI::UnregisterDataGPIO(int gpio) {
+    if (gpio < 0 || gpio >= 32) return;
+    ClearData(gpio, 0);
+    groups_.Unregister(gpio);
+    UpdateLayout();
 }
 
 void DirectMultiSPI::SetBufferedByte(int data_gpio, size_t pos, uint8_t data) {
-    assert(pos < size_);
-    uint32_t *buffer_pos = gpio_data_ + 8 * pos;
-    for (uint8_t bit = 0x80; bit; bit >>= 1, buffer_pos++) {
-        if (data & bit) {   // set
-            *buffer_pos |= (1 << data_gpio);
-        } else {  // reset
-            *buffer_pos &= ~(1 << data_gpio);
+    const int divider = groups_.divider(data_gpio);
+    assert(pos < groups_.bytes(data_gpio));
+    uint32_t *buffer_pos = gpio_data_ + 8 * divider * pos;
+    for (uint8_t bit = 0x80; bit; bit >>= 1) {
+        // With a slower clock, a bit spans multiple slots.
+        for (int i = 0; i < divider; ++i, buffer_pos++) {
+            if (data & bit) {   // set
+                *buffer_pos |= (1 << data_gpio);
+            } else {  // reset
+                *buffer_pos &= ~(1 << data_gpio);
+            }
         }
     }
 }
 
-void DirectMultiSPI::SendBuffers() {
-    uint32_t *end = gpio_data_ + 8 * size_;
-    for (uint32_t *data = gpio_data_; data < end; ++data) {
+bool DirectMultiSPI::MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                       size_t count) {
+    assert(from + count <= groups_.bytes(data_gpio));
+    assert(to + count <= groups_.bytes(data_gpio));
+    const size_t slots_per_byte = 8 * groups_.divider(data_gpio);
+    const uint32_t mask = 1 << data_gpio;
+    uint32_t *const src = gpio_data_ + slots_per_byte * from;
+    uint32_t *const dst = gpio_data_ + slots_per_byte * to;
+    const size_t slots = slots_per_byte * count;
+    if (dst < src) {
+        for (size_t i = 0; i < slots; ++i)
+            dst[i] = (dst[i] & ~mask) | (src[i] & mask);
+    } else {
+        for (size_t i = slots; i > 0; --i)
+            dst[i-1] = (dst[i-1] & ~mask) | (src[i-1] & mask);
+    }
+    return true;
+}
+
+template <class Output>
+void DirectMultiSPI::SendSingleClock(Output *out, const uint32_t *gpio_data) {
+    const uint32_t *end = gpio_data + size_;
+    for (const uint32_t *data = gpio_data; data < end; ++data) {
         uint32_t d = *data;
-        for (int i = 0; i < write_repeat_; ++i) gpio_.Write(d);
+        for (int i = 0; i < write_repeat_; ++i) out->Write(d);
         d |= (1 << clock_gpio_);   // pos clock edge.
-        for (int i = 0; i < write_repeat_; ++i) gpio_.Write(d);
+        for (int i = 0; i < write_repeat_; ++i) out->Write(d);
+    }
+}
+
+template <class Output>
+void DirectMultiSPI::SendClockGroups(Output *out, const uint32_t *gpio_data) {
+    const uint32_t *clock = clock_data_;
+    const uint32_t *end = gpio_data + size_;
+    for (const uint32_t *data = gpio_data; data < end; ++data, clock += 2) {
+        const uint32_t d = *data;
+        for (int i = 0; i < write_repeat_; ++i) out->Write(d | clock[0]);
+        for (int i = 0; i < write_repeat_; ++i) out->Write(d | clock[1]);
+    }
+}
+
+template <class Output>
+void DirectMultiSPI::SendTo(Output *out, const uint32_t *gpio_data) {
+    if (groups_.has_multiple_groups()) {
+        SendClockGroups(out, gpio_data);
+    } else {
+        SendSingleClock(out, gpio_data);
+    }
+    out->Write(0);  // Reset clock.
+}
+
+void DirectMultiSPI::Send(const uint32_t *gpio_data) {
+    const int64_t start = StatsNow();
+    if (stream_) {
+        stream_->StartSend();
+        SendTo(stream_, gpio_data);
+    } else {
+        SendTo(&gpio_, gpio_data);
     }
-    gpio_.Write(0);  // Reset clock.
+    AddTiming(&transfer_stats_.transmit, TRACE_TRANSMIT, start, StatsNow());
+    transfer_stats_.frames_sent++;
+    transfer_stats_.bits_sent += size_;
+}
+
+void DirectMultiSPI::SendBuffers() {
+    Send(gpio_data_);
+}
+
+uint32_t DirectMultiSPI::WireFormat() const {
+    return groups_.HashLayout(StartWireFormat(WIRE_FORMAT_DIRECT));
+}
+
+bool DirectMultiSPI::GetWireFrame(void *out) const {
+    memcpy(out, gpio_data_, WireFrameSize());
+    return true;
+}
+
+bool DirectMultiSPI::SendWireFrame(const void *frame) {
+    // The data bits for each slot are all we need; clocks are added
+    // while sending.
+    Send((const uint32_t*)frame);
+    return true;
 }
 
 // Public interface
 MultiSPI *CreateDirectMultiSPI(float speed_mhz, int clock_gpio) {
-    return new DirectMultiSPI(speed_mhz, clock_gpio);
+    return new DirectMultiSPI(speed_mhz, clock_gpio, NULL);
+}
+MultiSPI *CreateRecordingDirectMultiSPI(GPIOStream *stream, float speed_mhz,
+                                        int clock_gpio) {
+    return new DirectMultiSPI(speed_mhz, clock_gpio, stream);
 }
 }  // namespace spixels
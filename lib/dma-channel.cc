@@ -0,0 +1,101 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "dma-channel.h"
+
+#include "ft-gpio.h"
+#include "rpi-dma.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DMA_BASE          0x007000
+
+// Waking up from usleep() has a latency of several ten microseconds. So we
+// only sleep until shortly before the transfer is expected to be done and
+// busy-poll the channel status for the remaining time.
+#define DMA_POLL_MARGIN_USEC 60
+
+namespace spixels {
+int64_t GetMonotonicMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+DMAChannel::DMAChannel() : channel_(0) {}
+
+bool DMAChannel::Init(int channel) {
+    // 4.2.1.2
+    char *dmaBase = (char*) ft::mmap_bcm_register(DMA_BASE);
+    if (dmaBase == NULL) return false;
+    channel_ = (struct dma_channel_header*)(dmaBase + 0x100 * channel);
+
+    // We don't know in which state a previous user left the channel.
+    Reset();
+    return true;
+}
+
+void DMAChannel::Reset() {
+    channel_->cs |= DMA_CS_ABORT;
+    usleep(100);
+    channel_->cs &= ~DMA_CS_ACTIVE;
+    channel_->cs |= DMA_CS_RESET;
+    usleep(10);
+}
+
+void DMAChannel::Start(const struct UncachedMemBlock *mem,
+                       struct dma_cb *start) {
+    // A channel that ran to the end of its previous chain is inactive and
+    // can directly be handed the next one. Only if it ended with an error,
+    // we have to go through the slow abort and reset.
+    if (channel_->cs & DMA_CS_ERROR) {
+        fprintf(stderr, "DMA channel reported error; resetting.\n");
+        Reset();
+    }
+    channel_->cs = DMA_CS_END;  // Write one to clear.
+    channel_->cblock = UncachedMemBlock_to_physical(mem, start);
+    channel_->cs = DMA_CS_PRIORITY(7) | DMA_CS_PANIC_PRIORITY(7) | DMA_CS_DISDEBUG;
+    channel_->cs |= DMA_CS_ACTIVE;
+}
+
+int64_t DMAChannel::WaitDone(int64_t expected_usec, int64_t *poll_usec) {
+    const int64_t start_time = GetMonotonicMicros();
+    if (expected_usec > DMA_POLL_MARGIN_USEC) {
+        usleep(expected_usec - DMA_POLL_MARGIN_USEC);
+    }
+    const int64_t poll_start = poll_usec ? GetMonotonicMicros() : 0;
+    bool seen_active = false;
+    uint32_t cs;
+    while (((cs = channel_->cs) & DMA_CS_ACTIVE) && !(cs & DMA_CS_ERROR)) {
+        seen_active = true;
+        // Long sequences might take longer than predicted. Don't burn CPU.
+        if (GetMonotonicMicros() - start_time > expected_usec + 1000)
+            usleep(1000);
+    }
+    const int64_t end_time = GetMonotonicMicros();
+    if (poll_usec) *poll_usec = end_time - poll_start;
+    // Only if we saw the end of the transfer, we know how long it took.
+    // Otherwise we overslept, and the measured time includes the wake-up
+    // latency, which would make the estimate grow with every frame. Then
+    // sleep a bit shorter next time.
+    if (seen_active)
+        return end_time - start_time;
+    return expected_usec - expected_usec / 16;
+}
+}  // namespace spixels
@@ -0,0 +1,61 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_DMA_CHANNEL_H
+#define SPIXELS_DMA_CHANNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct dma_cb;
+struct dma_channel_header;
+struct UncachedMemBlock;
+
+namespace spixels {
+// Monotonic time in microseconds.
+int64_t GetMonotonicMicros();
+
+// A DMA channel that works through control block chains.
+class DMAChannel {
+public:
+    DMAChannel();
+
+    // Map the registers of the given channel and reset it.
+    // Returns 'false' if the registers could not be mapped.
+    bool Init(int channel);
+
+    bool initialized() const { return channel_ != 0; }
+
+    // Start working on the chain beginning with "start", which is
+    // located in "mem".
+    void Start(const struct UncachedMemBlock *mem, struct dma_cb *start);
+
+    // Wait until the chain is done. "expected_usec" is how long we expect
+    // this to take; we sleep most of that time and then busy-poll for
+    // the end of the transfer. Returns the expected time for the next
+    // transfer of the same length; if "poll_usec" is given, it is set to the
+    // time spent busy-polling.
+    int64_t WaitDone(int64_t expected_usec, int64_t *poll_usec = NULL);
+
+private:
+    void Reset();
+
+    volatile struct dma_channel_header *channel_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_DMA_CHANNEL_H
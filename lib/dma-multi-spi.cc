@@ -17,8 +17,14 @@
 
 #include "multi-spi.h"
 
+#include "clock-groups.h"
+#include "dma-channel.h"
 #include "ft-gpio.h"
+#include "gpio-stream.h"
+#include "pwm-pacer.h"
 #include "rpi-dma.h"
+#include "stats-clock.h"
+#include "wire-format.h"
 
 #include <assert.h>
 #include <strings.h>
@@ -34,6 +40,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <vector>
+
 
 // ---- GPIO specific defines
 #define GPIO_REGISTER_BASE 0x200000
@@ -43,34 +51,75 @@
 
 // ---- DMA specific defines
 #define DMA_CHANNEL       5   // That usually is free.
-#define DMA_BASE          0x007000
+
+// Resolution of delays in timed frame sequences.
+#define DMA_PACE_PERIOD_NSEC 1000
 
 namespace spixels {
 namespace {
 class DMAMultiSPI : public MultiSPI {
 public:
-    explicit DMAMultiSPI(int clock_gpio);
+    // If "stream" is given, the GPIO operations are recorded there instead
+    // of sent with DMA.
+    DMAMultiSPI(int clock_gpio, GPIOStream *stream);
     virtual ~DMAMultiSPI();
 
     virtual bool RegisterDataGPIO(int gpio, size_t serial_byte_size);
+    virtual void UnregisterDataGPIO(int gpio);
+    virtual bool SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                  int clock_divider);
     virtual void SetBufferedByte(int data_gpio, size_t pos, uint8_t data);
+    virtual bool MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                   size_t count);
+    virtual void Prepare();
     virtual void SendBuffers();
 
+    virtual bool QueueFrame(uint32_t delay_usec);
+    virtual bool SendQueuedFrames();
+
+    virtual uint32_t WireFormat() const;
+    virtual size_t WireFrameSize() const { return gpio_buffer_size_; }
+    virtual bool GetWireFrame(void *out) const;
+    virtual bool SendWireFrame(const void *frame);
+
 private:
+    struct GPIOData;
+    struct QueuedFrame {
+        GPIOData *data;
+        uint32_t delay_usec;
+        uint32_t delay_periods;  // Pacer periods, including FIFO fill-up.
+    };
+
+    bool AddOutput(int gpio) {
+        return stream_ ? stream_->AddOutput(gpio) : gpio_.AddOutput(gpio);
+    }
+    void UpdateLayout();
+    void ClearData(int gpio, int from_op);
+    void Send(const GPIOData *data);
+    void Record(const GPIOData *data);
     void FinishRegistration();
+    void ReleaseDMAMemory();
+    struct dma_cb *SetupGPIOBlocks(const struct UncachedMemBlock *mem,
+                                   struct dma_cb *cb, GPIOData *data,
+                                   int gpio_operations);
 
-    struct GPIOData;
     ft::GPIO gpio_;
-    const int clock_gpio_;
-    size_t serial_byte_size_;   // Number of serial bytes to send.
+    GPIOStream *const stream_;
+    ClockGroups groups_;
+    size_t bit_slots_;   // Number of bits to send at base clock speed.
 
     struct UncachedMemBlock alloced_;
     GPIOData *gpio_dma_;
     struct dma_cb* start_block_;
-    struct dma_channel_header* dma_channel_;
+    DMAChannel dma_channel_;
+    int64_t expected_transfer_usec_;  // As measured in last transfer.
 
     GPIOData *gpio_shadow_;
     size_t gpio_buffer_size_;  // Buffer-size for GPIO operations needed.
+    int shadow_capacity_;      // Number of GPIOData allocated in shadow.
+
+    PWMPacer pacer_;  // Only initialized once timed sequences are used.
+    std::vector<QueuedFrame> queue_;
 };
 }  // end anonymous namespace
 
@@ -81,112 +130,197 @@ struct DMAMultiSPI::GPIOData {
     uint32_t clr;
 };
 
-DMAMultiSPI::DMAMultiSPI(int clock_gpio)
-    : clock_gpio_(clock_gpio), serial_byte_size_(0),
-      gpio_dma_(NULL), gpio_shadow_(NULL) {
+DMAMultiSPI::DMAMultiSPI(int clock_gpio, GPIOStream *stream)
+    : stream_(stream), groups_(clock_gpio), bit_slots_(0),
+      gpio_dma_(NULL), expected_transfer_usec_(0),
+      gpio_shadow_(NULL), gpio_buffer_size_(0), shadow_capacity_(0) {
     alloced_.mem = NULL;
-    bool success = gpio_.Init();
+    bool success = stream_ || gpio_.Init();
     assert(success);  // gpio couldn't be initialized
-    success = gpio_.AddOutput(clock_gpio);
+    success = AddOutput(clock_gpio);
     assert(success);  // clock pin not valid
 }
 
 DMAMultiSPI::~DMAMultiSPI() {
-    UncachedMemBlock_free(&alloced_);
+    for (size_t i = 0; i < queue_.size(); ++i) {
+        free(queue_[i].data);
+    }
+    ReleaseDMAMemory();
     free(gpio_shadow_);
 }
 
-static int bytes_to_gpio_ops(size_t bytes) {
+static int slots_to_gpio_ops(size_t bit_slots) {
     // We need two GPIO-operations to bit-bang transfer one bit: one to set the
     // data and one to create a positive clock-edge.
-    // For each byte, we have 8 bits.
     // Also, we need a single operation at the end of everything to set clk low.
-    return bytes * 8 * 2 + 1;
+    return bit_slots * 2 + 1;
+}
+
+// One DMA operation can only span a limited amount of range.
+static int gpio_ops_to_blocks(int gpio_operations, size_t op_size) {
+    const int max_ops_per_block = (2<<15) / op_size;
+    return (gpio_operations + max_ops_per_block - 1) / max_ops_per_block;
+}
+
+bool DMAMultiSPI::SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                   int clock_divider) {
+    return (groups_.SetDataGPIOClock(data_gpio, clock_gpio, clock_divider)
+            && AddOutput(clock_gpio));
 }
 
 bool DMAMultiSPI::RegisterDataGPIO(int gpio, size_t requested_bytes) {
-    if (gpio_dma_ != NULL) {
-        fprintf(stderr, "Can not register DataGPIO after SendBuffers() has been"
-                "called\n");
-        assert(0);
+    const size_t previous_bytes = (gpio >= 0 && gpio < 32)
+        ? groups_.bytes(gpio) : 0;
+    if (!groups_.Register(gpio, requested_bytes))
+        return false;
+    UpdateLayout();
+    // If re-registered shorter, the old data at the end is not to be sent.
+    const int end_op = 2 * 8 * groups_.divider(gpio) * requested_bytes;
+    ClearData(gpio, end_op);
+    // An operation without set or clear bit leaves the line as it is, so
+    // new bytes need to be explicitly zero, and after the stream, the line
+    // needs to go low. Otherwise the level of the last bit would be sent.
+    for (size_t pos = previous_bytes; pos < requested_bytes; ++pos) {
+        SetBufferedByte(gpio, pos, 0x00);
+    }
+    gpio_shadow_[end_op].clr |= (1 << gpio);
+    return AddOutput(gpio);
+}
+
+void DMAMultiSPI::UnregisterDataGPIO(int gpio) {
+    if (gpio < 0 || gpio >= 32 || groups_.bytes(gpio) == 0) return;
+    ClearData(gpio, 0);
+    gpio_shadow_[0].clr |= (1 << gpio);  // Leave low.
+    groups_.Unregister(gpio);
+    UpdateLayout();
+}
+
+void DMAMultiSPI::ClearData(int gpio, int from_op) {
+    const int gpio_operations = slots_to_gpio_ops(bit_slots_);
+    for (int i = from_op; i < gpio_operations; ++i) {
+        gpio_shadow_[i].set &= ~(1 << gpio);
+        gpio_shadow_[i].clr &= ~(1 << gpio);
+    }
+}
+
+void DMAMultiSPI::UpdateLayout() {
+    const size_t slots = groups_.bit_slots();
+    const int gpio_operations = slots_to_gpio_ops(slots);
+    const int prev_gpio_ops = gpio_buffer_size_ / sizeof(GPIOData);
+    // We keep an in-memory buffer that we directly manipulate in
+    // SetBufferedByte() operations and then copy to the DMA managed buffer
+    // when actually sending. Reason is, that the DMA buffer is uncached
+    // memory and very slow to access in particular for the operations
+    // needed in SetBufferedByte().
+    // RegisterDataGPIO() can be called multiple times with different sizes,
+    // so we need to be prepared to adjust size.
+    if (gpio_operations > shadow_capacity_) {
+        gpio_shadow_ = (GPIOData*)realloc(gpio_shadow_,
+                                          gpio_operations * sizeof(GPIOData));
+        bzero(gpio_shadow_ + shadow_capacity_,
+              (gpio_operations - shadow_capacity_)*sizeof(GPIOData));
+        shadow_capacity_ = gpio_operations;
+    } else if (gpio_operations < prev_gpio_ops) {
+        // Keep unused part zero, so that it is clean when growing again.
+        bzero(gpio_shadow_ + gpio_operations,
+              (prev_gpio_ops - gpio_operations)*sizeof(GPIOData));
     }
-    if (requested_bytes > serial_byte_size_) {
-        const int prev_gpio_end = bytes_to_gpio_ops(serial_byte_size_) - 1;
-        serial_byte_size_ = requested_bytes;
-        const int gpio_operations = bytes_to_gpio_ops(serial_byte_size_);
+    if (slots != bit_slots_) {
+        // The DMA chain for the previous size is of no use anymore.
+        ReleaseDMAMemory();
+        bit_slots_ = slots;
         gpio_buffer_size_ = gpio_operations * sizeof(GPIOData);
-        // We keep an in-memory buffer that we directly manipulate in
-        // SetBufferedByte() operations and then copy to the DMA managed buffer
-        // when actually sending. Reason is, that the DMA buffer is uncached
-        // memory and very slow to access in particular for the operations
-        // needed in SetBufferedByte().
-        // RegisterDataGPIO() can be called multiple times with different sizes,
-        // so we need to be prepared to adjust size.
-        gpio_shadow_ = (GPIOData*)realloc(gpio_shadow_, gpio_buffer_size_);
-        bzero(gpio_shadow_ + prev_gpio_end,
-              (gpio_operations - prev_gpio_end)*sizeof(GPIOData));
-        // Prepare every other element to set the CLK pin so that later, we
-        // only have to set the data.
-        // Even: data, clock low; Uneven: clock pos edge
-        for (int i = prev_gpio_end; i < gpio_operations; ++i) {
-            if (i % 2 == 0)
-                gpio_shadow_[i].clr = (1<<clock_gpio_);
-            else
-                gpio_shadow_[i].set = (1<<clock_gpio_);
-        }
     }
 
-    return gpio_.AddOutput(gpio);
+    // Prepare the clock edges, so that later, we only have to set the data.
+    // With a single clock, even elements set data with clock low, uneven
+    // create the positive clock edge. Other clock groups have their edges
+    // further apart and end after their longest stream; so if the length of
+    // a group changes, the clock pattern changes.
+    const uint32_t all_clocks = groups_.clock_mask();
+    uint32_t prev_high = all_clocks;  // Make sure we start with clocks low.
+    for (int i = 0; i < gpio_operations; ++i) {
+        const uint32_t high = groups_.ClockHighMask(i);
+        GPIOData *op = gpio_shadow_ + i;
+        op->set = (op->set & ~all_clocks) | (high & ~prev_high);
+        op->clr = (op->clr & ~all_clocks) | (~high & prev_high);
+        prev_high = high;
+    }
 }
 
 void DMAMultiSPI::FinishRegistration() {
     assert(alloced_.mem == NULL);  // Registered twice ?
-    // One DMA operation can only span a limited amount of range.
-    const int kMaxOpsPerBlock = (2<<15) / sizeof(GPIOData);
-    const int gpio_operations = bytes_to_gpio_ops(serial_byte_size_);
-    const int control_blocks
-        = (gpio_operations + kMaxOpsPerBlock - 1) / kMaxOpsPerBlock;
+    const int gpio_operations = slots_to_gpio_ops(bit_slots_);
+    const int control_blocks = gpio_ops_to_blocks(gpio_operations,
+                                                  sizeof(GPIOData));
     const int alloc_size = (control_blocks * sizeof(struct dma_cb)
                             + gpio_operations * sizeof(GPIOData));
-    alloced_ = UncachedMemBlock_alloc(alloc_size);
+    // Re-using memory from a previous layout is much faster than
+    // asking the VideoCore for new memory.
+    alloced_ = UncachedMemBlock_pool_alloc(alloc_size);
     gpio_dma_ = (struct GPIOData*) ((uint8_t*)alloced_.mem
                                     + control_blocks * sizeof(struct dma_cb));
 
-    struct dma_cb* previous = NULL;
-    struct dma_cb* cb = NULL;
-    struct GPIOData *start_gpio = gpio_dma_;
+    // First block in our chain.
+    start_block_ = (struct dma_cb*) alloced_.mem;
+    struct dma_cb *last = SetupGPIOBlocks(&alloced_, start_block_, gpio_dma_,
+                                          gpio_operations);
+    last->next = 0;
+
+    if (!dma_channel_.initialized()) {
+        const bool success = dma_channel_.Init(DMA_CHANNEL);
+        assert(success);  // Could not map DMA registers.
+    }
+}
+
+void DMAMultiSPI::ReleaseDMAMemory() {
+    if (!queue_.empty()) {
+        fprintf(stderr, "Layout changed; dropping %d queued frames.\n",
+                (int)queue_.size());
+        for (size_t i = 0; i < queue_.size(); ++i) {
+            free(queue_[i].data);
+        }
+        queue_.clear();
+    }
+    UncachedMemBlock_pool_release(&alloced_);
+    gpio_dma_ = NULL;
+    expected_transfer_usec_ = 0;
+}
+
+// Set up the consecutive control blocks starting at "cb" to send
+// "gpio_operations" GPIOData starting at "data". Returns the last block; the
+// caller has to set its next pointer.
+struct dma_cb *DMAMultiSPI::SetupGPIOBlocks(const struct UncachedMemBlock *mem,
+                                            struct dma_cb *cb, GPIOData *data,
+                                            int gpio_operations) {
+    const int kMaxOpsPerBlock = (2<<15) / sizeof(GPIOData);
+    const int control_blocks = gpio_ops_to_blocks(gpio_operations,
+                                                  sizeof(GPIOData));
     int remaining = gpio_operations;
-    for (int i = 0; i < control_blocks; ++i) {
-        cb = (struct dma_cb*) ((uint8_t*)alloced_.mem + i * sizeof(dma_cb));
-        if (previous) {
-            previous->next = UncachedMemBlock_to_physical(&alloced_, cb);
+    for (int i = 0; i < control_blocks; ++i, ++cb) {
+        if (i > 0) {
+            (cb-1)->next = UncachedMemBlock_to_physical(mem, cb);
         }
         const int n = remaining > kMaxOpsPerBlock ? kMaxOpsPerBlock : remaining;
         cb->info   = (DMA_CB_TI_SRC_INC | DMA_CB_TI_DEST_INC |
                       DMA_CB_TI_NO_WIDE_BURSTS | DMA_CB_TI_TDMODE);
-        cb->src    = UncachedMemBlock_to_physical(&alloced_, start_gpio);
+        cb->src    = UncachedMemBlock_to_physical(mem, data);
         cb->dst    = PHYSICAL_GPIO_BUS + GPIO_SET_OFFSET;
         cb->length = DMA_CB_TXFR_LEN_YLENGTH(n)
             | DMA_CB_TXFR_LEN_XLENGTH(sizeof(GPIOData));
         cb->stride = DMA_CB_STRIDE_D_STRIDE(-16) | DMA_CB_STRIDE_S_STRIDE(0);
-        previous = cb;
-        start_gpio += n;
+        data += n;
         remaining -= n;
     }
-    cb->next = 0;
-
-    // First block in our chain.
-    start_block_ = (struct dma_cb*) alloced_.mem;
-
-    // 4.2.1.2
-    char *dmaBase = (char*) ft::mmap_bcm_register(DMA_BASE);
-    dma_channel_ = (struct dma_channel_header*)(dmaBase + 0x100 * DMA_CHANNEL);
+    return cb - 1;
 }
 
 void DMAMultiSPI::SetBufferedByte(int data_gpio, size_t pos, uint8_t data) {
-    assert(pos < serial_byte_size_);
-    GPIOData *buffer_pos = gpio_shadow_ + 2 * 8 * pos;
-    for (uint8_t bit = 0x80; bit; bit >>= 1, buffer_pos += 2) {
+    // With a slower clock, the bits are further apart.
+    const int bit_distance = 2 * groups_.divider(data_gpio);
+    assert(pos < groups_.bytes(data_gpio));
+    GPIOData *buffer_pos = gpio_shadow_ + 8 * bit_distance * pos;
+    for (uint8_t bit = 0x80; bit; bit >>= 1, buffer_pos += bit_distance) {
         if (data & bit) {   // set
             buffer_pos->set |= (1 << data_gpio);
             buffer_pos->clr &= ~(1 << data_gpio);
@@ -197,28 +331,161 @@ void DMAMultiSPI::SetBufferedByte(int data_gpio, size_t pos, uint8_t data) {
     }
 }
 
-void DMAMultiSPI::SendBuffers() {
+bool DMAMultiSPI::MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                    size_t count) {
+    assert(from + count <= groups_.bytes(data_gpio));
+    assert(to + count <= groups_.bytes(data_gpio));
+    // Operations in between the data bits don't touch this GPIO, so we
+    // can just move all of them.
+    const size_t ops_per_byte = 8 * 2 * groups_.divider(data_gpio);
+    const uint32_t mask = 1 << data_gpio;
+    GPIOData *const src = gpio_shadow_ + ops_per_byte * from;
+    GPIOData *const dst = gpio_shadow_ + ops_per_byte * to;
+    const size_t ops = ops_per_byte * count;
+    if (dst < src) {
+        for (size_t i = 0; i < ops; ++i) {
+            dst[i].set = (dst[i].set & ~mask) | (src[i].set & mask);
+            dst[i].clr = (dst[i].clr & ~mask) | (src[i].clr & mask);
+        }
+    } else {
+        for (size_t i = ops; i > 0; --i) {
+            dst[i-1].set = (dst[i-1].set & ~mask) | (src[i-1].set & mask);
+            dst[i-1].clr = (dst[i-1].clr & ~mask) | (src[i-1].clr & mask);
+        }
+    }
+    return true;
+}
+
+void DMAMultiSPI::Prepare() {
+    if (stream_) return;
     if (!gpio_dma_) FinishRegistration();
+    // Touch all memory involved in sending.
     memcpy(gpio_dma_, gpio_shadow_, gpio_buffer_size_);
+}
 
-    dma_channel_->cs |= DMA_CS_END;
-    dma_channel_->cblock = UncachedMemBlock_to_physical(&alloced_, start_block_);
-    dma_channel_->cs = DMA_CS_PRIORITY(7) | DMA_CS_PANIC_PRIORITY(7) | DMA_CS_DISDEBUG;
-    dma_channel_->cs |= DMA_CS_ACTIVE;
-    while ((dma_channel_->cs & DMA_CS_ACTIVE)
-           && !(dma_channel_->cs & DMA_CS_ERROR)) {
-        usleep(10);
+void DMAMultiSPI::SendBuffers() {
+    Send(gpio_shadow_);
+}
+
+// The DMA engine writes each GPIOData to the set register, then the clear
+// register; record that instead.
+void DMAMultiSPI::Record(const GPIOData *data) {
+    stream_->StartSend();
+    const int gpio_operations = gpio_buffer_size_ / sizeof(GPIOData);
+    for (int i = 0; i < gpio_operations; ++i) {
+        stream_->Append(data[i].set, data[i].clr);
     }
+}
 
-    dma_channel_->cs |= DMA_CS_ABORT;
-    usleep(100);
-    dma_channel_->cs &= ~DMA_CS_ACTIVE;
-    dma_channel_->cs |= DMA_CS_RESET;
+void DMAMultiSPI::Send(const GPIOData *data) {
+    transfer_stats_.frames_sent++;
+    transfer_stats_.bits_sent += bit_slots_;
+    if (stream_) {
+        ScopedTiming timing(&transfer_stats_.transmit, TRACE_TRANSMIT);
+        Record(data);
+        return;
+    }
+    if (!gpio_dma_) FinishRegistration();
+    const int64_t start = StatsNow();
+    memcpy(gpio_dma_, data, gpio_buffer_size_);
+    const int64_t copied = StatsNow();
+    dma_channel_.Start(&alloced_, start_block_);
+    // The buffer size does not change after registration, so the duration
+    // of this transfer is a good predictor for the next one.
+    int64_t poll_usec;
+    expected_transfer_usec_ = dma_channel_.WaitDone(expected_transfer_usec_,
+                                                    &poll_usec);
+    const int64_t end = StatsNow();
+    AddTiming(&transfer_stats_.copy, TRACE_COPY, start, copied);
+    AddTiming(&transfer_stats_.transmit, TRACE_TRANSMIT, copied, end);
+    AddTiming(&transfer_stats_.poll, TRACE_POLL, end - poll_usec * 1000, end);
+}
+
+bool DMAMultiSPI::QueueFrame(uint32_t delay_usec) {
+    if (stream_) return false;  // Needs the PWM as timer.
+    if (!gpio_dma_) FinishRegistration();
+    if (!pacer_.initialized() && !pacer_.Init(DMA_PACE_PERIOD_NSEC))
+        return false;
+    // While the data is sent, the PWM FIFO runs empty. It first needs
+    // to fill up before the delay is paced.
+    const uint64_t periods = ((uint64_t)delay_usec * 1000
+                              / pacer_.period_nsec() + PWMPacer::kFifoWords);
+    if (periods > PWMPacer::kMaxDelayPeriods) return false;
+    QueuedFrame frame;
+    frame.data = (GPIOData*)malloc(gpio_buffer_size_);
+    if (frame.data == NULL) return false;
+    memcpy(frame.data, gpio_shadow_, gpio_buffer_size_);
+    frame.delay_usec = delay_usec;
+    frame.delay_periods = periods;
+    queue_.push_back(frame);
+    return true;
+}
+
+bool DMAMultiSPI::SendQueuedFrames() {
+    if (queue_.empty()) return true;
+    const int frames = queue_.size();
+    const int gpio_operations = slots_to_gpio_ops(bit_slots_);
+    // Each frame is followed by a delay block.
+    const int blocks_per_frame = gpio_ops_to_blocks(gpio_operations,
+                                                    sizeof(GPIOData)) + 1;
+    const size_t cb_size = frames * blocks_per_frame * sizeof(struct dma_cb);
+    struct UncachedMemBlock mem
+        = UncachedMemBlock_pool_alloc(cb_size + frames * gpio_buffer_size_
+                                      + sizeof(uint32_t));
+    struct dma_cb *const start = (struct dma_cb*) mem.mem;
+    GPIOData *data = (GPIOData*) ((uint8_t*)mem.mem + cb_size);
+    uint32_t *pace_src = (uint32_t*) (data + frames * gpio_operations);
+    const uint32_t pace_src_bus = UncachedMemBlock_to_physical(&mem, pace_src);
+
+    // All frames are linked to one long chain, which the DMA engine works
+    // through on its own.
+    int64_t expected_usec = 0;
+    struct dma_cb *cb = start;
+    for (int i = 0; i < frames; ++i) {
+        memcpy(data, queue_[i].data, gpio_buffer_size_);
+        free(queue_[i].data);
+        struct dma_cb *delay_block = SetupGPIOBlocks(&mem, cb, data,
+                                                     gpio_operations) + 1;
+        (delay_block-1)->next = UncachedMemBlock_to_physical(&mem, delay_block);
+        pacer_.SetupDelayBlock(delay_block, pace_src_bus,
+                               queue_[i].delay_periods);
+        delay_block->next = (i + 1 < frames)
+            ? UncachedMemBlock_to_physical(&mem, delay_block + 1)
+            : 0;
+        cb = delay_block + 1;
+        data += gpio_operations;
+        expected_usec += expected_transfer_usec_ + queue_[i].delay_usec;
+    }
+    queue_.clear();
+
+    // Transmit time includes the delays, so only count the frames.
+    dma_channel_.Start(&mem, start);
+    dma_channel_.WaitDone(expected_usec);
+    UncachedMemBlock_pool_release(&mem);
+    transfer_stats_.frames_sent += frames;
+    return true;
+}
+
+uint32_t DMAMultiSPI::WireFormat() const {
+    return groups_.HashLayout(StartWireFormat(WIRE_FORMAT_DMA));
 }
 
+bool DMAMultiSPI::GetWireFrame(void *out) const {
+    // Includes the clock edges, so sending is just a copy.
+    memcpy(out, gpio_shadow_, gpio_buffer_size_);
+    return true;
+}
+
+bool DMAMultiSPI::SendWireFrame(const void *frame) {
+    Send((const GPIOData*)frame);
+    return true;
+}
 
 // Public interface
 MultiSPI *CreateDMAMultiSPI(int clock_gpio) {
-    return new DMAMultiSPI(clock_gpio);
+    return new DMAMultiSPI(clock_gpio, NULL);
+}
+MultiSPI *CreateRecordingDMAMultiSPI(GPIOStream *stream, int clock_gpio) {
+    return new DMAMultiSPI(clock_gpio, stream);
 }
 }  // namespace spixels
@@ -0,0 +1,312 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "dmx-receiver.h"
+
+#include "dma-channel.h"  // GetMonotonicMicros()
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define E131_PORT   5568
+#define ARTNET_PORT 6454
+
+#define DMX_SLOTS   512
+
+// Maximum packet size is E1.31 with 512 slots: 126 byte header.
+#define MAX_PACKET_SIZE 638
+
+// Packets received with one recvmmsg() call.
+#define RECEIVE_BATCH 32
+
+// E1.31 layer vectors and offsets.
+#define E131_ROOT_VECTOR_DATA      0x00000004
+#define E131_ROOT_VECTOR_EXTENDED  0x00000008
+#define E131_FRAMING_VECTOR_DATA   0x00000002
+#define E131_EXTENDED_VECTOR_SYNC  0x00000001
+#define E131_OPTION_PREVIEW        0x80
+#define E131_DATA_HEADER_SIZE      126   // Up to and including start code.
+#define E131_SYNC_PACKET_SIZE      49
+
+#define ARTNET_OP_DMX   0x5000
+#define ARTNET_OP_SYNC  0x5200
+#define ARTNET_DMX_HEADER_SIZE 18
+
+// Without sync packets for that long, the sender has stopped using sync,
+// and frames are sent on frame boundaries again (as Art-Net specifies).
+#define SYNC_TIMEOUT_USEC 4000000
+
+namespace spixels {
+static uint16_t ReadBE16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+static uint32_t ReadBE32(const uint8_t *p) {
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static const uint8_t kE131Identifier[12] = {
+    'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0
+};
+static const uint8_t kArtNetIdentifier[8] = {
+    'A', 'r', 't', '-', 'N', 'e', 't', 0
+};
+
+DMXReceiver::DMXReceiver(MultiSPI *spi)
+    : spi_(spi), universes_in_frame_(0), frame_start_usec_(0),
+      artnet_sync_usec_(0), e131_sync_usec_(0), running_(false),
+      receive_buffer_(RECEIVE_BATCH * MAX_PACKET_SIZE) {
+    bzero(&stats_, sizeof(stats_));
+}
+
+DMXReceiver::~DMXReceiver() {
+    for (size_t i = 0; i < fds_.size(); ++i) {
+        close(fds_[i]);
+    }
+}
+
+void DMXReceiver::MapUniverse(int universe, int first_slot,
+                              LEDStrip *strip, int first_pixel,
+                              int pixel_count) {
+    Mapping m = { universe, first_slot, strip, first_pixel, pixel_count };
+    mappings_.push_back(m);
+    if (FindUniverse(universe) == NULL) {
+        UniverseState u = { universe, -1, 0, false };
+        universes_.push_back(u);
+    }
+}
+
+int DMXReceiver::MapStrip(LEDStrip *strip, int universe) {
+    const int kPixelsPerUniverse = DMX_SLOTS / 3;
+    for (int pos = 0; pos < strip->count(); pos += kPixelsPerUniverse) {
+        int count = strip->count() - pos;
+        if (count > kPixelsPerUniverse) count = kPixelsPerUniverse;
+        MapUniverse(universe++, 0, strip, pos, count);
+    }
+    return universe;
+}
+
+DMXReceiver::UniverseState *DMXReceiver::FindUniverse(int universe) {
+    // Typically only a couple of dozen universes; linear search is fine.
+    for (size_t i = 0; i < universes_.size(); ++i) {
+        if (universes_[i].universe == universe) return &universes_[i];
+    }
+    return NULL;
+}
+
+bool DMXReceiver::Listen(Protocol protocol, int port) {
+    if (port == 0) port = (protocol == E131) ? E131_PORT : ARTNET_PORT;
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket()");
+        return false;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // Bursts of many universes at once should not get dropped.
+    int rcvbuf = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind()");
+        close(fd);
+        return false;
+    }
+    fds_.push_back(fd);
+    return true;
+}
+
+void DMXReceiver::ProcessPackets(int timeout_ms) {
+    const int nfds = fds_.size();
+    std::vector<struct pollfd> pfd(nfds);
+    for (int i = 0; i < nfds; ++i) {
+        pfd[i].fd = fds_[i];
+        pfd[i].events = POLLIN;
+    }
+    if (poll(&pfd[0], nfds, timeout_ms) <= 0)
+        return;
+
+    uint8_t *const buffers = &receive_buffer_[0];
+    struct iovec iov[RECEIVE_BATCH];
+    struct mmsghdr msgs[RECEIVE_BATCH];
+    for (int i = 0; i < RECEIVE_BATCH; ++i) {
+        iov[i].iov_base = buffers + i * MAX_PACKET_SIZE;
+        iov[i].iov_len = MAX_PACKET_SIZE;
+        bzero(&msgs[i].msg_hdr, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (int i = 0; i < nfds; ++i) {
+        if ((pfd[i].revents & POLLIN) == 0) continue;
+        // Drain everything that is there, batch by batch.
+        int received;
+        while ((received = recvmmsg(pfd[i].fd, msgs, RECEIVE_BATCH,
+                                    MSG_DONTWAIT, NULL)) > 0) {
+            const int64_t now = GetMonotonicMicros();
+            for (int m = 0; m < received; ++m) {
+                HandlePacket(buffers + m * MAX_PACKET_SIZE, msgs[m].msg_len,
+                             now);
+            }
+            if (received < RECEIVE_BATCH) break;
+        }
+    }
+}
+
+void DMXReceiver::Run() {
+    running_ = true;
+    while (running_) {
+        ProcessPackets(100);
+    }
+}
+
+void DMXReceiver::HandlePacket(const uint8_t *data, int len, int64_t now) {
+    if (len >= ARTNET_DMX_HEADER_SIZE - 4
+        && memcmp(data, kArtNetIdentifier, sizeof(kArtNetIdentifier)) == 0) {
+        const uint16_t opcode = data[8] | (data[9] << 8);  // little endian
+        if (opcode == ARTNET_OP_SYNC) {
+            stats_.sync_packets++;
+            artnet_sync_usec_ = now;
+            SendFrame();
+            return;
+        }
+        if (opcode == ARTNET_OP_DMX && len >= ARTNET_DMX_HEADER_SIZE) {
+            const int universe = data[14] | ((data[15] & 0x7f) << 8);
+            int slots = ReadBE16(data + 16);
+            if (slots > len - ARTNET_DMX_HEADER_SIZE)
+                slots = len - ARTNET_DMX_HEADER_SIZE;
+            // Sequence 0 means sequencing is not used.
+            const bool wait_for_sync = (artnet_sync_usec_ != 0
+                && now - artnet_sync_usec_ < SYNC_TIMEOUT_USEC);
+            HandleDMX(universe, data[12] == 0 ? -1 : data[12], 0,
+                      wait_for_sync, data + ARTNET_DMX_HEADER_SIZE, slots,
+                      now);
+            return;
+        }
+        stats_.ignored_packets++;
+        return;
+    }
+
+    if (len < E131_SYNC_PACKET_SIZE
+        || ReadBE16(data) != 0x0010
+        || memcmp(data + 4, kE131Identifier, sizeof(kE131Identifier)) != 0) {
+        stats_.ignored_packets++;
+        return;
+    }
+    const uint32_t root_vector = ReadBE32(data + 18);
+    const uint32_t framing_vector = ReadBE32(data + 40);
+    if (root_vector == E131_ROOT_VECTOR_EXTENDED
+        && framing_vector == E131_EXTENDED_VECTOR_SYNC) {
+        // Only for us if one of our universes is synchronized with it.
+        const int sync_address = ReadBE16(data + 45);
+        bool ours = false;
+        for (size_t i = 0; i < universes_.size() && !ours; ++i) {
+            ours = (universes_[i].sync_address == sync_address);
+        }
+        if (sync_address == 0 || !ours) {
+            stats_.ignored_packets++;
+            return;
+        }
+        stats_.sync_packets++;
+        e131_sync_usec_ = now;
+        SendFrame();
+        return;
+    }
+    if (root_vector != E131_ROOT_VECTOR_DATA
+        || framing_vector != E131_FRAMING_VECTOR_DATA
+        || len < E131_DATA_HEADER_SIZE
+        || (data[112] & E131_OPTION_PREVIEW)   // Not meant for us.
+        || data[125] != 0) {                   // Only DMX start code.
+        stats_.ignored_packets++;
+        return;
+    }
+    int slots = ReadBE16(data + 123) - 1;
+    if (slots > len - E131_DATA_HEADER_SIZE)
+        slots = len - E131_DATA_HEADER_SIZE;
+    const int sync_address = ReadBE16(data + 109);
+    const bool wait_for_sync = (sync_address != 0 && e131_sync_usec_ != 0
+                                && now - e131_sync_usec_ < SYNC_TIMEOUT_USEC);
+    HandleDMX(ReadBE16(data + 113), data[111], sync_address, wait_for_sync,
+              data + E131_DATA_HEADER_SIZE, slots, now);
+}
+
+void DMXReceiver::HandleDMX(int universe, int sequence, int sync_address,
+                            bool wait_for_sync, const uint8_t *slots,
+                            int slot_count, int64_t now) {
+    UniverseState *state = FindUniverse(universe);
+    if (state == NULL || slot_count <= 0) {
+        stats_.ignored_packets++;
+        return;
+    }
+    if (sequence >= 0 && state->last_sequence >= 0) {
+        // Out of order packets within a window are dropped.
+        const int8_t diff = sequence - state->last_sequence;
+        if (diff <= 0 && diff > -20) {
+            stats_.ignored_packets++;
+            return;
+        }
+    }
+    if (sequence >= 0) state->last_sequence = sequence;
+    state->sync_address = sync_address;
+    stats_.packets++;
+
+    // Without sync, seeing the universe again starts a new frame.
+    if (state->in_frame && !wait_for_sync) {
+        SendFrame();
+    }
+    if (frame_start_usec_ == 0) frame_start_usec_ = now;
+
+    for (size_t i = 0; i < mappings_.size(); ++i) {
+        const Mapping &m = mappings_[i];
+        if (m.universe != universe) continue;
+        int count = (slot_count - m.first_slot) / 3;
+        if (count > m.pixel_count) count = m.pixel_count;
+        if (count <= 0) continue;
+        // RGBc is three bytes, just like the slots; no need to copy.
+        m.strip->SetPixels(m.first_pixel,
+                           (const RGBc*)(slots + m.first_slot), count);
+    }
+
+    if (!state->in_frame) {
+        state->in_frame = true;
+        ++universes_in_frame_;
+    }
+    if (!wait_for_sync && universes_in_frame_ == (int)universes_.size()) {
+        SendFrame();
+    }
+}
+
+void DMXReceiver::SendFrame() {
+    if (frame_start_usec_ == 0) return;   // Nothing new.
+    spi_->SendBuffers();
+    const int64_t latency = GetMonotonicMicros() - frame_start_usec_;
+    stats_.frames++;
+    stats_.sum_latency_usec += latency;
+    if (latency > stats_.max_latency_usec) stats_.max_latency_usec = latency;
+    for (size_t i = 0; i < universes_.size(); ++i) {
+        universes_[i].in_frame = false;
+    }
+    universes_in_frame_ = 0;
+    frame_start_usec_ = 0;
+}
+}  // namespace spixels
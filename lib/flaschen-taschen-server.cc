@@ -0,0 +1,295 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "flaschen-taschen-server.h"
+
+#include "dma-channel.h"  // GetMonotonicMicros()
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// Largest UDP datagram.
+#define MAX_PACKET_SIZE 65507
+
+// Packets received with one recvmmsg() call.
+#define RECEIVE_BATCH 16
+
+// Upper limit of recvmmsg() calls before sending a frame.
+#define MAX_BATCHES_PER_FRAME 4
+
+// Largest number accepted in a header and largest offset accepted, so that
+// sizes and positions computed from them can't overflow.
+#define MAX_HEADER_NUMBER 65535
+
+namespace spixels {
+namespace {
+// Reads numbers and skips whitespace and comments in a PPM header,
+// without copying it.
+class HeaderParser {
+public:
+    HeaderParser(const uint8_t *data, const uint8_t *end)
+        : pos_(data), end_(end), ft_x_(0), ft_y_(0), ft_z_(0) {}
+
+    // Read next number; -1 on error or if larger than MAX_HEADER_NUMBER.
+    int ReadNumber() {
+        SkipWhitespaceAndComments();
+        if (pos_ >= end_ || !isdigit(*pos_)) return -1;
+        int result = 0;
+        while (pos_ < end_ && isdigit(*pos_)) {
+            result = result * 10 + (*pos_++ - '0');
+            if (result > MAX_HEADER_NUMBER) return -1;
+        }
+        return result;
+    }
+
+    // After the maxval, exactly one whitespace character precedes the data.
+    const uint8_t *DataStart() {
+        return (pos_ < end_ && isspace(*pos_)) ? pos_ + 1 : NULL;
+    }
+
+    const uint8_t *pos() const { return pos_; }
+
+    // Position from a "#FT: x y z" comment, if any.
+    int ft_x() const { return ft_x_; }
+    int ft_y() const { return ft_y_; }
+    int ft_z() const { return ft_z_; }
+
+private:
+    void SkipWhitespaceAndComments() {
+        while (pos_ < end_) {
+            if (isspace(*pos_)) {
+                ++pos_;
+            } else if (*pos_ == '#') {
+                const uint8_t *eol = (const uint8_t*)memchr(pos_, '\n',
+                                                            end_ - pos_);
+                if (eol == NULL) eol = end_;
+                ParseComment(pos_, eol);
+                pos_ = eol;
+            } else {
+                break;
+            }
+        }
+    }
+
+    void ParseComment(const uint8_t *start, const uint8_t *eol) {
+        if (eol - start < 5 || memcmp(start, "#FT:", 4) != 0) return;
+        char buffer[64];
+        const size_t len = eol - start < 63 ? eol - start : 63;
+        memcpy(buffer, start, len);
+        buffer[len] = '\0';
+        sscanf(buffer + 4, "%d %d %d", &ft_x_, &ft_y_, &ft_z_);
+    }
+
+    const uint8_t *pos_;
+    const uint8_t *const end_;
+    int ft_x_, ft_y_, ft_z_;
+};
+}  // anonymous namespace
+
+FlaschenTaschenServer::FlaschenTaschenServer(MultiSPI *spi, Canvas *canvas,
+                                             int layer_timeout_sec)
+    : spi_(spi), canvas_(canvas),
+      layer_timeout_usec_(layer_timeout_sec * 1000000LL),
+      width_(canvas->width()), height_(canvas->height()), top_layer_(0),
+      row_(canvas->width()),
+      receive_buffer_(RECEIVE_BATCH * (MAX_PACKET_SIZE + 1)),
+      fd_(-1), changed_(false), running_(false) {
+    for (int i = 0; i < MAX_LAYERS; ++i) {
+        layers_[i].last_update_usec = 0;
+    }
+    layers_[0].pixels.resize(width_ * height_);
+    bzero(&stats_, sizeof(stats_));
+}
+
+FlaschenTaschenServer::~FlaschenTaschenServer() {
+    if (fd_ >= 0) close(fd_);
+}
+
+bool FlaschenTaschenServer::Listen(int port) {
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd_ < 0) {
+        perror("socket()");
+        return false;
+    }
+    int rcvbuf = 4 << 20;   // Allow for bursts of full frames.
+    setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind()");
+        return false;
+    }
+    return true;
+}
+
+void FlaschenTaschenServer::ProcessPackets(int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        uint8_t *const buffers = &receive_buffer_[0];
+        struct iovec iov[RECEIVE_BATCH];
+        struct mmsghdr msgs[RECEIVE_BATCH];
+        for (int i = 0; i < RECEIVE_BATCH; ++i) {
+            iov[i].iov_base = buffers + i * (MAX_PACKET_SIZE + 1);
+            iov[i].iov_len = MAX_PACKET_SIZE;
+            bzero(&msgs[i].msg_hdr, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        // Drain what is queued, but don't hold back output for too long
+        // if packets arrive faster than we can handle them.
+        for (int batch = 0; batch < MAX_BATCHES_PER_FRAME; ++batch) {
+            const int received = recvmmsg(fd_, msgs, RECEIVE_BATCH,
+                                          MSG_DONTWAIT, NULL);
+            const int64_t now = GetMonotonicMicros();
+            for (int m = 0; m < received; ++m) {
+                stats_.packets++;
+                if (!HandlePacket((const uint8_t*)iov[m].iov_base,
+                                  msgs[m].msg_len, now)) {
+                    stats_.bad_packets++;
+                }
+            }
+            if (received < RECEIVE_BATCH)
+                break;
+        }
+    }
+    ExpireLayers(GetMonotonicMicros());
+    // All packets received are shown at once.
+    if (changed_) {
+        spi_->SendBuffers();
+        stats_.frames++;
+        changed_ = false;
+    }
+}
+
+void FlaschenTaschenServer::Run() {
+    running_ = true;
+    while (running_) {
+        ProcessPackets(100);
+    }
+}
+
+bool FlaschenTaschenServer::HandlePacket(const uint8_t *data, int len,
+                                         int64_t now) {
+    const uint8_t *const end = data + len;
+    if (len < 3 || data[0] != 'P' || data[1] != '6') return false;
+    HeaderParser header(data + 2, end);
+    const int w = header.ReadNumber();
+    const int h = header.ReadNumber();
+    const int maxval = header.ReadNumber();
+    const uint8_t *pixels = header.DataStart();
+    if (w <= 0 || h <= 0 || maxval != 255 || pixels == NULL) return false;
+    const int64_t image_bytes = 3LL * w * h;
+    if (end - pixels < image_bytes) return false;
+
+    int x = header.ft_x(), y = header.ft_y(), z = header.ft_z();
+    // Footer overrides the header comment.
+    const uint8_t *footer = pixels + image_bytes;
+    if (footer < end) {
+        char buffer[64];
+        const size_t footer_len = (end - footer) < 63 ? end - footer : 63;
+        memcpy(buffer, footer, footer_len);
+        buffer[footer_len] = '\0';
+        sscanf(buffer, "%d %d %d", &x, &y, &z);
+    }
+    if (z < 0 || z >= MAX_LAYERS) return false;
+    if (x < -MAX_HEADER_NUMBER || x > MAX_HEADER_NUMBER
+        || y < -MAX_HEADER_NUMBER || y > MAX_HEADER_NUMBER)
+        return false;
+
+    Layer &layer = layers_[z];
+    if (layer.pixels.empty()) layer.pixels.resize(width_ * height_);
+    layer.last_update_usec = now;
+    if (z > top_layer_) top_layer_ = z;
+    SetLayerRect(z, x, y, w, h, (const RGBc*)pixels, w);
+    return true;
+}
+
+void FlaschenTaschenServer::SetLayerRect(int z, int x, int y, int w, int h,
+                                         const RGBc *image, int stride) {
+    // Clip to canvas.
+    if (x < 0) { image -= x; w += x; x = 0; }
+    if (y < 0) { image -= y * stride; h += y; y = 0; }
+    if (x + w > width_) w = width_ - x;
+    if (y + h > height_) h = height_ - y;
+    if (w <= 0 || h <= 0) return;
+
+    RGBc *const layer = &layers_[z].pixels[0];
+    for (int row = 0; row < h; ++row) {
+        memcpy(layer + (y + row) * width_ + x, image + row * stride,
+               w * sizeof(RGBc));
+    }
+    if (z == 0 && top_layer_ == 0) {
+        // Nothing on top: the datagram goes straight to the strips.
+        canvas_->BlitRect(x, y, w, h, image, stride);
+    } else {
+        ComposeRect(x, y, w, h);
+    }
+    changed_ = true;
+}
+
+void FlaschenTaschenServer::ComposeRect(int x, int y, int w, int h) {
+    RGBc *const row = &row_[0];
+    for (int yy = y; yy < y + h; ++yy) {
+        for (int xx = x; xx < x + w; ++xx) {
+            const int pos = yy * width_ + xx;
+            // Topmost non-black pixel wins; layer 0 is always visible.
+            int z = top_layer_;
+            for (/**/; z > 0; --z) {
+                const Layer &l = layers_[z];
+                if (l.last_update_usec == 0) continue;
+                const RGBc &c = l.pixels[pos];
+                if (c.r || c.g || c.b) break;
+            }
+            row[xx - x] = layers_[z].pixels[pos];
+        }
+        canvas_->BlitRect(x, yy, w, 1, row, w);
+    }
+}
+
+void FlaschenTaschenServer::ExpireLayers(int64_t now) {
+    bool expired = false;
+    for (int z = 1; z <= top_layer_; ++z) {
+        Layer &l = layers_[z];
+        if (l.last_update_usec == 0
+            || now - l.last_update_usec < layer_timeout_usec_)
+            continue;
+        l.last_update_usec = 0;
+        std::fill(l.pixels.begin(), l.pixels.end(), RGBc());
+        expired = true;
+    }
+    if (!expired) return;
+    while (top_layer_ > 0 && layers_[top_layer_].last_update_usec == 0) {
+        --top_layer_;
+    }
+    ComposeRect(0, 0, width_, height_);
+    changed_ = true;
+}
+}  // namespace spixels
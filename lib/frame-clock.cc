@@ -0,0 +1,123 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "frame-clock.h"
+
+#include "multi-spi.h"
+#include "stats-clock.h"
+
+#include <errno.h>
+#include <time.h>
+
+namespace spixels {
+FrameClock::FrameClock(MultiSPI *spi, float frames_per_second,
+                       LatePolicy policy, int tolerance_usec)
+    : spi_(spi), period_nsec_((int64_t)(1e9 / frames_per_second)),
+      policy_(policy), tolerance_nsec_(tolerance_usec * 1000LL) {
+    last_.deadline_nsec = 0;
+    last_.slack_nsec = 0;
+    last_.late_nsec = 0;
+    last_.dropped = false;
+    ResetStats();
+}
+
+int64_t FrameClock::Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void FrameClock::ResetStats() {
+    stats_.frames_sent = 0;
+    stats_.frames_dropped = 0;
+    stats_.frames_skipped = 0;
+    stats_.min_slack_nsec = INT64_MAX;
+    stats_.sum_slack_nsec = 0;
+    stats_.max_late_nsec = 0;
+    stats_.sum_late_nsec = 0;
+}
+
+bool FrameClock::SendBuffersAt(int64_t deadline_nsec) {
+    const int64_t slack = deadline_nsec - Now();
+    last_.deadline_nsec = deadline_nsec;
+    last_.slack_nsec = slack;
+    last_.late_nsec = 0;
+    last_.dropped = false;
+    if (slack < stats_.min_slack_nsec) stats_.min_slack_nsec = slack;
+    stats_.sum_slack_nsec += slack;
+
+    if (slack < -tolerance_nsec_ && policy_ == DROP_LATE) {
+        last_.dropped = true;
+        stats_.frames_dropped++;
+        return false;
+    }
+
+    if (slack > 0) {
+        struct timespec ts;
+        ts.tv_sec = deadline_nsec / 1000000000LL;
+        ts.tv_nsec = deadline_nsec % 1000000000LL;
+        // Absolute deadline: no drift if we are woken up by a signal.
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+               == EINTR) {
+        }
+    }
+
+    const int64_t send_start = Now();
+    const int64_t late = send_start - deadline_nsec;
+    spi_->SendBuffers();
+    if (FrameTraceActive()) {
+        if (slack > 0) {
+            AddFrameTraceSpan(TRACE_DEADLINE_WAIT, deadline_nsec - slack,
+                              send_start);
+        }
+        AddFrameTraceSpan(TRACE_SEND, send_start, Now());
+    }
+
+    last_.late_nsec = late;
+    if (late > stats_.max_late_nsec) stats_.max_late_nsec = late;
+    stats_.sum_late_nsec += late;
+    stats_.frames_sent++;
+    return true;
+}
+
+int64_t FrameClock::NextDeadline(int64_t previous_deadline) {
+    const int64_t deadline = previous_deadline + period_nsec_;
+    const int64_t now = Now();
+    if (deadline >= now)
+        return deadline;
+    // There is no point in rendering frames that are late anyway.
+    const int64_t behind = (now - deadline) / period_nsec_ + 1;
+    stats_.frames_skipped += behind;
+    return deadline + behind * period_nsec_;
+}
+
+void FrameClock::Run(FrameRenderer *renderer) {
+    spi_->Prepare();  // Don't let setup delay the first frame.
+    const int64_t start = Now();
+    int64_t deadline = start + period_nsec_;
+    for (;;) {
+        const int64_t frame = (deadline - start) / period_nsec_ - 1;
+        SetFrameTraceFrame(frame);
+        const int64_t render_start = FrameTraceActive() ? Now() : 0;
+        if (!renderer->RenderFrame(frame, deadline))
+            break;
+        if (render_start) AddFrameTraceSpan(TRACE_RENDER, render_start, Now());
+        SendBuffersAt(deadline);
+        deadline = NextDeadline(deadline);
+    }
+}
+}  // namespace spixels
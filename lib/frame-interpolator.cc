@@ -0,0 +1,152 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "frame-interpolator.h"
+
+#include "pixel-ops.h"
+
+#include <string.h>
+
+namespace spixels {
+static int SumCount(LEDStrip *const *strips, int count) {
+    int result = 0;
+    for (int i = 0; i < count; ++i) result += strips[i]->count();
+    return result;
+}
+
+FrameInterpolator::FrameInterpolator(LEDStrip *const *strips, int strip_count,
+                                     Easing easing)
+    : strips_(new LEDStrip*[strip_count]), offsets_(new int[strip_count]),
+      strip_count_(strip_count), total_pixels_(SumCount(strips, strip_count)),
+      easing_(easing),
+      write_(new RGBc[total_pixels_]), previous_(new RGBc[total_pixels_]),
+      current_(new RGBc[total_pixels_]), output_(new RGBc[total_pixels_]),
+      previous_publish_(0), current_publish_(0), last_alpha_(-1),
+      clock_(NULL), running_(false) {
+    // All strips are in one consecutive buffer, so that blending is a
+    // single long loop over all of them.
+    int offset = 0;
+    for (int i = 0; i < strip_count; ++i) {
+        strips_[i] = strips[i];
+        offsets_[i] = offset;
+        offset += strips[i]->count();
+    }
+    pthread_mutex_init(&mutex_, NULL);
+}
+
+FrameInterpolator::~FrameInterpolator() {
+    Stop();
+    pthread_mutex_destroy(&mutex_);
+    delete [] output_;
+    delete [] current_;
+    delete [] previous_;
+    delete [] write_;
+    delete [] offsets_;
+    delete [] strips_;
+}
+
+void FrameInterpolator::SetPixel(int strip, int pos, const RGBc &c) {
+    if (strip < 0 || strip >= strip_count_) return;
+    if (pos < 0 || pos >= strips_[strip]->count()) return;
+    write_[offsets_[strip] + pos] = c;
+}
+
+void FrameInterpolator::SetPixels(int strip, int pos,
+                                  const RGBc *colors, int count) {
+    if (strip < 0 || strip >= strip_count_) return;
+    if (pos < 0) {
+        colors -= pos;
+        count += pos;
+        pos = 0;
+    }
+    const int strip_count = strips_[strip]->count();
+    if (pos + count > strip_count) count = strip_count - pos;
+    if (count <= 0) return;
+    memcpy(write_ + offsets_[strip] + pos, colors, count * sizeof(RGBc));
+}
+
+void FrameInterpolator::PublishFrame() {
+    const int64_t now = FrameClock::Now();
+    pthread_mutex_lock(&mutex_);
+    RGBc *const recycled = previous_;
+    previous_ = current_;
+    current_ = write_;
+    write_ = recycled;
+    previous_publish_ = current_publish_;
+    current_publish_ = now;
+    last_alpha_ = -1;
+    pthread_mutex_unlock(&mutex_);
+    memcpy(write_, current_, total_pixels_ * sizeof(RGBc));
+}
+
+bool FrameInterpolator::RenderFrame(int64_t frame, int64_t deadline_nsec) {
+    pthread_mutex_lock(&mutex_);
+    const int64_t source_period = current_publish_ - previous_publish_;
+    int alpha = 256;
+    if (previous_publish_ > 0 && source_period > 0
+        && deadline_nsec < current_publish_ + source_period) {
+        alpha = (deadline_nsec - current_publish_) * 256 / source_period;
+        if (alpha < 0) alpha = 0;
+    }
+    if (easing_ == EASE_IN_OUT) {
+        // 3a^2 - 2a^3 in fixed point.
+        const int a2 = alpha * alpha >> 8;
+        alpha = a2 * (3 * 256 - 2 * alpha) >> 8;
+    }
+    // Once the fade is done, the strips already show the final frame.
+    const bool changed = (alpha != last_alpha_);
+    if (changed) {
+        BlendBytes((const uint8_t*)previous_, (const uint8_t*)current_, alpha,
+                   (uint8_t*)output_, 3 * total_pixels_);
+        last_alpha_ = alpha;
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    if (changed) {
+        for (int i = 0; i < strip_count_; ++i) {
+            strips_[i]->SetPixels(0, output_ + offsets_[i],
+                                  strips_[i]->count());
+        }
+    }
+    return clock_ == NULL || running_;
+}
+
+void *FrameInterpolator::ThreadMain(void *self) {
+    FrameInterpolator *const interpolator = (FrameInterpolator*) self;
+    interpolator->clock_->Run(interpolator);
+    return NULL;
+}
+
+bool FrameInterpolator::Start(FrameClock *clock) {
+    if (running_) return false;
+    clock_ = clock;
+    running_ = true;
+    if (pthread_create(&thread_, NULL, &ThreadMain, this) != 0) {
+        running_ = false;
+        clock_ = NULL;
+        return false;
+    }
+    return true;
+}
+
+void FrameInterpolator::Stop() {
+    if (!running_) return;
+    running_ = false;
+    pthread_join(thread_, NULL);
+    clock_ = NULL;
+}
+}  // namespace spixels
@@ -0,0 +1,464 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "frame-sync.h"
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SYNC_MAGIC 0x73796e63   // 'sync'
+
+// Frames to keep reports for before the skew of a frame is final.
+#define REPORT_FRAMES 64
+
+// Nodes the master keeps track of.
+#define MAX_NODES 256
+
+// Clock samples to choose the one with the shortest round trip from.
+#define CLOCK_SAMPLES 16
+
+// Don't present frames before we have that many samples.
+#define MIN_CLOCK_SAMPLES 4
+
+// First few clock requests come quickly, to get a good estimate fast.
+#define INITIAL_CLOCK_REQUESTS 8
+#define INITIAL_CLOCK_INTERVAL_NSEC  50000000LL
+#define CLOCK_INTERVAL_NSEC         500000000LL
+
+// Wake up this long before a frame is due, then sleep precisely.
+#define LATCH_MARGIN_NSEC 2000000LL
+
+namespace spixels {
+namespace {
+enum MessageType {
+    ANNOUNCE = 1,     // Master: frame, time[0] = presentation time.
+    CLOCK_REQUEST,    // Node: time[0] = node send time.
+    CLOCK_REPLY,      // Master: time[0] echoed, [1] received, [2] sent.
+    REPORT,           // Node: frame, time[0] = presented in master time,
+                      //       time[1] = presented in node host time.
+};
+
+// All fields in network byte order on the wire.
+struct Message {
+    uint32_t magic;
+    uint32_t type;
+    int64_t frame;
+    int64_t time[3];
+};
+
+void SendMessage(int fd, const struct sockaddr_in &to, MessageType type,
+                 int64_t frame, int64_t t0, int64_t t1 = 0, int64_t t2 = 0) {
+    Message msg;
+    msg.magic = htonl(SYNC_MAGIC);
+    msg.type = htonl(type);
+    msg.frame = htobe64(frame);
+    msg.time[0] = htobe64(t0);
+    msg.time[1] = htobe64(t1);
+    msg.time[2] = htobe64(t2);
+    sendto(fd, &msg, sizeof(msg), 0, (const struct sockaddr*)&to, sizeof(to));
+}
+
+// Receive next message. Returns 'false' if there is none.
+bool ReceiveMessage(int fd, Message *msg, struct sockaddr_in *from) {
+    for (;;) {
+        socklen_t from_len = sizeof(*from);
+        const ssize_t len = recvfrom(fd, msg, sizeof(*msg), MSG_DONTWAIT,
+                                     (struct sockaddr*)from, &from_len);
+        if (len < 0) return false;
+        if (len != sizeof(*msg) || ntohl(msg->magic) != SYNC_MAGIC)
+            continue;
+        msg->type = ntohl(msg->type);
+        msg->frame = be64toh(msg->frame);
+        for (int i = 0; i < 3; ++i) msg->time[i] = be64toh(msg->time[i]);
+        return true;
+    }
+}
+
+bool SameAddress(const struct sockaddr_in &a, const struct sockaddr_in &b) {
+    return (a.sin_addr.s_addr == b.sin_addr.s_addr
+            && a.sin_port == b.sin_port);
+}
+
+bool ParseAddress(const char *address, struct in_addr *result) {
+    if (inet_pton(AF_INET, address, result) == 1)
+        return true;
+    fprintf(stderr, "Invalid address %s\n", address);
+    return false;
+}
+
+int TimeoutMillis(int64_t nsec) {
+    if (nsec <= 0) return 0;
+    if (nsec > 100000000LL) return 100;
+    return (nsec + 999999) / 1000000;
+}
+}  // anonymous namespace
+
+struct FrameSyncMaster::FrameReports {
+    int64_t frame;
+    int count;
+    int64_t min_nsec, max_nsec;
+    int64_t host_min_nsec, host_max_nsec;
+};
+
+FrameSyncMaster::FrameSyncMaster()
+    : fd_(-1), recent_(REPORT_FRAMES), running_(false) {
+    for (size_t i = 0; i < recent_.size(); ++i) {
+        recent_[i].frame = -1;
+        recent_[i].count = 0;
+    }
+    bzero(&stats_, sizeof(stats_));
+}
+
+FrameSyncMaster::~FrameSyncMaster() {
+    if (fd_ >= 0) close(fd_);
+}
+
+bool FrameSyncMaster::Open(const char *group, int port,
+                           const char *interface) {
+    bzero(&group_addr_, sizeof(group_addr_));
+    group_addr_.sin_family = AF_INET;
+    group_addr_.sin_port = htons(port);
+    if (!ParseAddress(group, &group_addr_.sin_addr))
+        return false;
+    // Nodes send their requests to the port we are sending from.
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        perror("socket()");
+        return false;
+    }
+    if (interface) {
+        struct in_addr local;
+        if (!ParseAddress(interface, &local))
+            return false;
+        if (setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_IF,
+                       &local, sizeof(local)) < 0) {
+            perror("IP_MULTICAST_IF");
+            return false;
+        }
+    }
+    const unsigned char loop = 1;   // Nodes might be on this host.
+    setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    return true;
+}
+
+void FrameSyncMaster::Announce(int64_t frame, int64_t present_nsec) {
+    SendMessage(fd_, group_addr_, ANNOUNCE, frame, present_nsec);
+    stats_.frames_announced++;
+}
+
+void FrameSyncMaster::HandleMessages() {
+    Message msg;
+    struct sockaddr_in from;
+    while (ReceiveMessage(fd_, &msg, &from)) {
+        const int64_t received = FrameClock::Now();
+        switch (msg.type) {
+        case CLOCK_REQUEST:
+            SendMessage(fd_, from, CLOCK_REPLY, 0, msg.time[0], received,
+                        FrameClock::Now());
+            AddNode(from);
+            break;
+        case REPORT:
+            AddReport(from, msg.frame, msg.time[0], msg.time[1]);
+            break;
+        }
+    }
+}
+
+bool FrameSyncMaster::IsNode(const struct sockaddr_in &from) const {
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (SameAddress(nodes_[i], from)) return true;
+    }
+    return false;
+}
+
+void FrameSyncMaster::AddNode(const struct sockaddr_in &from) {
+    if (nodes_.size() >= MAX_NODES || IsNode(from)) return;
+    nodes_.push_back(from);
+    stats_.nodes = nodes_.size();
+}
+
+void FrameSyncMaster::AddReport(const struct sockaddr_in &from, int64_t frame,
+                                int64_t present_nsec, int64_t host_nsec) {
+    // Anyone can send us packets: only take reports from nodes that asked
+    // for the clock, about frames that are announced and still tracked.
+    if (!IsNode(from)) return;
+    if (frame < 0 || frame >= stats_.frames_announced
+        || frame < stats_.frames_announced - (int64_t)recent_.size())
+        return;
+    stats_.reports++;
+
+    FrameReports *r = &recent_[frame % recent_.size()];
+    if (frame < r->frame) return;   // Too late, skew already computed.
+    if (frame != r->frame) {
+        FinishFrame(r);
+        r->frame = frame;
+        r->count = 0;
+    }
+    if (r->count == 0) {
+        r->min_nsec = r->max_nsec = present_nsec;
+        r->host_min_nsec = r->host_max_nsec = host_nsec;
+    }
+    if (present_nsec < r->min_nsec) r->min_nsec = present_nsec;
+    if (present_nsec > r->max_nsec) r->max_nsec = present_nsec;
+    if (host_nsec < r->host_min_nsec) r->host_min_nsec = host_nsec;
+    if (host_nsec > r->host_max_nsec) r->host_max_nsec = host_nsec;
+    r->count++;
+}
+
+void FrameSyncMaster::FinishFrame(FrameReports *r) {
+    if (r->count < 2) return;
+    const int64_t skew = r->max_nsec - r->min_nsec;
+    const int64_t host_skew = r->host_max_nsec - r->host_min_nsec;
+    stats_.skew_frames++;
+    stats_.sum_skew_nsec += skew;
+    if (skew > stats_.max_skew_nsec) stats_.max_skew_nsec = skew;
+    stats_.sum_host_skew_nsec += host_skew;
+    if (host_skew > stats_.max_host_skew_nsec)
+        stats_.max_host_skew_nsec = host_skew;
+}
+
+void FrameSyncMaster::Run(float fps, int lead_frames) {
+    const int64_t period = (int64_t)(1e9 / fps);
+    const int64_t start = FrameClock::Now() + lead_frames * period;
+    int64_t frame = 0;
+    int64_t next_announce = FrameClock::Now();
+    struct pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    running_ = true;
+    while (running_) {
+        const int64_t now = FrameClock::Now();
+        if (now >= next_announce) {
+            Announce(frame, start + frame * period);
+            ++frame;
+            next_announce += period;
+            continue;
+        }
+        if (poll(&pfd, 1, TimeoutMillis(next_announce - now)) > 0)
+            HandleMessages();
+    }
+}
+
+struct FrameSyncNode::QueuedFrame {
+    int64_t frame;
+    int64_t deadline;              // In our clock.
+    std::vector<uint8_t> wire;     // If pre-rendered.
+};
+
+FrameSyncNode::FrameSyncNode(MultiSPI *spi, int queue_frames)
+    : spi_(spi), queue_frames_(queue_frames),
+      pre_render_(spi->WireFormat() != 0),
+      multicast_fd_(-1), control_fd_(-1), have_master_(false),
+      simulated_offset_(0), next_clock_request_(0), clock_requests_(0),
+      have_offset_(false), render_nsec_(0), last_frame_(-1),
+      running_(false) {
+    bzero(&stats_, sizeof(stats_));
+}
+
+FrameSyncNode::~FrameSyncNode() {
+    for (size_t i = 0; i < queue_.size(); ++i) delete queue_[i];
+    for (size_t i = 0; i < free_frames_.size(); ++i) delete free_frames_[i];
+    if (multicast_fd_ >= 0) close(multicast_fd_);
+    if (control_fd_ >= 0) close(control_fd_);
+}
+
+bool FrameSyncNode::Join(const char *group, int port, const char *interface) {
+    struct ip_mreq membership;
+    bzero(&membership, sizeof(membership));
+    if (!ParseAddress(group, &membership.imr_multiaddr))
+        return false;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (interface && !ParseAddress(interface, &membership.imr_interface))
+        return false;
+
+    multicast_fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    control_fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (multicast_fd_ < 0 || control_fd_ < 0) {
+        perror("socket()");
+        return false;
+    }
+    // Other nodes might be listening on this host.
+    const int on = 1;
+    setsockopt(multicast_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr = membership.imr_multiaddr;
+    addr.sin_port = htons(port);
+    if (bind(multicast_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind()");
+        return false;
+    }
+    if (setsockopt(multicast_fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                   &membership, sizeof(membership)) < 0) {
+        perror("IP_ADD_MEMBERSHIP");
+        return false;
+    }
+    return true;
+}
+
+void FrameSyncNode::RequestClock() {
+    SendMessage(control_fd_, master_, CLOCK_REQUEST, 0, Now());
+    ++clock_requests_;
+    next_clock_request_ = Now() + (clock_requests_ < INITIAL_CLOCK_REQUESTS
+                                   ? INITIAL_CLOCK_INTERVAL_NSEC
+                                   : CLOCK_INTERVAL_NSEC);
+}
+
+void FrameSyncNode::AddClockSample(int64_t offset, int64_t round_trip) {
+    ClockSample sample = { offset, round_trip };
+    if (clock_samples_.size() >= CLOCK_SAMPLES)
+        clock_samples_.erase(clock_samples_.begin());
+    clock_samples_.push_back(sample);
+    // Samples with a short round trip had the least queuing delay, so
+    // they are the most accurate.
+    const ClockSample *best = &clock_samples_[0];
+    for (size_t i = 1; i < clock_samples_.size(); ++i) {
+        if (clock_samples_[i].round_trip_nsec < best->round_trip_nsec)
+            best = &clock_samples_[i];
+    }
+    stats_.clock_offset_nsec = best->offset_nsec;
+    stats_.round_trip_nsec = best->round_trip_nsec;
+    have_offset_ = (clock_samples_.size() >= MIN_CLOCK_SAMPLES);
+}
+
+void FrameSyncNode::HandleMessages(FrameRenderer *renderer) {
+    Message msg;
+    struct sockaddr_in from;
+    while (ReceiveMessage(control_fd_, &msg, &from)) {
+        if (msg.type != CLOCK_REPLY || !SameAddress(from, master_))
+            continue;
+        const int64_t t4 = Now();
+        const int64_t t1 = msg.time[0], t2 = msg.time[1], t3 = msg.time[2];
+        AddClockSample(((t1 - t2) + (t4 - t3)) / 2, (t4 - t1) - (t3 - t2));
+    }
+    while (ReceiveMessage(multicast_fd_, &msg, &from)) {
+        if (msg.type != ANNOUNCE) continue;
+        if (!have_master_ || !SameAddress(from, master_)) {
+            // New master; start over.
+            master_ = from;
+            have_master_ = true;
+            have_offset_ = false;
+            clock_samples_.clear();
+            clock_requests_ = 0;
+            last_frame_ = -1;
+            RequestClock();
+        }
+        if (msg.frame <= last_frame_) continue;
+        if (last_frame_ >= 0)
+            stats_.frames_missed += msg.frame - last_frame_ - 1;
+        last_frame_ = msg.frame;
+        if (!have_offset_) {
+            stats_.frames_missed++;
+            continue;
+        }
+        const int64_t deadline = msg.time[0] + stats_.clock_offset_nsec;
+        if (deadline < Now() + LATCH_MARGIN_NSEC + render_nsec_
+            || (int)queue_.size() >= queue_frames_) {
+            stats_.frames_missed++;
+            continue;
+        }
+        Enqueue(renderer, msg.frame, deadline);
+    }
+}
+
+void FrameSyncNode::Enqueue(FrameRenderer *renderer, int64_t frame,
+                            int64_t deadline) {
+    QueuedFrame *f;
+    if (free_frames_.empty()) {
+        f = new QueuedFrame();
+    } else {
+        f = free_frames_.back();
+        free_frames_.pop_back();
+    }
+    f->frame = frame;
+    f->deadline = deadline;
+    if (pre_render_) {
+        if (!renderer->RenderFrame(frame, deadline - simulated_offset_))
+            running_ = false;
+        f->wire.resize(spi_->WireFrameSize());
+        spi_->GetWireFrame(&f->wire[0]);
+    }
+    queue_.push_back(f);   // Frames are announced in order.
+}
+
+void FrameSyncNode::Present(FrameRenderer *renderer) {
+    QueuedFrame *const f = queue_.front();
+    queue_.erase(queue_.begin());
+    if (!pre_render_) {
+        const int64_t start = Now();
+        if (!renderer->RenderFrame(f->frame, f->deadline - simulated_offset_))
+            running_ = false;
+        render_nsec_ = Now() - start;
+    }
+
+    const int64_t wake_up = f->deadline - simulated_offset_;
+    struct timespec ts;
+    ts.tv_sec = wake_up / 1000000000LL;
+    ts.tv_nsec = wake_up % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+           == EINTR) {
+    }
+    const int64_t latch = Now();
+    if (pre_render_) {
+        spi_->SendWireFrame(&f->wire[0]);
+    } else {
+        spi_->SendBuffers();
+    }
+    const int64_t late = latch - f->deadline;
+    if (late > stats_.max_late_nsec) stats_.max_late_nsec = late;
+    stats_.frames_presented++;
+    SendMessage(control_fd_, master_, REPORT, f->frame,
+                latch - stats_.clock_offset_nsec, latch - simulated_offset_);
+    free_frames_.push_back(f);
+}
+
+void FrameSyncNode::Run(FrameRenderer *renderer) {
+    struct pollfd pfd[2];
+    pfd[0].fd = multicast_fd_;
+    pfd[1].fd = control_fd_;
+    pfd[0].events = pfd[1].events = POLLIN;
+    running_ = true;
+    while (running_) {
+        const int64_t now = Now();
+        if (have_master_ && now >= next_clock_request_) {
+            RequestClock();
+        }
+        int64_t wake_up = now + 100000000LL;
+        if (!queue_.empty()) {
+            const int64_t due = (queue_.front()->deadline - LATCH_MARGIN_NSEC
+                                 - render_nsec_);
+            if (now >= due) {
+                Present(renderer);
+                continue;
+            }
+            wake_up = due;
+        }
+        if (have_master_ && next_clock_request_ < wake_up)
+            wake_up = next_clock_request_;
+        if (poll(pfd, 2, TimeoutMillis(wake_up - now)) > 0)
+            HandleMessages(renderer);
+    }
+}
+}  // namespace spixels
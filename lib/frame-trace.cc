@@ -0,0 +1,130 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "frame-trace.h"
+
+#include "stats-clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace spixels {
+namespace {
+struct TraceSlot {
+    uint64_t seq;          // Index + 1 when complete; 0 while written.
+    int64_t start_nsec;
+    int64_t duration_nsec;
+    int64_t frame;
+    int32_t thread_id;
+    int32_t span;
+};
+
+TraceSlot *ring = NULL;    // Never freed: writers might still be busy.
+uint64_t ring_mask;
+uint64_t ring_next = 0;
+int64_t current_frame = -1;
+__thread int32_t thread_id = 0;
+
+const char *const kSpanNames[] = {
+    "app", "render", "encode", "deadline wait", "send", "copy",
+    "transmit", "poll",
+};
+}  // anonymous namespace
+
+int frame_trace_active = 0;
+
+bool StartFrameTrace(size_t capacity) {
+    if (ring == NULL) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        TraceSlot *slots = (TraceSlot*)calloc(size, sizeof(TraceSlot));
+        if (slots == NULL) return false;
+        ring_mask = size - 1;
+        __atomic_store_n(&ring, slots, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&frame_trace_active, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void StopFrameTrace() {
+    __atomic_store_n(&frame_trace_active, 0, __ATOMIC_RELEASE);
+}
+
+void SetFrameTraceFrame(int64_t frame) {
+    __atomic_store_n(&current_frame, frame, __ATOMIC_RELAXED);
+}
+
+void AddFrameTraceSpan(FrameTraceSpan span, int64_t start_nsec,
+                       int64_t end_nsec) {
+    TraceSlot *const slots = __atomic_load_n(&ring, __ATOMIC_ACQUIRE);
+    if (!FrameTraceActive() || slots == NULL) return;
+    if (thread_id == 0) thread_id = syscall(SYS_gettid);
+    const uint64_t index = __atomic_fetch_add(&ring_next, 1,
+                                              __ATOMIC_RELAXED);
+    TraceSlot *const slot = &slots[index & ring_mask];
+    // Readers skip the slot while it is written (see WriteFrameTrace()).
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->start_nsec = start_nsec;
+    slot->duration_nsec = end_nsec - start_nsec;
+    slot->frame = __atomic_load_n(&current_frame, __ATOMIC_RELAXED);
+    slot->thread_id = thread_id;
+    slot->span = span;
+    __atomic_store_n(&slot->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+bool WriteFrameTrace(const char *filename) {
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        perror(filename);
+        return false;
+    }
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    const TraceSlot *const slots = __atomic_load_n(&ring, __ATOMIC_ACQUIRE);
+    const uint64_t end = __atomic_load_n(&ring_next, __ATOMIC_ACQUIRE);
+    const uint64_t size = slots ? ring_mask + 1 : 0;
+    const int pid = getpid();
+    bool first = true;
+    for (uint64_t i = end > size ? end - size : 0; i < end; ++i) {
+        const TraceSlot *const slot = &slots[i & ring_mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != i + 1)
+            continue;   // Being written or already overwritten.
+        const TraceSlot copy = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != i + 1)
+            continue;
+        // Chrome wants microseconds.
+        fprintf(out, "%s{\"name\": \"%s\", \"cat\": \"spixels\", "
+                "\"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                "\"pid\": %d, \"tid\": %d",
+                first ? "" : ",\n", kSpanNames[copy.span],
+                copy.start_nsec / 1e3, copy.duration_nsec / 1e3,
+                pid, copy.thread_id);
+        if (copy.frame >= 0) {
+            fprintf(out, ", \"args\": {\"frame\": %lld}",
+                    (long long)copy.frame);
+        }
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+}
+}  // namespace spixels
@@ -142,6 +142,10 @@ static RaspberryPiModel GetPiModel() {
 }
 
 // Public interface
+uint32_t GetPLLDFrequencyHz() {
+    return GetPiModel() == PI_MODEL_4 ? 750000000 : 500000000;
+}
+
 uint32_t *mmap_bcm_register(off_t register_offset) {
     off_t base = BCM2709_PERI_BASE;  // safe fallback guess.
     switch (GetPiModel()) {
@@ -27,6 +27,10 @@ namespace ft {
 // Memory map a bcm register. Takes care of detecting the right Raspberry Pi
 uint32_t *mmap_bcm_register(off_t register_offset);
 
+// Frequency of the PLLD clock, which can be used as clock source for
+// peripherals. Depends on the Raspberry Pi model.
+uint32_t GetPLLDFrequencyHz();
+
 class GPIO {
 public:
     // Available bits that actually have pins.
@@ -0,0 +1,124 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "gpio-stream.h"
+
+#include "ft-gpio.h"
+
+namespace spixels {
+bool GPIOStream::AddOutput(int gpio) {
+    const uint32_t gpio_mask = 1 << gpio;
+    if (gpio < 0 || gpio >= 32 || (gpio_mask & ft::GPIO::kValidBits) == 0)
+        return false;
+    output_bits_ |= gpio_mask;
+    return true;
+}
+
+std::vector<uint8_t> GPIOStream::Decode(int data_gpio, int clock_gpio) const {
+    const uint32_t data_mask = 1 << data_gpio;
+    const uint32_t clock_mask = 1 << clock_gpio;
+    std::vector<uint8_t> result;
+    uint32_t state = 0;
+    uint8_t byte = 0;
+    int bits = 0;
+    for (size_t i = 0; i < ops_.size(); ++i) {
+        const uint32_t next = (state & ~ops_[i].clr) | ops_[i].set;
+        if ((next & clock_mask) && !(state & clock_mask)) {
+            byte = (byte << 1) | ((next & data_mask) ? 1 : 0);
+            if (++bits == 8) {
+                result.push_back(byte);
+                bits = 0;
+            }
+        }
+        state = next;
+    }
+    return result;
+}
+
+// Scale "value" with maximum "max" to the linear range.
+static uint16_t Scale(uint32_t value, uint32_t max) {
+    return value * 0xFFFF / max;
+}
+
+bool DecodeStripPixels(LEDStripProtocol protocol,
+                       const std::vector<uint8_t> &bytes, int count,
+                       std::vector<LinearRGB> *pixels) {
+    pixels->resize(count);
+    const uint8_t *data = bytes.empty() ? NULL : &bytes[0];
+    switch (protocol) {
+    case PROTOCOL_WS2801:
+        if (bytes.size() < 3 * (size_t)count) return false;
+        for (int i = 0; i < count; ++i, data += 3) {
+            LinearRGB &p = (*pixels)[i];
+            p.r = Scale(data[0], 0xFF);
+            p.g = Scale(data[1], 0xFF);
+            p.b = Scale(data[2], 0xFF);
+        }
+        return true;
+
+    case PROTOCOL_LPD6803:
+        // Four zero start bytes; 16 bit per pixel: start bit, 3x5 bit.
+        if (bytes.size() < 4 + 2 * (size_t)count) return false;
+        if (data[0] || data[1] || data[2] || data[3]) return false;
+        data += 4;
+        for (int i = 0; i < count; ++i, data += 2) {
+            const uint16_t value = (data[0] << 8) | data[1];
+            if (!(value & 0x8000)) return false;
+            LinearRGB &p = (*pixels)[i];
+            p.r = Scale((value >> 10) & 0x1F, 0x1F);
+            p.g = Scale((value >>  5) & 0x1F, 0x1F);
+            p.b = Scale((value >>  0) & 0x1F, 0x1F);
+        }
+        return true;
+
+    case PROTOCOL_LPD8806: {
+        // 7 bit per color with the top bit set, then zero latch bytes.
+        const size_t latch_bytes = (count + 31) / 32;
+        if (bytes.size() < 3 * (size_t)count + latch_bytes) return false;
+        for (int i = 0; i < count; ++i, data += 3) {
+            if ((data[0] & data[1] & data[2] & 0x80) == 0) return false;
+            LinearRGB &p = (*pixels)[i];
+            p.b = Scale(data[0] & 0x7F, 0x7F);
+            p.r = Scale(data[1] & 0x7F, 0x7F);
+            p.g = Scale(data[2] & 0x7F, 0x7F);
+        }
+        for (size_t i = 0; i < latch_bytes; ++i) {
+            if (data[i]) return false;
+        }
+        return true;
+    }
+
+    case PROTOCOL_APA102:
+        // Four zero start bytes; per pixel 3 bit marker, 5 bit global
+        // brightness, then blue, green, red.
+        if (bytes.size() < 4 + 4 * (size_t)count) return false;
+        if (data[0] || data[1] || data[2] || data[3]) return false;
+        data += 4;
+        for (int i = 0; i < count; ++i, data += 4) {
+            if ((data[0] & 0xE0) != 0xE0) return false;
+            const uint32_t global = data[0] & 0x1F;
+            LinearRGB &p = (*pixels)[i];
+            p.b = Scale(data[1] * global, 0xFF * 0x1F);
+            p.g = Scale(data[2] * global, 0xFF * 0x1F);
+            p.r = Scale(data[3] * global, 0xFF * 0x1F);
+        }
+        return true;
+    }
+    return false;
+}
+}  // namespace spixels
@@ -18,9 +18,16 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <typeinfo>
+#include <vector>
 
 #include "multi-spi.h"
 #include "led-strip.h"
+#include "pixel-ops.h"
+#include "stats-clock.h"
 
 typedef uint16_t CIEValue;
 
@@ -49,14 +56,32 @@ static CIEValue luminance_cie1931(uint8_t value, uint8_t bright) {
 }
 
 namespace spixels {
+struct LEDStrip::Palette {
+    RGBc color[256];
+    CIEValue linear[256][3];
+    uint8_t encoded[256][kMaxEncodedBytes];
+    uint8_t *indices;     // Palette index per pixel.
+    uint8_t *indexed;     // Bitmap of pixels last set by index.
+};
+
 LEDStrip::LEDStrip(int count)
-    : count_(count), values_(new RGBc[count]), brightness_(255) {
+    : count_(count), values_(new RGBc[count]), brightness_(255),
+      palette_(NULL) {
 }
 
-LEDStrip::~LEDStrip() { delete values_; }
+LEDStrip::~LEDStrip() {
+    if (palette_) {
+        delete [] palette_->indexed;
+        delete [] palette_->indices;
+        delete palette_;
+    }
+    delete values_;
+}
 
 void LEDStrip::SetPixel(int pos, const RGBc& c) {
     if (pos < 0 || pos >= count()) return;
+    if (palette_) palette_->indexed[pos / 8] &= ~(1 << (pos % 8));
+    encode_stats_.pixels_encoded++;
     values_[pos] = c;
     SetLinearValues(pos,
                     luminance_cie1931(c.r, brightness_),
@@ -64,37 +89,304 @@ void LEDStrip::SetPixel(int pos, const RGBc& c) {
                     luminance_cie1931(c.b, brightness_));
 }
 
+void LEDStrip::SetPixels(int pos, const RGBc *colors, int count) {
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    if (pos < 0) {
+        colors -= pos;
+        count += pos;
+        pos = 0;
+    }
+    if (pos + count > count_) count = count_ - pos;
+    if (count <= 0) return;
+    memcpy(values_ + pos, colors, count * sizeof(RGBc));
+    EncodePixels(pos, count);
+}
+
+void LEDStrip::EncodePixels(int pos, int count) {
+    encode_stats_.pixels_encoded += count;
+    if (palette_) {
+        // Pixels set from values_ are not indexed anymore.
+        for (int i = pos; i < pos + count; ++i) {
+            palette_->indexed[i / 8] &= ~(1 << (i % 8));
+        }
+    }
+    EncodeValues(pos, count);
+}
+
+void LEDStrip::EncodeValues(int pos, int count) {
+    for (int i = pos; i < pos + count; ++i) {
+        const RGBc &c = values_[i];
+        SetLinearValues(i,
+                        luminance_cie1931(c.r, brightness_),
+                        luminance_cie1931(c.g, brightness_),
+                        luminance_cie1931(c.b, brightness_));
+    }
+}
+
+void LEDStrip::Fill(const RGBc &c) {
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    encode_stats_.pixels_encoded += count_;
+    const uint16_t r = luminance_cie1931(c.r, brightness_);
+    const uint16_t g = luminance_cie1931(c.g, brightness_);
+    const uint16_t b = luminance_cie1931(c.b, brightness_);
+    if (palette_) bzero(palette_->indexed, (count_ + 7) / 8);
+    for (int i = 0; i < count_; ++i) {
+        values_[i] = c;
+    }
+    if (count_ == 0) return;
+    if (encoded_bytes() == 0) {
+        for (int i = 0; i < count_; ++i) {
+            SetLinearValues(i, r, g, b);
+        }
+        return;
+    }
+    // Encode once, then double the filled range by copying encoded bytes.
+    uint8_t bytes[kMaxEncodedBytes];
+    EncodeLinearValues(r, g, b, bytes);
+    SetEncodedPixel(0, bytes);
+    for (int done = 1; done < count_; done *= 2) {
+        const int copy = std::min(done, count_ - done);
+        if (!MoveEncodedPixels(0, done, copy)) {
+            for (int i = done; i < count_; ++i) {
+                SetEncodedPixel(i, bytes);
+            }
+            break;
+        }
+    }
+}
+
+void LEDStrip::Fade(uint8_t factor) {
+    if (factor == 255) return;
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    ScaleBytes((const uint8_t*)values_, factor, (uint8_t*)values_,
+               3 * count_);
+    EncodePixels(0, count_);
+}
+
+void LEDStrip::Shift(int n, bool rotate) {
+    if (count_ == 0) return;
+    if (rotate) {
+        n %= count_;
+    } else if (n >= count_ || n <= -count_) {
+        Fill(RGBc());
+        return;
+    }
+    if (n == 0) return;
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    if (palette_) bzero(palette_->indexed, (count_ + 7) / 8);
+    const int distance = n > 0 ? n : -n;
+    const int kept = count_ - distance;
+    const int from = n > 0 ? 0 : distance;
+    const int to = n > 0 ? distance : 0;
+    const int vacated = n > 0 ? 0 : kept;  // Start of pixels moved in.
+
+    // The pixels that wrap around, or black.
+    if (rotate) {
+        std::rotate(values_, values_ + (n > 0 ? kept : distance),
+                    values_ + count_);
+    } else {
+        memmove(values_ + to, values_ + from, kept * sizeof(RGBc));
+        std::fill(values_ + vacated, values_ + vacated + distance, RGBc());
+    }
+
+    // Moving the encoded data is cheaper than encoding it again.
+    if (!MoveEncodedPixels(from, to, kept)) {
+        EncodePixels(to, kept);
+    }
+    EncodePixels(vacated, distance);
+}
+
+void LEDStrip::Blend(const RGBc &color, uint8_t alpha) {
+    if (alpha == 0) return;
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    const uint8_t rgb[3] = { color.r, color.g, color.b };
+    BlendBytesToColor((const uint8_t*)values_, rgb, alpha + (alpha >> 7),
+                      (uint8_t*)values_, count_);
+    EncodePixels(0, count_);
+}
+
+void LEDStrip::Blend(const LEDStrip &other, uint8_t alpha) {
+    if (alpha == 0 || other.count_ < count_) return;
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    BlendBytes((const uint8_t*)values_, (const uint8_t*)other.values_,
+               alpha + (alpha >> 7), (uint8_t*)values_, 3 * count_);
+    EncodePixels(0, count_);
+}
+
 void LEDStrip::SetBrightness(uint8_t new_brightness) {
     if (new_brightness == brightness_) return;
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
     brightness_ = new_brightness;
+    if (palette_ == NULL) {
+        EncodePixels(0, count_);  // Force recalculation.
+        return;
+    }
+    for (int i = 0; i < 256; ++i) {
+        EncodePaletteEntry(i);
+    }
     for (int i = 0; i < count_; ++i) {
-        SetPixel(i, values_[i]);  // Force recalculation.
+        if (palette_->indexed[i / 8] & (1 << (i % 8))) {
+            SetIndexedPixel(i, palette_->indices[i]);
+        } else {
+            SetPixel(i, values_[i]);
+        }
+    }
+}
+
+LEDStrip::Palette *LEDStrip::palette() {
+    if (palette_ == NULL) {
+        palette_ = new Palette();
+        palette_->indices = new uint8_t[count_]();
+        palette_->indexed = new uint8_t[(count_ + 7) / 8]();
+        for (int i = 0; i < 256; ++i) {
+            EncodePaletteEntry(i);
+        }
+    }
+    return palette_;
+}
+
+void LEDStrip::EncodePaletteEntry(int index) {
+    const RGBc &c = palette_->color[index];
+    CIEValue *linear = palette_->linear[index];
+    linear[0] = luminance_cie1931(c.r, brightness_);
+    linear[1] = luminance_cie1931(c.g, brightness_);
+    linear[2] = luminance_cie1931(c.b, brightness_);
+    if (encoded_bytes() > 0) {
+        EncodeLinearValues(linear[0], linear[1], linear[2],
+                           palette_->encoded[index]);
+    }
+}
+
+void LEDStrip::SetIndexedPixel(int pos, uint8_t index) {
+    encode_stats_.pixels_encoded++;
+    values_[pos] = palette_->color[index];
+    palette_->indices[pos] = index;
+    palette_->indexed[pos / 8] |= (1 << (pos % 8));
+    if (encoded_bytes() > 0) {
+        SetEncodedPixel(pos, palette_->encoded[index]);
+    } else {
+        const CIEValue *linear = palette_->linear[index];
+        SetLinearValues(pos, linear[0], linear[1], linear[2]);
+    }
+}
+
+void LEDStrip::SetPaletteColor(uint8_t index, const RGBc &c) {
+    SetPaletteColors(index, &c, 1);
+}
+
+void LEDStrip::SetPaletteColors(uint8_t first, const RGBc *colors,
+                                int count) {
+    if (first + count > 256) count = 256 - first;
+    if (count <= 0) return;
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    Palette *const p = palette();
+    uint8_t changed[256 / 8] = {0};
+    bool any_changed = false;
+    for (int i = 0; i < count; ++i) {
+        const int index = first + i;
+        const RGBc &c = colors[i];
+        RGBc *const entry = &p->color[index];
+        if (entry->r == c.r && entry->g == c.g && entry->b == c.b) continue;
+        *entry = c;
+        EncodePaletteEntry(index);
+        changed[index / 8] |= (1 << (index % 8));
+        any_changed = true;
+    }
+    if (!any_changed) return;
+    for (int i = 0; i < count_; ++i) {
+        const uint8_t index = p->indices[i];
+        if ((changed[index / 8] & (1 << (index % 8)))
+            && (p->indexed[i / 8] & (1 << (i % 8)))) {
+            SetIndexedPixel(i, index);
+        }
+    }
+}
+
+RGBc LEDStrip::GetPaletteColor(uint8_t index) const {
+    return palette_ ? palette_->color[index] : RGBc();
+}
+
+void LEDStrip::SetPixelIndex(int pos, uint8_t index) {
+    if (pos < 0 || pos >= count_) return;
+    palette();
+    SetIndexedPixel(pos, index);
+}
+
+void LEDStrip::SetPixelIndices(int pos, const uint8_t *indices, int count) {
+    if (pos < 0) {
+        indices -= pos;
+        count += pos;
+        pos = 0;
+    }
+    if (pos + count > count_) count = count_ - pos;
+    if (count <= 0) return;
+    ScopedTiming timing(&encode_stats_.bulk, TRACE_ENCODE);
+    palette();
+    for (int i = 0; i < count; ++i) {
+        SetIndexedPixel(pos + i, indices[i]);
     }
 }
 
 namespace {
-class WS2801LedStrip : public LEDStrip {
+// Strips on a single MultiSPI data GPIO, with a fixed number of bytes per
+// pixel. Implementations only need to encode a pixel.
+class SPILedStrip : public LEDStrip {
 public:
-    WS2801LedStrip(MultiSPI *spi, int gpio, int count)
-        : LEDStrip(count), spi_(spi), gpio_(gpio) {
-        spi_->RegisterDataGPIO(gpio, count * 3);
+    virtual void SetLinearValues(int pos, uint16_t r, uint16_t g, uint16_t b) {
+        uint8_t bytes[kMaxEncodedBytes];
+        EncodeLinearValues(r, g, b, bytes);
+        SetEncodedPixel(pos, bytes);
     }
 
-    virtual void SetLinearValues(int pos, uint16_t r, uint16_t g, uint16_t b) {
-        spi_->SetBufferedByte(gpio_, 3 * pos + 0, r >> 8);
-        spi_->SetBufferedByte(gpio_, 3 * pos + 1, g >> 8);
-        spi_->SetBufferedByte(gpio_, 3 * pos + 2, b >> 8);
+protected:
+    // "first_byte" is the position of the first pixel in the stream.
+    SPILedStrip(MultiSPI *spi, int gpio, int count,
+                int bytes_per_pixel, int first_byte)
+        : LEDStrip(count), spi_(spi), gpio_(gpio),
+          bytes_per_pixel_(bytes_per_pixel), first_byte_(first_byte) {
+    }
+
+    virtual int encoded_bytes() const { return bytes_per_pixel_; }
+
+    virtual void SetEncodedPixel(int pos, const uint8_t *bytes) {
+        const size_t base = first_byte_ + bytes_per_pixel_ * pos;
+        for (int i = 0; i < bytes_per_pixel_; ++i) {
+            spi_->SetBufferedByte(gpio_, base + i, bytes[i]);
+        }
+    }
+
+    virtual bool MoveEncodedPixels(int from, int to, int count) {
+        return spi_->MoveBufferedBytes(gpio_,
+                                       first_byte_ + bytes_per_pixel_ * from,
+                                       first_byte_ + bytes_per_pixel_ * to,
+                                       bytes_per_pixel_ * count);
     }
 
-private:
     MultiSPI *const spi_;
     const int gpio_;
+    const int bytes_per_pixel_;
+    const int first_byte_;
+};
+
+class WS2801LedStrip : public SPILedStrip {
+public:
+    WS2801LedStrip(MultiSPI *spi, int gpio, int count)
+        : SPILedStrip(spi, gpio, count, 3, 0) {
+        spi_->RegisterDataGPIO(gpio, count * 3);
+    }
+
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {
+        bytes[0] = r >> 8;
+        bytes[1] = g >> 8;
+        bytes[2] = b >> 8;
+    }
 };
 
-class LPD6803LedStrip : public LEDStrip {
+class LPD6803LedStrip : public SPILedStrip {
 public:
     LPD6803LedStrip(MultiSPI *spi, int gpio, int count)
-        : LEDStrip(count), spi_(spi), gpio_(gpio) {
+        : SPILedStrip(spi, gpio, count, 2, 4) {
         const size_t bytes_needed = 4 + 2 * count + 4;
         spi_->RegisterDataGPIO(gpio, bytes_needed);
 
@@ -108,26 +400,23 @@ public:
         }
     }
 
-    virtual void SetLinearValues(int pos, uint16_t r, uint16_t g, uint16_t b) {
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {
         uint16_t data = 0;
         data |= (1<<15);  // start bit
         data |= (r >> 11) << 10;
         data |= (g >> 11) <<  5;
         data |= (b >> 11) <<  0;
 
-        spi_->SetBufferedByte(gpio_, 2 * pos + 4 + 0, data >> 8);
-        spi_->SetBufferedByte(gpio_, 2 * pos + 4 + 1, data & 0xFF);
+        bytes[0] = data >> 8;
+        bytes[1] = data & 0xFF;
     }
-
-private:
-    MultiSPI *const spi_;
-    const int gpio_;
 };
 
-class LPD8806LedStrip : public LEDStrip {
+class LPD8806LedStrip : public SPILedStrip {
 public:
     LPD8806LedStrip(MultiSPI *spi, int gpio, int count)
-        : LEDStrip(count), spi_(spi), gpio_(gpio) {
+        : SPILedStrip(spi, gpio, count, 3, 0) {
         const size_t data_bytes = 3 * count;
         const size_t latch_bytes = (count+31)/32;
         const size_t bytes_needed = data_bytes + latch_bytes;
@@ -142,22 +431,19 @@ public:
         }
     }
 
-    virtual void SetLinearValues(int pos, uint16_t r, uint16_t g, uint16_t b) {
-        spi_->SetBufferedByte(gpio_, 3 * pos + 0, (b >> 9) | 0x80);
-        spi_->SetBufferedByte(gpio_, 3 * pos + 1, (r >> 9) | 0x80);
-        spi_->SetBufferedByte(gpio_, 3 * pos + 2, (g >> 9) | 0x80);
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {
+        bytes[0] = (b >> 9) | 0x80;
+        bytes[1] = (r >> 9) | 0x80;
+        bytes[2] = (g >> 9) | 0x80;
     }
-
-private:
-    MultiSPI *const spi_;
-    const int gpio_;
 };
 
 
-class APA102LedStrip : public LEDStrip {
+class APA102LedStrip : public SPILedStrip {
 public:
     APA102LedStrip(MultiSPI *spi, int gpio, int count)
-        : LEDStrip(count), spi_(spi), gpio_(gpio) {
+        : SPILedStrip(spi, gpio, count, 4, 4) {
         const size_t startframe_size = 4;
         const size_t endframe_size = (count+15) / 16;
         const size_t bytes_needed = startframe_size + 4*count + endframe_size;
@@ -181,40 +467,206 @@ public:
         }
     }
 
-    virtual void SetLinearValues(int pos, uint16_t r, uint16_t g, uint16_t b) {
-        const int base = 4 + 4 * pos;
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {
         r >>= 4; g >>= 4; b >>= 4;
 
         // If value is dim, use the APA global brightness adjustment for
         // more resolution. We essentially get 4 bits at the bottom end.
         const uint16_t bit_use = r | g | b;  // find highest bit used.
         if (bit_use < 16) {
-            spi_->SetBufferedByte(gpio_, base + 0, 0xE0 | 0x01);
+            bytes[0] = 0xE0 | 0x01;
         } else if (bit_use < 32) {
-            spi_->SetBufferedByte(gpio_, base + 0, 0xE0 | 0x03);
+            bytes[0] = 0xE0 | 0x03;
             r >>= 1; g >>= 1; b >>= 1;
         } else if (bit_use < 64) {
-            spi_->SetBufferedByte(gpio_, base + 0, 0xE0 | 0x07);
+            bytes[0] = 0xE0 | 0x07;
             r >>= 2; g >>= 2; b >>= 2;
         } else if (bit_use < 128) {
-            spi_->SetBufferedByte(gpio_, base + 0, 0xE0 | 0x0F);
+            bytes[0] = 0xE0 | 0x0F;
             r >>= 3; g >>= 3; b >>= 3;
         } else {
-            spi_->SetBufferedByte(gpio_, base + 0, 0xE0 | 0x1F);
+            bytes[0] = 0xE0 | 0x1F;
             r >>= 4; g >>= 4; b >>= 4;
         }
 
-        spi_->SetBufferedByte(gpio_, base + 1, b);
-        spi_->SetBufferedByte(gpio_, base + 2, g);
-        spi_->SetBufferedByte(gpio_, base + 3, r);
+        bytes[1] = b;
+        bytes[2] = g;
+        bytes[3] = r;
     }
+};
 
-private:
-    MultiSPI *const spi_;
-    const int gpio_;
+class WS2812LedStrip : public SPILedStrip {
+public:
+    WS2812LedStrip(MultiSPI *spi, int gpio, int count)
+        : SPILedStrip(spi, gpio, count, 3, 0) {
+        spi_->RegisterDataGPIO(gpio, count * 3);
+        for (int i = 0; i < count; ++i) {
+            SetPixel(i, 0x000000);
+        }
+    }
+
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {
+        bytes[0] = g >> 8;
+        bytes[1] = r >> 8;
+        bytes[2] = b >> 8;
+    }
+};
+
+class SK6812RGBWLedStrip : public SPILedStrip {
+public:
+    SK6812RGBWLedStrip(MultiSPI *spi, int gpio, int count)
+        : SPILedStrip(spi, gpio, count, 4, 0) {
+        spi_->RegisterDataGPIO(gpio, count * 4);
+        for (int i = 0; i < count; ++i) {
+            SetPixel(i, 0x000000);
+        }
+    }
+
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {
+        // The part all colors have in common is shown with the white LED.
+        uint16_t w = r < g ? r : g;
+        if (b < w) w = b;
+        bytes[0] = (g - w) >> 8;
+        bytes[1] = (r - w) >> 8;
+        bytes[2] = (b - w) >> 8;
+        bytes[3] = w >> 8;
+    }
 };
+
 }  // anonymous namespace
 
+// Not in the anonymous namespace: it is a friend of LEDStrip, to call the
+// protected encoding functions of its segments.
+class SegmentedLedStrip : public LEDStrip {
+public:
+    SegmentedLedStrip(const StripSegment *segments, int count)
+        : LEDStrip(TotalCount(segments, count)), uniform_encoding_(count > 0),
+          last_segment_(0) {
+        int offset = 0;
+        size_t longest = 0;
+        for (int i = 0; i < count; ++i) {
+            Segment s;
+            s.strip = segments[i].strip;
+            s.reversed = segments[i].reversed;
+            s.start = offset;
+            s.end = offset + s.strip->count();
+            segments_.push_back(s);
+            offset = s.end;
+            if ((size_t)s.strip->count() > longest) longest = s.strip->count();
+            // Encoded pixels can only be used if all segments encode alike.
+            uniform_encoding_ = (uniform_encoding_
+                                 && s.strip->encoded_bytes() > 0
+                                 && typeid(*s.strip)
+                                    == typeid(*segments[0].strip));
+        }
+        reversed_.resize(longest);
+    }
+
+    virtual ~SegmentedLedStrip() {
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            delete segments_[i].strip;
+        }
+    }
+
+    virtual void SetLinearValues(int pos, uint16_t r, uint16_t g, uint16_t b) {
+        const Segment *s = FindSegment(pos);
+        if (s == NULL) return;
+        s->strip->SetLinearValues(s->Local(pos), r, g, b);
+    }
+
+protected:
+    virtual int encoded_bytes() const {
+        return uniform_encoding_ ? segments_[0].strip->encoded_bytes() : 0;
+    }
+
+    virtual void EncodeLinearValues(uint16_t r, uint16_t g, uint16_t b,
+                                    uint8_t *bytes) const {
+        segments_[0].strip->EncodeLinearValues(r, g, b, bytes);
+    }
+
+    virtual void SetEncodedPixel(int pos, const uint8_t *bytes) {
+        const Segment *s = FindSegment(pos);
+        if (s == NULL) return;
+        s->strip->SetEncodedPixel(s->Local(pos), bytes);
+    }
+
+    // Only within a segment: the others are sent on different GPIOs.
+    virtual bool MoveEncodedPixels(int from, int to, int count) {
+        const Segment *s = FindSegment(from);
+        if (s == NULL || from + count > s->end
+            || to < s->start || to + count > s->end)
+            return false;
+        if (s->reversed) {
+            return s->strip->MoveEncodedPixels(s->end - from - count,
+                                               s->end - to - count, count);
+        }
+        return s->strip->MoveEncodedPixels(from - s->start, to - s->start,
+                                           count);
+    }
+
+    // Hand the part of each segment to its strip in one go.
+    virtual void EncodeValues(int pos, int count) {
+        const int end = pos + count;
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            const Segment &s = segments_[i];
+            const int from = std::max(pos, s.start);
+            const int to = std::min(end, s.end);
+            if (from >= to) continue;
+            s.strip->brightness_ = brightness_;   // Applied by the segment.
+            if (!s.reversed) {
+                s.strip->SetPixels(from - s.start, values_ + from, to - from);
+                continue;
+            }
+            for (int k = 0; k < to - from; ++k) {
+                reversed_[k] = values_[to - 1 - k];
+            }
+            s.strip->SetPixels(s.end - to, &reversed_[0], to - from);
+        }
+    }
+
+private:
+    struct Segment {
+        LEDStrip *strip;
+        bool reversed;
+        int start;
+        int end;
+
+        // Position in the segment strip.
+        int Local(int pos) const {
+            return reversed ? end - 1 - pos : pos - start;
+        }
+    };
+
+    static int TotalCount(const StripSegment *segments, int count) {
+        int result = 0;
+        for (int i = 0; i < count; ++i) result += segments[i].strip->count();
+        return result;
+    }
+
+    const Segment *FindSegment(int pos) {
+        // Consecutive updates are typically in the same segment as before.
+        if (!segments_.empty()) {
+            const Segment &last = segments_[last_segment_];
+            if (pos >= last.start && pos < last.end) return &last;
+        }
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            if (pos >= segments_[i].start && pos < segments_[i].end) {
+                last_segment_ = i;
+                return &segments_[i];
+            }
+        }
+        return NULL;
+    }
+
+    std::vector<Segment> segments_;
+    bool uniform_encoding_;
+    std::vector<RGBc> reversed_;   // Scratch for reversed segments.
+    size_t last_segment_;
+};
+
 // Public interface
 LEDStrip *CreateWS2801Strip(MultiSPI *spi, int connector, int count) {
     return new WS2801LedStrip(spi, connector, count);
@@ -228,4 +680,13 @@ LEDStrip *CreateLPD8806Strip(MultiSPI *spi, int connector, int count) {
 LEDStrip *CreateAPA102Strip(MultiSPI *spi, int connector, int count) {
     return new APA102LedStrip(spi, connector, count);
 }
+LEDStrip *CreateSegmentedStrip(const StripSegment *segments, int count) {
+    return new SegmentedLedStrip(segments, count);
+}
+LEDStrip *CreateWS2812Strip(MultiSPI *spi, int connector, int count) {
+    return new WS2812LedStrip(spi, connector, count);
+}
+LEDStrip *CreateSK6812RGBWStrip(MultiSPI *spi, int connector, int count) {
+    return new SK6812RGBWLedStrip(spi, connector, count);
+}
 }  // spixels namespace
@@ -0,0 +1,76 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "multi-spi.h"
+
+#include "ft-gpio.h"
+
+#include <stdio.h>
+
+namespace spixels {
+/*static*/ const MultiSPI::PinMap MultiSPI::kAdapter16PinMap = {
+    16,
+    { SPI_P1, SPI_P2, SPI_P3,  SPI_P4,  SPI_P5,  SPI_P6,  SPI_P7,  SPI_P8,
+      SPI_P9, SPI_P10, SPI_P11, SPI_P12, SPI_P13, SPI_P14, SPI_P15, SPI_P16 }
+};
+
+/*static*/ const MultiSPI::PinMap MultiSPI::kAllPinsPinMap = {
+    25,
+    { SPI_P1, SPI_P2, SPI_P3,  SPI_P4,  SPI_P5,  SPI_P6,  SPI_P7,  SPI_P8,
+      SPI_P9, SPI_P10, SPI_P11, SPI_P12, SPI_P13, SPI_P14, SPI_P15, SPI_P16,
+      2, 3, 7, 8, 9, 10, 11, 14, 15 }
+};
+
+static MultiSPI::PinMap current_pin_map = MultiSPI::kAdapter16PinMap;
+
+/*static*/ bool MultiSPI::SetPinMap(const PinMap &pin_map) {
+    if (pin_map.connectors < 0 || pin_map.connectors > MAX_CONNECTORS)
+        return false;
+    uint32_t used = 0;
+    for (int i = 0; i < pin_map.connectors; ++i) {
+        const int gpio = pin_map.data_gpio[i];
+        if (gpio < 0 || gpio >= 32
+            || (ft::GPIO::kValidBits & (1 << gpio)) == 0) {
+            fprintf(stderr, "Connector %d: GPIO %d not available.\n",
+                    i + 1, gpio);
+            return false;
+        }
+        if (gpio == SPI_CLOCK || (used & (1 << gpio))) {
+            fprintf(stderr, "Connector %d: GPIO %d already in use.\n",
+                    i + 1, gpio);
+            return false;
+        }
+        used |= (1 << gpio);
+    }
+    current_pin_map = pin_map;
+    return true;
+}
+
+/*static*/ const MultiSPI::PinMap &MultiSPI::GetPinMap() {
+    return current_pin_map;
+}
+
+/*static*/ int MultiSPI::ConnectorCount() {
+    return current_pin_map.connectors;
+}
+
+/*static*/ int MultiSPI::SPIPinForConnector(int connector) {
+    if (connector < 1 || connector > current_pin_map.connectors)
+        return -1;
+    return current_pin_map.data_gpio[connector - 1];
+}
+}  // namespace spixels
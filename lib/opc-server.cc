@@ -0,0 +1,266 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "opc-server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define OPC_HEADER_SIZE 4
+#define OPC_MAX_MESSAGE (OPC_HEADER_SIZE + 65535)
+
+#define OPC_SET_PIXELS 0
+#define OPC_SYSEX      255
+
+#define SPIXELS_SYSTEM_ID 0x7370
+#define SPIXELS_DELTA     0x01
+
+#define DELTA_RUN_FLAG 0x8000
+
+#define MAX_EVENTS 16
+
+namespace spixels {
+static uint16_t ReadBE16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+OPCServer::OPCServer(MultiSPI *spi)
+    : spi_(spi), listen_fd_(-1), epoll_fd_(-1), changed_(false),
+      running_(false) {
+    bzero(&stats_, sizeof(stats_));
+}
+
+OPCServer::~OPCServer() {
+    while (!clients_.empty()) {
+        CloseClient(clients_.back());
+    }
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (listen_fd_ >= 0) close(listen_fd_);
+}
+
+void OPCServer::MapChannel(int channel, LEDStrip *strip, int first_pixel) {
+    Mapping m = { channel, strip, first_pixel };
+    mappings_.push_back(m);
+}
+
+void OPCServer::MapStrips(LEDStrip *const *strips, int count) {
+    for (int i = 0; i < count; ++i) {
+        MapChannel(i + 1, strips[i]);
+    }
+}
+
+bool OPCServer::Listen(int port) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_fd_ < 0) {
+        perror("socket()");
+        return false;
+    }
+    int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0
+        || listen(listen_fd_, 16) < 0) {
+        return ListenFailed("bind()/listen()");
+    }
+    epoll_fd_ = epoll_create1(0);
+    if (epoll_fd_ < 0) return ListenFailed("epoll_create1()");
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;   // NULL: the listen socket.
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0)
+        return ListenFailed("epoll_ctl()");
+    return true;
+}
+
+bool OPCServer::ListenFailed(const char *what) {
+    perror(what);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (listen_fd_ >= 0) close(listen_fd_);
+    epoll_fd_ = listen_fd_ = -1;
+    return false;
+}
+
+void OPCServer::Accept() {
+    int fd;
+    while ((fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        Client *client = new Client();
+        client->fd = fd;
+        client->buffer.resize(OPC_MAX_MESSAGE);
+        client->fill = 0;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = client;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl()");
+            close(fd);
+            delete client;
+            continue;
+        }
+        clients_.push_back(client);
+        stats_.connections++;
+    }
+}
+
+void OPCServer::CloseClient(Client *client) {
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        if (clients_[i] == client) {
+            clients_[i] = clients_.back();
+            clients_.pop_back();
+            break;
+        }
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    delete client;
+}
+
+bool OPCServer::ReadClient(Client *client) {
+    // Only one read per event: epoll reports the client again if there is
+    // more, and a busy client does not hold up the others or the output.
+    uint8_t *const buffer = &client->buffer[0];
+    const ssize_t r = read(client->fd, buffer + client->fill,
+                           client->buffer.size() - client->fill);
+    if (r == 0) return false;
+    if (r < 0) return (errno == EAGAIN || errno == EINTR);
+    stats_.bytes += r;
+    client->fill += r;
+    // Pixels are applied directly from the receive buffer. Only the
+    // incomplete message at the end needs to be moved to the front.
+    const size_t consumed = HandleMessages(buffer, client->fill);
+    if (consumed > 0) {
+        memmove(buffer, buffer + consumed, client->fill - consumed);
+        client->fill -= consumed;
+    }
+    return true;
+}
+
+size_t OPCServer::HandleMessages(const uint8_t *data, size_t len) {
+    size_t pos = 0;
+    while (len - pos >= OPC_HEADER_SIZE) {
+        const uint8_t *msg = data + pos;
+        const size_t payload = ReadBE16(msg + 2);
+        if (len - pos < OPC_HEADER_SIZE + payload)
+            break;
+        const int channel = msg[0];
+        const uint8_t *body = msg + OPC_HEADER_SIZE;
+        switch (msg[1]) {
+        case OPC_SET_PIXELS:
+            // RGBc has the same layout as the OPC pixel data.
+            SetPixels(channel, 0, (const RGBc*)body, payload / 3);
+            stats_.messages++;
+            break;
+        case OPC_SYSEX:
+            if (payload >= 3 && ReadBE16(body) == SPIXELS_SYSTEM_ID
+                && body[2] == SPIXELS_DELTA) {
+                HandleDelta(channel, body + 3, payload - 3);
+                stats_.messages++;
+            }
+            break;
+        }
+        pos += OPC_HEADER_SIZE + payload;
+    }
+    return pos;
+}
+
+void OPCServer::HandleDelta(int channel, const uint8_t *data, size_t len) {
+    while (len >= 4) {
+        const int offset = ReadBE16(data);
+        const int count = ReadBE16(data + 2);
+        data += 4; len -= 4;
+        if (count & DELTA_RUN_FLAG) {
+            if (len < 3) return;
+            FillPixels(channel, offset, *(const RGBc*)data,
+                       count & ~DELTA_RUN_FLAG);
+            data += 3; len -= 3;
+        } else {
+            if (len < 3 * (size_t)count) return;
+            SetPixels(channel, offset, (const RGBc*)data, count);
+            data += 3 * count; len -= 3 * count;
+        }
+    }
+}
+
+void OPCServer::SetPixels(int channel, int pos, const RGBc *colors,
+                          int count) {
+    for (size_t i = 0; i < mappings_.size(); ++i) {
+        const Mapping &m = mappings_[i];
+        if (channel != 0 && m.channel != channel) continue;
+        // LEDStrip::SetPixels() clips to the strip.
+        const int start = pos - m.first_pixel;
+        m.strip->SetPixels(start, colors, count);
+    }
+    changed_ = true;
+}
+
+void OPCServer::FillPixels(int channel, int pos, const RGBc &color,
+                           int count) {
+    for (size_t i = 0; i < mappings_.size(); ++i) {
+        const Mapping &m = mappings_[i];
+        if (channel != 0 && m.channel != channel) continue;
+        int from = pos - m.first_pixel;
+        int to = from + count;
+        if (from < 0) from = 0;
+        if (to > m.strip->count()) to = m.strip->count();
+        if (from == 0 && to == m.strip->count()) {
+            m.strip->Fill(color);
+            continue;
+        }
+        for (int p = from; p < to; ++p) {
+            m.strip->SetPixel(p, color);
+        }
+    }
+    changed_ = true;
+}
+
+void OPCServer::ProcessEvents(int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    const int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout_ms);
+    for (int i = 0; i < n; ++i) {
+        Client *const client = (Client*) events[i].data.ptr;
+        if (client == NULL) {
+            Accept();
+        } else if (!ReadClient(client)) {
+            CloseClient(client);
+        }
+    }
+    // Everything that arrived is shown at once.
+    if (changed_) {
+        spi_->SendBuffers();
+        stats_.frames++;
+        changed_ = false;
+    }
+}
+
+void OPCServer::Run() {
+    running_ = true;
+    while (running_) {
+        ProcessEvents(100);
+    }
+}
+}  // namespace spixels
@@ -0,0 +1,135 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pixel-ops.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define SPIXELS_NEON
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#  define SPIXELS_SSE2
+#endif
+
+namespace spixels {
+// x / 255, rounded; exact for x in [0 .. 255*255]. All SIMD variants
+// below use the same formula, so results don't depend on the platform.
+static inline uint8_t Div255(uint16_t x) {
+    const uint16_t t = x + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+void BlendBytes(const uint8_t *from, const uint8_t *to, int alpha,
+                uint8_t *out, int bytes) {
+    // Weights add up to 256, so the sum fits in 16 bit; this allows the
+    // vector units to process as many bytes as possible at once.
+    const uint16_t to_weight = alpha;
+    const uint16_t from_weight = 256 - alpha;
+    for (int i = 0; i < bytes; ++i) {
+        out[i] = (uint16_t)(from[i] * from_weight + to[i] * to_weight) >> 8;
+    }
+}
+
+void BlendBytesToColor(const uint8_t *from, const uint8_t rgb[3], int alpha,
+                       uint8_t *out, int pixels) {
+    const uint16_t from_weight = 256 - alpha;
+    const uint16_t to[3] = { (uint16_t)(rgb[0] * alpha),
+                             (uint16_t)(rgb[1] * alpha),
+                             (uint16_t)(rgb[2] * alpha) };
+    for (int i = 0; i < 3 * pixels; i += 3) {
+        out[i + 0] = (uint16_t)(from[i + 0] * from_weight + to[0]) >> 8;
+        out[i + 1] = (uint16_t)(from[i + 1] * from_weight + to[1]) >> 8;
+        out[i + 2] = (uint16_t)(from[i + 2] * from_weight + to[2]) >> 8;
+    }
+}
+
+void ScaleBytes(const uint8_t *in, uint8_t factor, uint8_t *out, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out[i] = Div255(in[i] * factor);
+    }
+}
+
+void MixBytesWeighted(const uint8_t *below, const uint8_t *top,
+                      const uint8_t *weights, uint8_t opacity,
+                      uint8_t *out, int bytes) {
+    int i = 0;
+#if defined(SPIXELS_NEON)
+    const uint8x8_t op = vdup_n_u8(opacity);
+    const uint8x8_t full = vdup_n_u8(255);
+    for (/**/; i + 8 <= bytes; i += 8) {
+        const uint16x8_t wx = vmull_u8(vld1_u8(weights + i), op);
+        const uint8x8_t w = vraddhn_u16(wx, vrshrq_n_u16(wx, 8));  // /255
+        uint16x8_t x = vmull_u8(vld1_u8(below + i), vsub_u8(full, w));
+        x = vmlal_u8(x, vld1_u8(top + i), w);
+        vst1_u8(out + i, vraddhn_u16(x, vrshrq_n_u16(x, 8)));
+    }
+#elif defined(SPIXELS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i op = _mm_set1_epi16(opacity);
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+    for (/**/; i + 8 <= bytes; i += 8) {
+        const __m128i b = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i*)(below + i)), zero);
+        const __m128i t = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i*)(top + i)), zero);
+        __m128i w = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i*)(weights + i)), zero);
+        w = _mm_add_epi16(_mm_mullo_epi16(w, op), half);
+        w = _mm_srli_epi16(_mm_add_epi16(w, _mm_srli_epi16(w, 8)), 8);
+        __m128i x = _mm_add_epi16(_mm_mullo_epi16(b, _mm_sub_epi16(full, w)),
+                                  _mm_mullo_epi16(t, w));
+        x = _mm_add_epi16(x, half);
+        x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+        _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(x, zero));
+    }
+#endif
+    for (/**/; i < bytes; ++i) {
+        const uint8_t w = Div255(weights[i] * opacity);
+        out[i] = Div255(below[i] * (255 - w) + top[i] * w);
+    }
+}
+
+void AddBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+              int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        const uint16_t sum = below[i] + top[i];
+        out[i] = sum > 255 ? 255 : sum;
+    }
+}
+
+void MultiplyBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+                   int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out[i] = Div255(below[i] * top[i]);
+    }
+}
+
+void ScreenBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+                 int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out[i] = 255 - Div255((255 - below[i]) * (255 - top[i]));
+    }
+}
+
+void LightenBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+                  int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out[i] = below[i] > top[i] ? below[i] : top[i];
+    }
+}
+}  // namespace spixels
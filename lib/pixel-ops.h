@@ -0,0 +1,61 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_PIXEL_OPS_H
+#define SPIXELS_PIXEL_OPS_H
+
+#include <stdint.h>
+
+namespace spixels {
+// Kernels working on arrays of pixels. RGBc is three bytes without padding,
+// so an array of pixels is just an array of 3*count bytes, and the kernels
+// treat it as such: the loops are simple enough for the compiler to
+// vectorize them (NEON on the Pi, SSE on x86).
+
+// Linear blend between "from" and "to" for "bytes" bytes:
+// out = from + (to - from) * alpha / 256. "alpha" is in the range [0..256].
+// "out" may be the same as "from" or "to".
+void BlendBytes(const uint8_t *from, const uint8_t *to, int alpha,
+                uint8_t *out, int bytes);
+
+// Like BlendBytes(), towards the same "rgb" color for all "pixels" RGB
+// pixels. "out" may be the same as "from".
+void BlendBytesToColor(const uint8_t *from, const uint8_t rgb[3], int alpha,
+                       uint8_t *out, int pixels);
+
+// out = in * factor / 255, rounded.
+void ScaleBytes(const uint8_t *in, uint8_t factor, uint8_t *out, int bytes);
+
+// Per byte: out = (below * (255 - w) + top * w) / 255 with the weight
+// w = weights[i] * opacity / 255. Uses NEON or SSE2 if available.
+// "out" may be the same as "below" or "top".
+void MixBytesWeighted(const uint8_t *below, const uint8_t *top,
+                      const uint8_t *weights, uint8_t opacity,
+                      uint8_t *out, int bytes);
+
+// Combine "below" and "top" per byte; result in "out".
+void AddBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+              int bytes);                                     // saturating
+void MultiplyBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+                   int bytes);
+void ScreenBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+                 int bytes);
+void LightenBytes(const uint8_t *below, const uint8_t *top, uint8_t *out,
+                  int bytes);                                 // max()
+}  // namespace spixels
+
+#endif  // SPIXELS_PIXEL_OPS_H
@@ -0,0 +1,182 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "position-mapper.h"
+
+#include <math.h>
+#include <stdio.h>
+
+namespace spixels {
+PositionMapper::PositionMapper(Projection projection, int threads)
+    : projection_(projection), width_(0), image_(NULL), stride_(0),
+      threads_(threads < 1 ? 1 : threads), exit_(false) {
+    if (threads_ == 1) return;
+    pthread_barrier_init(&start_, NULL, threads_);
+    pthread_barrier_init(&done_, NULL, threads_);
+    workers_.resize(threads_ - 1);  // The calling thread does one part.
+    for (int i = 0; i < threads_ - 1; ++i) {
+        workers_[i].mapper = this;
+        workers_[i].index = i + 1;
+        pthread_create(&workers_[i].thread, NULL, &WorkerMain, &workers_[i]);
+    }
+}
+
+PositionMapper::~PositionMapper() {
+    if (threads_ == 1) return;
+    exit_ = true;
+    pthread_barrier_wait(&start_);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        pthread_join(workers_[i].thread, NULL);
+    }
+    pthread_barrier_destroy(&done_);
+    pthread_barrier_destroy(&start_);
+}
+
+void PositionMapper::AddStrip(LEDStrip *strip, const Point *positions,
+                              int count) {
+    if (count > strip->count()) count = strip->count();
+    StripPositions s;
+    s.strip = strip;
+    s.first = positions_.size();
+    s.count = count;
+    strips_.push_back(s);
+    positions_.insert(positions_.end(), positions, positions + count);
+}
+
+bool PositionMapper::AddStripFromFile(LEDStrip *strip, const char *filename) {
+    FILE *in = fopen(filename, "r");
+    if (in == NULL) {
+        perror(filename);
+        return false;
+    }
+    std::vector<Point> positions;
+    char line[256];
+    while (fgets(line, sizeof(line), in)) {
+        Point p = { 0, 0, 0 };
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%f %f %f", &p.x, &p.y, &p.z) < 2) continue;
+        positions.push_back(p);
+    }
+    fclose(in);
+    if (!positions.empty()) AddStrip(strip, &positions[0], positions.size());
+    return true;
+}
+
+void PositionMapper::Prepare(int source_width, int source_height) {
+    width_ = source_width;
+    const int n = positions_.size();
+
+    // Projected coordinates.
+    std::vector<float> u(n), v(n);
+    for (int i = 0; i < n; ++i) {
+        const Point &p = positions_[i];
+        switch (projection_) {
+        case PROJECT_XY: case PROJECT_XY_FLIP: u[i] = p.x; v[i] = p.y; break;
+        case PROJECT_XZ: case PROJECT_XZ_FLIP: u[i] = p.x; v[i] = p.z; break;
+        case PROJECT_ZY: case PROJECT_ZY_FLIP: u[i] = p.z; v[i] = p.y; break;
+        }
+        if (projection_ == PROJECT_XY_FLIP || projection_ == PROJECT_XZ_FLIP
+            || projection_ == PROJECT_ZY_FLIP) {
+            v[i] = -v[i];
+        }
+    }
+    float min_u = 0, max_u = 0, min_v = 0, max_v = 0;
+    for (int i = 0; i < n; ++i) {
+        if (i == 0 || u[i] < min_u) min_u = u[i];
+        if (i == 0 || u[i] > max_u) max_u = u[i];
+        if (i == 0 || v[i] < min_v) min_v = v[i];
+        if (i == 0 || v[i] > max_v) max_v = v[i];
+    }
+    const float scale_u = (max_u > min_u) ? (source_width - 1) / (max_u - min_u)
+                                          : 0;
+    const float scale_v = (max_v > min_v) ? (source_height - 1) / (max_v - min_v)
+                                          : 0;
+
+    samples_.resize(n);
+    colors_.resize(n);
+    for (int i = 0; i < n; ++i) {
+        const float px = (u[i] - min_u) * scale_u;
+        const float py = (v[i] - min_v) * scale_v;
+        int x0 = (int) floorf(px), y0 = (int) floorf(py);
+        if (x0 > source_width - 2) x0 = source_width - 2;
+        if (y0 > source_height - 2) y0 = source_height - 2;
+        if (x0 < 0) x0 = 0;
+        if (y0 < 0) y0 = 0;
+        const int fx = lrintf((px - x0) * 16);   // 4 bit fractions.
+        const int fy = lrintf((py - y0) * 16);
+        Sample &s = samples_[i];
+        s.col[0] = x0;
+        s.col[1] = (source_width > 1) ? x0 + 1 : x0;
+        s.row[0] = y0;
+        s.row[1] = (source_height > 1) ? y0 + 1 : y0;
+        s.weight[1] = fx * (16 - fy);
+        s.weight[2] = (16 - fx) * fy;
+        s.weight[3] = fx * fy;
+        // Exactly 256 together.
+        s.weight[0] = 256 - s.weight[1] - s.weight[2] - s.weight[3];
+    }
+}
+
+void PositionMapper::Gather(int part) {
+    const int n = samples_.size();
+    const int from = (int64_t)n * part / threads_;
+    const int to = (int64_t)n * (part + 1) / threads_;
+    const RGBc *const image = image_;
+    const int stride = stride_;
+    for (int i = from; i < to; ++i) {
+        const Sample &s = samples_[i];
+        const RGBc *row0 = image + s.row[0] * stride;
+        const RGBc *row1 = image + s.row[1] * stride;
+        const RGBc &p0 = row0[s.col[0]], &p1 = row0[s.col[1]];
+        const RGBc &p2 = row1[s.col[0]], &p3 = row1[s.col[1]];
+        const uint16_t w0 = s.weight[0], w1 = s.weight[1];
+        const uint16_t w2 = s.weight[2], w3 = s.weight[3];
+        RGBc &out = colors_[i];
+        out.r = (p0.r * w0 + p1.r * w1 + p2.r * w2 + p3.r * w3) >> 8;
+        out.g = (p0.g * w0 + p1.g * w1 + p2.g * w2 + p3.g * w3) >> 8;
+        out.b = (p0.b * w0 + p1.b * w1 + p2.b * w2 + p3.b * w3) >> 8;
+    }
+}
+
+void *PositionMapper::WorkerMain(void *arg) {
+    Worker *const worker = (Worker*) arg;
+    PositionMapper *const mapper = worker->mapper;
+    for (;;) {
+        pthread_barrier_wait(&mapper->start_);
+        if (mapper->exit_) break;
+        mapper->Gather(worker->index);
+        pthread_barrier_wait(&mapper->done_);
+    }
+    return NULL;
+}
+
+void PositionMapper::MapFrame(const RGBc *image, int stride) {
+    if (samples_.empty()) return;
+    image_ = image;
+    stride_ = (stride == 0) ? width_ : stride;
+    if (threads_ > 1) pthread_barrier_wait(&start_);
+    Gather(0);
+    if (threads_ > 1) pthread_barrier_wait(&done_);
+
+    // Strips share the output buffer of the MultiSPI, so encoding them is
+    // done in this thread.
+    for (size_t i = 0; i < strips_.size(); ++i) {
+        const StripPositions &s = strips_[i];
+        s.strip->SetPixels(0, &colors_[s.first], s.count);
+    }
+}
+}  // namespace spixels
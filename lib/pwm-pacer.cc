@@ -0,0 +1,104 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pwm-pacer.h"
+
+#include "ft-gpio.h"
+#include "rpi-dma.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+// ---- Clock manager. BCM2835 ARM Peripherals 6.3
+#define CLK_BASE          0x101000
+#define CLK_PWMCTL        (0xa0 / 4)
+#define CLK_PWMDIV        (0xa4 / 4)
+#define CLK_PASSWD        (0x5A << 24)
+#define CLK_CTL_BUSY      (1 << 7)
+#define CLK_CTL_KILL      (1 << 5)
+#define CLK_CTL_ENAB      (1 << 4)
+#define CLK_CTL_SRC_PLLD  6
+#define CLK_DIV_DIVI(x)   ((x) << 12)
+
+// ---- PWM. BCM2835 ARM Peripherals 9.6
+#define PWM_BASE          0x20C000
+#define PWM_CTL           (0x00 / 4)
+#define PWM_STA           (0x04 / 4)
+#define PWM_DMAC          (0x08 / 4)
+#define PWM_RNG1          (0x10 / 4)
+#define PWM_FIF1_OFFSET   0x18
+#define PWM_CTL_CLRF1     (1 << 6)
+#define PWM_CTL_USEF1     (1 << 5)
+#define PWM_CTL_MODE1     (1 << 1)
+#define PWM_CTL_PWEN1     (1 << 0)
+#define PWM_DMAC_ENAB     (1 << 31)
+#define PWM_DMAC_PANIC(x) ((x) << 8)
+#define PWM_DMAC_DREQ(x)  (x)
+
+#define PHYSICAL_PWM_FIFO (0x7E000000 + PWM_BASE + PWM_FIF1_OFFSET)
+
+// We run the PWM clock at 10Mhz; the PWM range then determines the period.
+#define PWM_CLOCK_HZ      10000000
+
+namespace spixels {
+PWMPacer::PWMPacer() : pwm_reg_(0), clk_reg_(0), period_nsec_(0) {}
+
+bool PWMPacer::Init(int period_nsec) {
+    pwm_reg_ = ft::mmap_bcm_register(PWM_BASE);
+    clk_reg_ = ft::mmap_bcm_register(CLK_BASE);
+    if (pwm_reg_ == 0 || clk_reg_ == 0) {
+        fprintf(stderr, "Can't map PWM/clock registers for DMA pacing.\n");
+        pwm_reg_ = 0;
+        return false;
+    }
+    const int range = period_nsec / (1000000000 / PWM_CLOCK_HZ);
+    period_nsec_ = range * (1000000000 / PWM_CLOCK_HZ);
+
+    pwm_reg_[PWM_CTL] = 0;  // Stop PWM before messing with its clock.
+    usleep(10);
+
+    clk_reg_[CLK_PWMCTL] = CLK_PASSWD | CLK_CTL_KILL;
+    while (clk_reg_[CLK_PWMCTL] & CLK_CTL_BUSY) {
+        usleep(10);
+    }
+    const int divider = ft::GetPLLDFrequencyHz() / PWM_CLOCK_HZ;
+    clk_reg_[CLK_PWMDIV] = CLK_PASSWD | CLK_DIV_DIVI(divider);
+    clk_reg_[CLK_PWMCTL] = CLK_PASSWD | CLK_CTL_SRC_PLLD;
+    clk_reg_[CLK_PWMCTL] = CLK_PASSWD | CLK_CTL_SRC_PLLD | CLK_CTL_ENAB;
+    usleep(10);
+
+    pwm_reg_[PWM_RNG1] = range;
+    pwm_reg_[PWM_STA] = ~0;  // Clear all status flags.
+    pwm_reg_[PWM_DMAC] = (PWM_DMAC_ENAB
+                          | PWM_DMAC_PANIC(15) | PWM_DMAC_DREQ(15));
+    pwm_reg_[PWM_CTL] = PWM_CTL_CLRF1;
+    usleep(10);
+    // Serializer mode: each word takes exactly 'range' clocks to shift out.
+    pwm_reg_[PWM_CTL] = PWM_CTL_USEF1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1;
+    return true;
+}
+
+void PWMPacer::SetupDelayBlock(struct dma_cb *cb, uint32_t src_bus_addr,
+                               uint32_t periods) const {
+    cb->info   = (DMA_CB_TI_NO_WIDE_BURSTS | DMA_CB_TI_WAIT_RESP
+                  | DMA_CB_TI_DEST_DREQ | DMA_CB_TI_PERMAP(DMA_PERMAP_PWM));
+    cb->src    = src_bus_addr;  // No SRC_INC: we just read the same word.
+    cb->dst    = PHYSICAL_PWM_FIFO;
+    cb->length = periods * sizeof(uint32_t);
+    cb->stride = 0;
+}
+}  // namespace spixels
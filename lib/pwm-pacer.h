@@ -0,0 +1,71 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_PWM_PACER_H
+#define SPIXELS_PWM_PACER_H
+
+#include <stdint.h>
+
+struct dma_cb;
+
+namespace spixels {
+// The PWM peripheral consumes the words in its FIFO at a precise rate: one
+// word per PWM period. A DMA control block that writes N words to that
+// FIFO gated by the PWM data request signal thus takes exactly N periods
+// to complete. We use this to insert precise delays into DMA control
+// block chains, which otherwise run as fast as the bus allows.
+//
+// The actual PWM output is not routed to any pin, so this does not
+// interfere with the GPIOs we use for data.
+class PWMPacer {
+public:
+    PWMPacer();
+
+    // Set up the PWM clock and peripheral so that each word in the FIFO
+    // takes "period_nsec" to drain. Resolution is 100ns.
+    // Returns 'false' if the registers could not be mapped.
+    bool Init(int period_nsec);
+
+    bool initialized() const { return pwm_reg_ != 0; }
+    int period_nsec() const { return period_nsec_; }
+
+    // Set up control block "cb" to delay the chain for the given number of
+    // PWM periods. "src_bus_addr" is the bus address of any 32 bit word
+    // in DMA memory; its value is read but ignored.
+    // Does not touch cb->next.
+    void SetupDelayBlock(struct dma_cb *cb, uint32_t src_bus_addr,
+                         uint32_t periods) const;
+
+    // The FIFO accepts this many words right away before it is full and
+    // starts pacing. So a delay block following a transfer that took
+    // long enough to drain the FIFO needs to be this many periods longer.
+    // Conversely, a chain of many short paced blocks needs to start with
+    // a delay block of this length to fill the FIFO first.
+    static const int kFifoWords = 16;
+
+    // The DMA transfer length field has 30 bits, which limits the number of
+    // periods a single delay block can wait.
+    static const uint32_t kMaxDelayPeriods = ((1 << 30) - 1) / sizeof(uint32_t);
+
+private:
+    volatile uint32_t *pwm_reg_;
+    volatile uint32_t *clk_reg_;
+    int period_nsec_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_PWM_PACER_H
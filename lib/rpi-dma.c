@@ -20,6 +20,8 @@
 #include "mailbox.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define PAGE_SIZE 4096
@@ -33,8 +35,15 @@
 #define MEM_FLAG_COHERENT         (2 << 2)
 #define MEM_FLAG_L1_NONALLOCATING (MEM_FLAG_DIRECT | MEM_FLAG_COHERENT)
 
+#define MAX_POOLED_BLOCKS 16
+
 static int mbox_fd = -1;   // used internally by the UncachedMemBlock-functions.
 
+// Shared by all outputs, which might be used from different threads.
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct UncachedMemBlock pool[MAX_POOLED_BLOCKS];
+static int pool_size = 0;
+
 // Allocate a block of memory of the given size (which is rounded up to the next
 // full page). The memory will be aligned on a page boundary and zeroed out.
 struct UncachedMemBlock UncachedMemBlock_alloc(size_t size) {
@@ -67,6 +76,57 @@ void UncachedMemBlock_free(struct UncachedMemBlock *block) {
     block->mem = NULL;
 }
 
+// Get smallest fitting block from the pool or allocate a new one.
+struct UncachedMemBlock UncachedMemBlock_pool_alloc(size_t size) {
+    pthread_mutex_lock(&pool_mutex);
+    // Smallest block that fits.
+    int best = -1;
+    for (int i = 0; i < pool_size; ++i) {
+        if (pool[i].size >= size
+            && (best < 0 || pool[i].size < pool[best].size)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        pthread_mutex_unlock(&pool_mutex);
+        return UncachedMemBlock_alloc(size);
+    }
+
+    struct UncachedMemBlock result = pool[best];
+    pool[best] = pool[--pool_size];
+    pthread_mutex_unlock(&pool_mutex);
+    // Writes to uncached memory are slow; only clear what was asked for.
+    memset(result.mem, 0x00, size);
+    return result;
+}
+
+// Keep block for re-use; only really free it if the pool is full.
+void UncachedMemBlock_pool_release(struct UncachedMemBlock *block) {
+    if (block->mem == NULL) return;
+    pthread_mutex_lock(&pool_mutex);
+    if (pool_size == MAX_POOLED_BLOCKS) {
+        pthread_mutex_unlock(&pool_mutex);
+        UncachedMemBlock_free(block);
+        return;
+    }
+    static int exit_handler_registered = 0;
+    if (!exit_handler_registered) {
+        // Memory allocated on the VideoCore is not freed when we exit.
+        atexit(UncachedMemBlock_pool_drain);
+        exit_handler_registered = 1;
+    }
+    pool[pool_size++] = *block;
+    pthread_mutex_unlock(&pool_mutex);
+    block->mem = NULL;
+}
+
+void UncachedMemBlock_pool_drain(void) {
+    pthread_mutex_lock(&pool_mutex);
+    while (pool_size > 0) {
+        UncachedMemBlock_free(&pool[--pool_size]);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+}
 
 // Given a pointer to memory that is in the allocated block, return the
 // physical bus addresse needed by DMA operations.
@@ -24,10 +24,16 @@ extern "C" {
 
 // BCM2385 ARM Peripherals 4.2.1.2
 #define DMA_CB_TI_NO_WIDE_BURSTS (1<<26)
+#define DMA_CB_TI_PERMAP(x)      (((x)&0x1f) << 16)
 #define DMA_CB_TI_SRC_INC        (1<<8)
+#define DMA_CB_TI_DEST_DREQ      (1<<6)
 #define DMA_CB_TI_DEST_INC       (1<<4)
+#define DMA_CB_TI_WAIT_RESP      (1<<3)
 #define DMA_CB_TI_TDMODE         (1<<1)
 
+// Peripheral data request lines (DREQ) to use with DMA_CB_TI_PERMAP()
+#define DMA_PERMAP_PWM 5
+
 #define DMA_CS_RESET    (1<<31)
 #define DMA_CS_ABORT    (1<<30)
 #define DMA_CS_DISDEBUG (1<<28)
@@ -83,6 +89,16 @@ struct UncachedMemBlock UncachedMemBlock_alloc(size_t size);
 // Free block previously allocated with UncachedMemBlock_alloc()
 void UncachedMemBlock_free(struct UncachedMemBlock *block);
 
+// Allocating and freeing uncached memory is a round-trip to the VideoCore
+// each time. If memory is frequently re-allocated, use these instead:
+// released blocks are kept in a pool and handed out again for requests that
+// fit. The requested size of a block handed out is zeroed out; a pooled
+// block might be larger, and the rest can contain old data.
+// Pooled blocks are returned to the VideoCore at exit or with _pool_drain().
+struct UncachedMemBlock UncachedMemBlock_pool_alloc(size_t size);
+void UncachedMemBlock_pool_release(struct UncachedMemBlock *block);
+void UncachedMemBlock_pool_drain(void);
+
 // Given a pointer to memory that is in the allocated block, return the
 // physical bus addresse needed by DMA operations.
 uintptr_t UncachedMemBlock_to_physical(const struct UncachedMemBlock *blk,
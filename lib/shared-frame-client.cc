@@ -0,0 +1,156 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "shared-frame-client.h"
+
+#include "shared-frame.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace spixels {
+SharedFrameClient::SharedFrameClient()
+    : socket_fd_(-1), header_(NULL), mapped_size_(0),
+      back_(SHARED_FRAME_INITIAL_BACK), back_pixels_(NULL) {
+}
+
+SharedFrameClient::~SharedFrameClient() {
+    Disconnect();
+}
+
+void SharedFrameClient::Disconnect() {
+    if (header_) munmap(header_, mapped_size_);
+    header_ = NULL;
+    back_pixels_ = NULL;
+    if (socket_fd_ >= 0) close(socket_fd_);
+    socket_fd_ = -1;
+}
+
+// Receive the status byte and, if sent along, the memfd.
+static int ReceiveReply(int fd, int *memfd) {
+    uint8_t status;
+    struct iovec iov;
+    iov.iov_base = &status;
+    iov.iov_len = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    bzero(&msg, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    *memfd = -1;
+    if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != 1)
+        return -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET
+        && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(memfd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return status;
+}
+
+bool SharedFrameClient::Connect(const char *socket_path, int layer,
+                                Compositor::BlendMode mode, uint8_t opacity) {
+    Disconnect();
+    struct sockaddr_un addr;
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    socket_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(socket_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect()");
+        Disconnect();
+        return false;
+    }
+
+    SharedFrameHello hello;
+    hello.magic = SHARED_FRAME_MAGIC;
+    hello.version = SHARED_FRAME_VERSION;
+    hello.layer = layer;
+    hello.blend_mode = mode;
+    hello.opacity = opacity;
+    if (write(socket_fd_, &hello, sizeof(hello)) != sizeof(hello)) {
+        perror("write()");
+        Disconnect();
+        return false;
+    }
+    int memfd;
+    const int status = ReceiveReply(socket_fd_, &memfd);
+    if (status != SHARED_FRAME_OK || memfd < 0) {
+        fprintf(stderr, "Server refused connection: %s\n",
+                status == SHARED_FRAME_LAYER_BUSY ? "layer in use"
+                : status == SHARED_FRAME_BAD_REQUEST ? "bad request"
+                : "no reply");
+        if (memfd >= 0) close(memfd);
+        Disconnect();
+        return false;
+    }
+
+    struct stat st;
+    fstat(memfd, &st);
+    mapped_size_ = st.st_size;
+    void *mem = mmap(NULL, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     memfd, 0);
+    close(memfd);
+    if (mem == MAP_FAILED) {
+        perror("mmap()");
+        Disconnect();
+        return false;
+    }
+    header_ = (SharedFrameHeader*) mem;
+    offsets_.resize(header_->strip_count);
+    int offset = 0;
+    for (size_t i = 0; i < header_->strip_count; ++i) {
+        offsets_[i] = offset;
+        offset += header_->strip_length[i];
+    }
+    back_ = SHARED_FRAME_INITIAL_BACK;
+    back_pixels_ = (RGBc*) SharedFrameBuffer(header_, back_);
+    return true;
+}
+
+int SharedFrameClient::strip_count() const {
+    return header_ ? header_->strip_count : 0;
+}
+
+int SharedFrameClient::strip_length(int strip) const {
+    if (strip < 0 || strip >= strip_count()) return 0;
+    return header_->strip_length[strip];
+}
+
+void SharedFrameClient::SetPixel(int strip, int pos, const RGBc &c) {
+    if (pos < 0 || pos >= strip_length(strip)) return;
+    back_pixels_[offsets_[strip] + pos] = c;
+}
+
+RGBc *SharedFrameClient::pixels(int strip) {
+    if (strip < 0 || strip >= strip_count()) return NULL;
+    return back_pixels_ + offsets_[strip];
+}
+
+void SharedFrameClient::PublishFrame() {
+    if (!header_) return;
+    back_ = SharedFramePublish(header_, back_);
+    back_pixels_ = (RGBc*) SharedFrameBuffer(header_, back_);
+}
+}  // namespace spixels
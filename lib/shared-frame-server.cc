@@ -0,0 +1,324 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "shared-frame-server.h"
+
+#include "frame-clock.h"
+#include "shared-frame.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace spixels {
+struct SharedFrameServer::Client {
+    int fd;
+    int layer;                    // -1 until the hello is received.
+    SharedFrameHeader *header;
+    size_t mapped_size;
+    // Layout as we created it; the header is writable by the client.
+    const uint8_t *buffers;
+    size_t buffer_size;
+    int front;                    // Buffer we are reading from.
+};
+
+SharedFrameServer::SharedFrameServer(LEDStrip *const *strips, int strip_count,
+                                     int layers)
+    : strips_(new LEDStrip*[strip_count]), strip_count_(strip_count),
+      pixel_count_(0), compositor_(strips, strip_count, layers),
+      layer_used_(layers, false), listen_fd_(-1), running_(false) {
+    for (int i = 0; i < strip_count; ++i) {
+        strips_[i] = strips[i];
+        pixel_count_ += strips[i]->count();
+    }
+    bzero(&stats_, sizeof(stats_));
+}
+
+SharedFrameServer::~SharedFrameServer() {
+    while (!clients_.empty()) {
+        CloseClient(clients_.back());
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+    }
+    delete [] strips_;
+}
+
+bool SharedFrameServer::Listen(const char *socket_path) {
+    if (strip_count_ > SHARED_FRAME_MAX_STRIPS) {
+        fprintf(stderr, "Can only share up to %d strips.\n",
+                SHARED_FRAME_MAX_STRIPS);
+        return false;
+    }
+    struct sockaddr_un addr;
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return false;
+    }
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        perror("socket()");
+        return false;
+    }
+    unlink(socket_path);  // Left over from a previous run.
+    if (bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind()");
+        return false;
+    }
+    // We typically run as root to access the hardware, clients don't.
+    chmod(socket_path, 0666);
+    if (listen(listen_fd_, 8) < 0) {
+        perror("listen()");
+        return false;
+    }
+    socket_path_ = socket_path;
+    return true;
+}
+
+void SharedFrameServer::Accept() {
+    const int fd = accept4(listen_fd_, NULL, NULL,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    Client *client = new Client();
+    client->fd = fd;
+    client->layer = -1;
+    client->header = NULL;
+    client->mapped_size = 0;
+    client->buffers = NULL;
+    client->buffer_size = 0;
+    client->front = SHARED_FRAME_INITIAL_FRONT;
+    clients_.push_back(client);
+    stats_.clients++;
+    stats_.connections++;
+}
+
+static void SendReply(int fd, uint8_t status, int memfd) {
+    struct iovec iov;
+    iov.iov_base = &status;
+    iov.iov_len = 1;
+    struct msghdr msg;
+    bzero(&msg, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    if (memfd >= 0) {
+        bzero(control, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+    }
+    sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+
+// Create the shared memory for a client. Returns the memfd or -1.
+static int CreateSharedFrames(LEDStrip *const *strips, int strip_count,
+                              int pixel_count, SharedFrameHeader **header,
+                              size_t *size, const uint8_t **buffers,
+                              size_t *buffer_size) {
+    const size_t header_size = (sizeof(SharedFrameHeader) + 63) & ~63;
+    *buffer_size = (3 * pixel_count + 63) & ~63;
+    *size = header_size + 3 * *buffer_size;
+    const int memfd = memfd_create("spixels-frames",
+                                   MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        perror("memfd_create()");
+        return -1;
+    }
+    // Clients must not be able to pull the memory from under us.
+    if (ftruncate(memfd, *size) < 0
+        || fcntl(memfd, F_ADD_SEALS,
+                 F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        perror("Setting up shared memory");
+        close(memfd);
+        return -1;
+    }
+    void *mem = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     memfd, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap()");
+        close(memfd);
+        return -1;
+    }
+    SharedFrameHeader *h = (SharedFrameHeader*) mem;
+    h->magic = SHARED_FRAME_MAGIC;
+    h->strip_count = strip_count;
+    for (int i = 0; i < strip_count; ++i) {
+        h->strip_length[i] = strips[i]->count();
+    }
+    h->pixel_count = pixel_count;
+    h->buffer_offset = header_size;
+    h->buffer_size = *buffer_size;
+    h->state = SHARED_FRAME_INITIAL_MIDDLE;
+    h->published = 0;
+    *header = h;
+    *buffers = (const uint8_t*)mem + header_size;
+    return memfd;
+}
+
+void SharedFrameServer::HandleHello(Client *client) {
+    SharedFrameHello hello;
+    const ssize_t len = recv(client->fd, &hello, sizeof(hello), 0);
+    if (len == 0 || (len < 0 && errno != EAGAIN)) {
+        CloseClient(client);
+        return;
+    }
+    if (len < 0) return;
+    if (len != sizeof(hello) || hello.magic != SHARED_FRAME_MAGIC
+        || hello.version != SHARED_FRAME_VERSION
+        || hello.layer < 0 || hello.layer >= compositor_.layers()
+        || hello.blend_mode < Compositor::BLEND_NORMAL
+        || hello.blend_mode > Compositor::BLEND_LIGHTEN
+        || hello.opacity < 0 || hello.opacity > 255) {
+        SendReply(client->fd, SHARED_FRAME_BAD_REQUEST, -1);
+        stats_.rejected++;
+        CloseClient(client);
+        return;
+    }
+    if (layer_used_[hello.layer]) {
+        SendReply(client->fd, SHARED_FRAME_LAYER_BUSY, -1);
+        stats_.rejected++;
+        CloseClient(client);
+        return;
+    }
+    const int memfd = CreateSharedFrames(strips_, strip_count_, pixel_count_,
+                                         &client->header,
+                                         &client->mapped_size,
+                                         &client->buffers,
+                                         &client->buffer_size);
+    if (memfd < 0) {
+        CloseClient(client);
+        return;
+    }
+    SendReply(client->fd, SHARED_FRAME_OK, memfd);
+    close(memfd);   // The client has its own now; we keep the mapping.
+
+    client->layer = hello.layer;
+    layer_used_[client->layer] = true;
+    compositor_.ClearLayer(client->layer);
+    compositor_.SetLayerBlendMode(client->layer,
+                                  (Compositor::BlendMode)hello.blend_mode);
+    compositor_.SetLayerOpacity(client->layer, hello.opacity);
+}
+
+void SharedFrameServer::CloseClient(Client *client) {
+    if (client->layer >= 0) {
+        compositor_.ClearLayer(client->layer);
+        layer_used_[client->layer] = false;
+    }
+    if (client->header) munmap(client->header, client->mapped_size);
+    close(client->fd);
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        if (clients_[i] == client) {
+            clients_.erase(clients_.begin() + i);
+            stats_.clients--;
+            break;
+        }
+    }
+    delete client;
+}
+
+bool SharedFrameServer::FetchFrames() {
+    bool any_new = false;
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        Client *const client = clients_[i];
+        if (client->header == NULL) continue;
+        const int front = SharedFrameFetch(client->header, client->front);
+        if (front < 0) continue;
+        // Only use our own idea of the layout; the client could have
+        // scribbled over the header.
+        if (front > 2) {
+            stats_.rejected++;
+            CloseClient(client);
+            --i;
+            continue;
+        }
+        client->front = front;
+        const RGBc *pixels
+            = (const RGBc*) (client->buffers + front * client->buffer_size);
+        for (int s = 0; s < strip_count_; ++s) {
+            compositor_.SetPixels(client->layer, s, 0, pixels,
+                                  strips_[s]->count());
+            pixels += strips_[s]->count();
+        }
+        stats_.client_frames++;
+        any_new = true;
+    }
+    return any_new;
+}
+
+bool SharedFrameServer::ProcessUntil(int64_t deadline_nsec) {
+    std::vector<struct pollfd> fds;
+    for (;;) {
+        const int64_t remaining = deadline_nsec - FrameClock::Now();
+        if (remaining <= 0) break;
+        fds.resize(1 + clients_.size());
+        fds[0].fd = listen_fd_;
+        fds[0].events = POLLIN;
+        for (size_t i = 0; i < clients_.size(); ++i) {
+            fds[i+1].fd = clients_[i]->fd;
+            fds[i+1].events = POLLIN;
+        }
+        // Round up, so that we don't spin in the last millisecond.
+        if (poll(&fds[0], fds.size(), (remaining + 999999) / 1000000) <= 0)
+            continue;
+        // Clients only talk to us to say hello or goodbye.
+        for (size_t i = fds.size() - 1; i > 0; --i) {
+            if (fds[i].revents == 0) continue;
+            Client *const client = clients_[i-1];
+            if (client->layer < 0) {
+                HandleHello(client);
+            } else {
+                CloseClient(client);
+            }
+        }
+        if (fds[0].revents & POLLIN) Accept();
+    }
+    FetchFrames();
+    return compositor_.Compose();
+}
+
+void SharedFrameServer::Run(FrameClock *clock) {
+    const int64_t period = clock->frame_period_nsec();
+    int64_t deadline = FrameClock::Now() + period;
+    bool unsent = false;  // Composed, but the clock dropped the frame.
+    running_ = true;
+    while (running_) {
+        // Leave a bit of the frame period for composing.
+        if (ProcessUntil(deadline - period / 4) || unsent) {
+            unsent = !clock->SendBuffersAt(deadline);
+            if (!unsent) stats_.frames++;
+        }
+        deadline = clock->NextDeadline(deadline);
+    }
+}
+}  // namespace spixels
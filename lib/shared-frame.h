@@ -0,0 +1,108 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_SHARED_FRAME_H
+#define SPIXELS_SHARED_FRAME_H
+
+// Protocol between SharedFrameServer and SharedFrameClient. Both sides are
+// in this library, so there is no compatibility to keep beyond the version
+// check.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace spixels {
+#define SHARED_FRAME_MAGIC   0x73706978   // 'spix'
+#define SHARED_FRAME_VERSION 1
+#define SHARED_FRAME_MAX_STRIPS 32
+
+// First message from the client on the unix socket.
+struct SharedFrameHello {
+    uint32_t magic;
+    uint32_t version;
+    int32_t layer;
+    int32_t blend_mode;       // Compositor::BlendMode
+    int32_t opacity;
+};
+
+// Reply: one status byte, with the memfd attached if SHARED_FRAME_OK.
+enum {
+    SHARED_FRAME_OK = 0,
+    SHARED_FRAME_BAD_REQUEST = 1,
+    SHARED_FRAME_LAYER_BUSY = 2,
+};
+
+// At the start of the shared memory, followed by three frame buffers of
+// "pixel_count" RGB pixels each, all strips consecutive.
+//
+// The buffers are a lock-free triple buffer: the client owns the "back"
+// buffer and renders into it, the server owns the "front" buffer and reads
+// from it. Which buffer is in the middle is in "state", together with a
+// flag whether it holds a frame not seen by the server yet. Both sides swap
+// their buffer with the middle one in a single atomic exchange, so neither
+// ever waits for the other and the server always gets the latest complete
+// frame.
+struct SharedFrameHeader {
+    uint32_t magic;
+    uint32_t strip_count;
+    uint32_t strip_length[SHARED_FRAME_MAX_STRIPS];
+    uint32_t pixel_count;             // Sum of all strip lengths.
+    uint32_t buffer_offset;           // Of the first buffer, in bytes.
+    uint32_t buffer_size;             // Bytes per buffer.
+
+    uint32_t state;                   // Middle buffer | SHARED_FRAME_FRESH
+    uint32_t published;               // Frames published by the client.
+};
+
+#define SHARED_FRAME_FRESH 0x4
+#define SHARED_FRAME_INDEX_MASK 0x3
+
+// Initial assignment of the three buffers.
+#define SHARED_FRAME_INITIAL_BACK   0
+#define SHARED_FRAME_INITIAL_MIDDLE 1
+#define SHARED_FRAME_INITIAL_FRONT  2
+
+// Swap the buffer we own with the middle buffer. The writer passes
+// SHARED_FRAME_FRESH to publish; the reader only swaps if the middle
+// buffer is fresh. Returns the index of the buffer we own afterwards.
+inline int SharedFramePublish(SharedFrameHeader *header, int back) {
+    const uint32_t previous = __atomic_exchange_n(
+        &header->state, back | SHARED_FRAME_FRESH, __ATOMIC_ACQ_REL);
+    __atomic_fetch_add(&header->published, 1, __ATOMIC_RELAXED);
+    return previous & SHARED_FRAME_INDEX_MASK;
+}
+
+// Returns the new front buffer, or -1 if there is no new frame.
+inline int SharedFrameFetch(SharedFrameHeader *header, int front) {
+    if ((__atomic_load_n(&header->state, __ATOMIC_ACQUIRE)
+         & SHARED_FRAME_FRESH) == 0)
+        return -1;
+    // Only the reader clears the flag, so it is still set now.
+    const uint32_t previous = __atomic_exchange_n(&header->state, front,
+                                                  __ATOMIC_ACQ_REL);
+    return previous & SHARED_FRAME_INDEX_MASK;
+}
+
+// For the client. The server doesn't trust the header and uses the layout
+// it created.
+inline uint8_t *SharedFrameBuffer(SharedFrameHeader *header, int index) {
+    return ((uint8_t*)header + header->buffer_offset
+            + index * header->buffer_size);
+}
+}  // namespace spixels
+
+#endif  // SPIXELS_SHARED_FRAME_H
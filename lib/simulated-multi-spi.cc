@@ -0,0 +1,134 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "multi-spi.h"
+
+#include "stats-clock.h"
+#include "wire-format.h"
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+namespace spixels {
+namespace {
+// MultiSPI that does not touch any hardware: it keeps the buffers and
+// takes as long to send as the real thing would, so that programs can be
+// tested and timed on any machine.
+class SimulatedMultiSPI : public MultiSPI {
+public:
+    explicit SimulatedMultiSPI(float speed_mhz)
+        : speed_mhz_(speed_mhz), serial_byte_size_(0) {}
+
+    virtual bool RegisterDataGPIO(int gpio, size_t serial_byte_size) {
+        if (gpio < 0 || gpio >= 32) return false;
+        buffers_[gpio].assign(serial_byte_size, 0);
+        UpdateLayout();
+        return true;
+    }
+
+    virtual void UnregisterDataGPIO(int gpio) {
+        if (gpio < 0 || gpio >= 32) return;
+        buffers_[gpio].clear();
+        UpdateLayout();
+    }
+
+    virtual void SetBufferedByte(int data_gpio, size_t pos, uint8_t data) {
+        assert(pos < buffers_[data_gpio].size());
+        buffers_[data_gpio][pos] = data;
+    }
+
+    virtual bool MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                   size_t count) {
+        std::vector<uint8_t> &buffer = buffers_[data_gpio];
+        assert(from + count <= buffer.size() && to + count <= buffer.size());
+        memmove(&buffer[to], &buffer[from], count);
+        return true;
+    }
+
+    virtual void SendBuffers() {
+        Wait();
+    }
+
+    // The wire frame is simply the buffers of all GPIOs in a row.
+    virtual uint32_t WireFormat() const {
+        uint32_t hash = StartWireFormat(WIRE_FORMAT_SIMULATED);
+        for (int gpio = 0; gpio < 32; ++gpio) {
+            if (buffers_[gpio].empty()) continue;
+            hash = HashWireFormat(hash, gpio);
+            hash = HashWireFormat(hash, buffers_[gpio].size());
+        }
+        return hash;
+    }
+
+    virtual size_t WireFrameSize() const {
+        size_t result = 0;
+        for (int gpio = 0; gpio < 32; ++gpio) result += buffers_[gpio].size();
+        return result;
+    }
+
+    virtual bool GetWireFrame(void *out) const {
+        uint8_t *pos = (uint8_t*)out;
+        for (int gpio = 0; gpio < 32; ++gpio) {
+            if (buffers_[gpio].empty()) continue;
+            memcpy(pos, &buffers_[gpio][0], buffers_[gpio].size());
+            pos += buffers_[gpio].size();
+        }
+        return true;
+    }
+
+    virtual bool SendWireFrame(const void *frame) {
+        Wait();
+        return true;
+    }
+
+private:
+    // Take as long as the transfer would.
+    void Wait() {
+        transfer_stats_.frames_sent++;
+        transfer_stats_.bits_sent += 8 * serial_byte_size_;
+        ScopedTiming timing(&transfer_stats_.transmit, TRACE_TRANSMIT);
+        if (speed_mhz_ <= 0) return;
+        // All streams go out in parallel, so only the longest one counts.
+        const int64_t nsec = (int64_t)(8000 * serial_byte_size_ / speed_mhz_);
+        struct timespec ts;
+        ts.tv_sec = nsec / 1000000000LL;
+        ts.tv_nsec = nsec % 1000000000LL;
+        nanosleep(&ts, NULL);
+    }
+
+    void UpdateLayout() {
+        serial_byte_size_ = 0;
+        for (int i = 0; i < 32; ++i) {
+            if (buffers_[i].size() > serial_byte_size_)
+                serial_byte_size_ = buffers_[i].size();
+        }
+    }
+
+    const float speed_mhz_;
+    std::vector<uint8_t> buffers_[32];
+    size_t serial_byte_size_;
+};
+}  // end anonymous namespace
+
+// Public interface
+MultiSPI *CreateSimulatedMultiSPI(float speed_mhz) {
+    return new SimulatedMultiSPI(speed_mhz);
+}
+}  // namespace spixels
@@ -0,0 +1,67 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef SPIXELS_STATS_CLOCK_H
+#define SPIXELS_STATS_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "frame-trace.h"
+#include "timing-stats.h"
+
+namespace spixels {
+// Timestamp in nanoseconds for statistics. The ARM cycle counter is not
+// readable from user space with the stock Raspberry Pi kernel, but
+// clock_gettime() is handled in the vDSO without a system call, which
+// reads the architected timer; that is cheap enough to do a few times per
+// frame.
+inline int64_t StatsNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Set while frame tracing; see frame-trace.h
+extern int frame_trace_active;
+inline bool FrameTraceActive() {
+    return __atomic_load_n(&frame_trace_active, __ATOMIC_RELAXED);
+}
+
+// Add a measured time to "stat" and, while tracing, as span to the trace.
+inline void AddTiming(TimingStat *stat, FrameTraceSpan span,
+                      int64_t start_nsec, int64_t end_nsec) {
+    stat->Add(end_nsec - start_nsec);
+    if (FrameTraceActive()) AddFrameTraceSpan(span, start_nsec, end_nsec);
+}
+
+// Adds the time until it goes out of scope to a TimingStat.
+class ScopedTiming {
+public:
+    ScopedTiming(TimingStat *stat, FrameTraceSpan span)
+        : stat_(stat), span_(span), start_(StatsNow()) {}
+    ~ScopedTiming() { AddTiming(stat_, span_, start_, StatsNow()); }
+
+private:
+    TimingStat *const stat_;
+    const FrameTraceSpan span_;
+    const int64_t start_;
+};
+}  // namespace spixels
+
+#endif  // SPIXELS_STATS_CLOCK_H
@@ -0,0 +1,340 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "video-pipeline.h"
+
+#include "frame-clock.h"
+#include "frame-trace.h"
+#include "multi-spi.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+// Pipe buffer to ask for if the input is a pipe. The default of 64k is
+// less than a single frame of most videos, which would then need many
+// reads and wakeups of the writer.
+#define PIPE_BUFFER_SIZE (1 << 20)
+
+namespace spixels {
+// Fixed number of frame buffers passed between two stages. Buffers cycle
+// from free (producer) to ready (consumer) and back.
+class VideoPipeline::FrameQueue {
+public:
+    FrameQueue(size_t frame_bytes, int frames)
+        : closed_(false), shutdown_(false) {
+        for (int i = 0; i < frames; ++i) {
+            free_.push_back(new uint8_t[frame_bytes]);
+        }
+        all_ = free_;
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&changed_, NULL);
+    }
+    ~FrameQueue() {
+        for (size_t i = 0; i < all_.size(); ++i) delete [] all_[i];
+        pthread_cond_destroy(&changed_);
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    // Get a buffer to fill. Blocks until one is free; NULL on shutdown.
+    uint8_t *AcquireFree() {
+        pthread_mutex_lock(&mutex_);
+        while (free_.empty() && !shutdown_)
+            pthread_cond_wait(&changed_, &mutex_);
+        uint8_t *result = NULL;
+        if (!shutdown_) {
+            result = free_.back();
+            free_.pop_back();
+        }
+        pthread_mutex_unlock(&mutex_);
+        return result;
+    }
+
+    void PushReady(uint8_t *buffer) { Put(&ready_, buffer); }
+    void ReleaseFree(uint8_t *buffer) { Put(&free_, buffer); }
+
+    // Get the oldest filled buffer. Blocks until there is one; NULL if the
+    // producer closed the queue and all buffers are consumed or on shutdown.
+    uint8_t *AcquireReady() {
+        pthread_mutex_lock(&mutex_);
+        while (ready_.empty() && !closed_ && !shutdown_)
+            pthread_cond_wait(&changed_, &mutex_);
+        uint8_t *result = NULL;
+        if (!ready_.empty() && !shutdown_) {
+            result = ready_.front();
+            ready_.pop_front();
+        }
+        pthread_mutex_unlock(&mutex_);
+        return result;
+    }
+
+    // Producer is done.
+    void Close() { SetFlag(&closed_); }
+
+    // Wake up everyone and make all Acquire calls return NULL.
+    void Shutdown() { SetFlag(&shutdown_); }
+
+private:
+    template <class Container> void Put(Container *c, uint8_t *buffer) {
+        pthread_mutex_lock(&mutex_);
+        c->push_back(buffer);
+        pthread_cond_broadcast(&changed_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    void SetFlag(bool *flag) {
+        pthread_mutex_lock(&mutex_);
+        *flag = true;
+        pthread_cond_broadcast(&changed_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    std::vector<uint8_t*> all_;
+    std::vector<uint8_t*> free_;
+    std::deque<uint8_t*> ready_;
+    bool closed_;
+    bool shutdown_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t changed_;
+};
+
+// Range of source pixels [begin, end) for each of the "out" pixels.
+static void ComputeRanges(int in, int out, int *begin, int *end) {
+    for (int i = 0; i < out; ++i) {
+        begin[i] = (int64_t)i * in / out;
+        end[i] = (int64_t)(i + 1) * in / out;
+        if (end[i] == begin[i]) end[i] = begin[i] + 1;  // Upscaling.
+    }
+}
+
+VideoPipeline::VideoPipeline(MultiSPI *spi, Canvas *canvas,
+                             int video_width, int video_height,
+                             int queue_frames)
+    : spi_(spi), canvas_(canvas),
+      video_width_(video_width), video_height_(video_height),
+      video_bytes_(3 * video_width * video_height),
+      canvas_bytes_(3 * canvas->width() * canvas->height()),
+      needs_scaling_(video_width != canvas->width()
+                     || video_height != canvas->height()),
+      x_begin_(new int[canvas->width()]), x_end_(new int[canvas->width()]),
+      y_begin_(new int[canvas->height()]), y_end_(new int[canvas->height()]),
+      sums_(new uint32_t[3 * canvas->width()]),
+      fd_(-1), stop_fd_(eventfd(0, EFD_CLOEXEC)), clock_(NULL),
+      running_stages_(0), started_(false) {
+    ComputeRanges(video_width, canvas->width(), x_begin_, x_end_);
+    ComputeRanges(video_height, canvas->height(), y_begin_, y_end_);
+    read_queue_ = new FrameQueue(video_bytes_, queue_frames);
+    // Without scaling, the sender works on the frames as read.
+    map_queue_ = needs_scaling_
+        ? new FrameQueue(canvas_bytes_, queue_frames)
+        : read_queue_;
+    bzero(stats_, sizeof(stats_));
+}
+
+VideoPipeline::~VideoPipeline() {
+    Stop();
+    if (stop_fd_ >= 0) close(stop_fd_);
+    if (map_queue_ != read_queue_) delete map_queue_;
+    delete read_queue_;
+    delete [] sums_;
+    delete [] y_end_;
+    delete [] y_begin_;
+    delete [] x_end_;
+    delete [] x_begin_;
+}
+
+bool VideoPipeline::Start(int fd, FrameClock *clock) {
+    if (started_) return false;
+    fd_ = fd;
+    clock_ = clock;
+    // Fewer, larger reads. Both fail harmlessly if fd is not a pipe or file.
+    fcntl(fd, F_SETPIPE_SZ, PIPE_BUFFER_SIZE);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    started_ = true;
+    running_stages_ = needs_scaling_ ? 3 : 2;
+    pthread_create(&threads_[READ], NULL, &ReadThread, this);
+    if (needs_scaling_) pthread_create(&threads_[MAP], NULL, &MapThread, this);
+    pthread_create(&threads_[SEND], NULL, &SendThread, this);
+    return true;
+}
+
+void VideoPipeline::Wait() {
+    if (!started_) return;
+    pthread_join(threads_[READ], NULL);
+    if (needs_scaling_) pthread_join(threads_[MAP], NULL);
+    pthread_join(threads_[SEND], NULL);
+    started_ = false;
+}
+
+void VideoPipeline::Stop() {
+    if (!started_) return;
+    read_queue_->Shutdown();
+    map_queue_->Shutdown();
+    // Wake up the reader should it be waiting for input.
+    const uint64_t one = 1;
+    if (stop_fd_ >= 0 && write(stop_fd_, &one, sizeof(one)) < 0) {
+        perror("VideoPipeline stop");
+    }
+    Wait();
+}
+
+void *VideoPipeline::ReadThread(void *self) {
+    ((VideoPipeline*)self)->Read();
+    return NULL;
+}
+void *VideoPipeline::MapThread(void *self) {
+    ((VideoPipeline*)self)->Map();
+    return NULL;
+}
+void *VideoPipeline::SendThread(void *self) {
+    ((VideoPipeline*)self)->Send();
+    return NULL;
+}
+
+void VideoPipeline::Read() {
+    StageStats *const stats = &stats_[READ];
+    for (;;) {
+        const int64_t start = FrameClock::Now();
+        uint8_t *const frame = read_queue_->AcquireFree();
+        const int64_t acquired = FrameClock::Now();
+        stats->wait_nsec += acquired - start;
+        if (frame == NULL) break;
+
+        // Usually a single read per frame, unless the writer is slow.
+        // Only read() once there is input, so that Stop() does not have to
+        // wait for the writer.
+        size_t got = 0;
+        while (got < video_bytes_) {
+            struct pollfd fds[2] = { { fd_, POLLIN, 0 },
+                                     { stop_fd_, POLLIN, 0 } };
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                perror("VideoPipeline poll");
+                break;
+            }
+            if (fds[1].revents) break;
+            const ssize_t r = read(fd_, frame + got, video_bytes_ - got);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            got += r;
+        }
+        if (got < video_bytes_) {   // End of input; partial frame dropped.
+            read_queue_->ReleaseFree(frame);
+            break;
+        }
+        read_queue_->PushReady(frame);
+        // Time waiting for the writer counts as busy time of the reader.
+        stats->busy_nsec += FrameClock::Now() - acquired;
+        stats->frames++;
+        stats->bytes += video_bytes_;
+    }
+    read_queue_->Close();
+    __sync_fetch_and_sub(&running_stages_, 1);
+}
+
+void VideoPipeline::Map() {
+    StageStats *const stats = &stats_[MAP];
+    for (;;) {
+        const int64_t start = FrameClock::Now();
+        uint8_t *const in = read_queue_->AcquireReady();
+        uint8_t *const out = in ? map_queue_->AcquireFree() : NULL;
+        const int64_t acquired = FrameClock::Now();
+        stats->wait_nsec += acquired - start;
+        if (out == NULL) break;
+
+        Scale(in, out);
+        read_queue_->ReleaseFree(in);
+        map_queue_->PushReady(out);
+        stats->busy_nsec += FrameClock::Now() - acquired;
+        stats->frames++;
+        stats->bytes += canvas_bytes_;
+    }
+    map_queue_->Close();
+    __sync_fetch_and_sub(&running_stages_, 1);
+}
+
+// Box filter: each output pixel is the average of the source pixels that
+// fall onto it.
+void VideoPipeline::Scale(const uint8_t *in, uint8_t *out) {
+    const int width = canvas_->width();
+    const int height = canvas_->height();
+    for (int y = 0; y < height; ++y) {
+        bzero(sums_, 3 * width * sizeof(uint32_t));
+        for (int sy = y_begin_[y]; sy < y_end_[y]; ++sy) {
+            const uint8_t *const row = in + 3 * sy * video_width_;
+            uint32_t *sum = sums_;
+            for (int x = 0; x < width; ++x, sum += 3) {
+                const uint8_t *p = row + 3 * x_begin_[x];
+                const uint8_t *const end = row + 3 * x_end_[x];
+                uint32_t r = 0, g = 0, b = 0;
+                for (/**/; p < end; p += 3) {
+                    r += p[0]; g += p[1]; b += p[2];
+                }
+                sum[0] += r; sum[1] += g; sum[2] += b;
+            }
+        }
+        const uint32_t rows = y_end_[y] - y_begin_[y];
+        for (int x = 0; x < width; ++x) {
+            const uint32_t count = rows * (x_end_[x] - x_begin_[x]);
+            for (int c = 0; c < 3; ++c) {
+                *out++ = (sums_[3 * x + c] + count / 2) / count;
+            }
+        }
+    }
+}
+
+void VideoPipeline::Send() {
+    StageStats *const stats = &stats_[SEND];
+    int64_t deadline = clock_ ? FrameClock::Now() : 0;
+    for (;;) {
+        const int64_t start = FrameClock::Now();
+        uint8_t *const frame = map_queue_->AcquireReady();
+        const int64_t acquired = FrameClock::Now();
+        stats->wait_nsec += acquired - start;
+        if (frame == NULL) break;
+
+        SetFrameTraceFrame(stats->frames);
+        canvas_->Blit((const RGBc*)frame);
+        // The strips have their own copy now.
+        map_queue_->ReleaseFree(frame);
+        if (clock_) {
+            deadline = clock_->NextDeadline(deadline);
+            // Sleeping until the deadline is not work.
+            const int64_t early = deadline - FrameClock::Now();
+            if (early > 0) stats->wait_nsec += early;
+            clock_->SendBuffersAt(deadline);
+            if (early > 0) stats->busy_nsec -= early;
+        } else {
+            spi_->SendBuffers();
+        }
+        stats->busy_nsec += FrameClock::Now() - acquired;
+        stats->frames++;
+        stats->bytes += canvas_bytes_;
+    }
+    // Nothing more to come; make sure the reader doesn't wait for room.
+    read_queue_->Shutdown();
+    __sync_fetch_and_sub(&running_stages_, 1);
+}
+}  // namespace spixels
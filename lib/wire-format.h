@@ -0,0 +1,47 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPIXELS_WIRE_FORMAT_H
+#define SPIXELS_WIRE_FORMAT_H
+
+#include <stdint.h>
+
+// Helpers for the implementations of MultiSPI::WireFormat().
+
+namespace spixels {
+// Each implementation starts the hash with its own tag.
+enum WireFormatTag {
+    WIRE_FORMAT_DIRECT    = 0x44495231,   // 'DIR1'
+    WIRE_FORMAT_DMA       = 0x444d4131,   // 'DMA1'
+    WIRE_FORMAT_WS2812    = 0x57533231,   // 'WS21'
+    WIRE_FORMAT_SIMULATED = 0x53494d31,   // 'SIM1'
+};
+
+// Add "value" to the layout hash (FNV-1a over the bytes of the value).
+inline uint32_t HashWireFormat(uint32_t hash, uint32_t value) {
+    for (int i = 0; i < 4; ++i, value >>= 8) {
+        hash = (hash ^ (value & 0xff)) * 16777619u;
+    }
+    return hash;
+}
+
+inline uint32_t StartWireFormat(WireFormatTag tag) {
+    return HashWireFormat(2166136261u, tag);
+}
+}  // namespace spixels
+
+#endif  // SPIXELS_WIRE_FORMAT_H
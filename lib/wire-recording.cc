@@ -0,0 +1,332 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "wire-recording.h"
+
+#include "frame-clock.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WIRE_FILE_MAGIC "SPXWIRE"
+#define WIRE_FILE_VERSION 1
+
+// Frames are aligned, so that they can be used in place from the mapped
+// file by implementations reading words.
+#define FRAME_ALIGNMENT 64
+
+namespace spixels {
+static uint64_t Align(uint64_t pos) {
+    return (pos + FRAME_ALIGNMENT - 1) & ~(uint64_t)(FRAME_ALIGNMENT - 1);
+}
+
+static bool WriteAt(int fd, const void *data, size_t size, uint64_t pos) {
+    return pwrite(fd, data, size, pos) == (ssize_t)size;
+}
+
+WireRecorder::WireRecorder(MultiSPI *backend)
+    : backend_(backend), fd_(-1), send_(true), wire_format_(0),
+      first_frame_usec_(-1), file_pos_(0) {
+    for (int i = 0; i < 32; ++i) {
+        layout_[i].gpio = i;
+        layout_[i].bytes = 0;
+        layout_[i].clock_gpio = -1;
+        layout_[i].clock_divider = 1;
+    }
+}
+
+WireRecorder::~WireRecorder() {
+    Close();
+}
+
+bool WireRecorder::Open(const char *filename) {
+    Close();
+    fd_ = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        perror(filename);
+        return false;
+    }
+    index_.clear();
+    previous_frame_.clear();
+    first_frame_usec_ = -1;
+    file_pos_ = Align(sizeof(WireFileHeader));  // Header written at Close().
+    return true;
+}
+
+bool WireRecorder::Fail(const char *msg) {
+    fprintf(stderr, "Recording stopped: %s\n", msg);
+    close(fd_);
+    fd_ = -1;
+    return false;
+}
+
+bool WireRecorder::RegisterDataGPIO(int gpio, size_t serial_byte_size) {
+    if (!backend_->RegisterDataGPIO(gpio, serial_byte_size))
+        return false;
+    layout_[gpio].bytes = serial_byte_size;
+    return true;
+}
+
+void WireRecorder::UnregisterDataGPIO(int gpio) {
+    backend_->UnregisterDataGPIO(gpio);
+    if (gpio < 0 || gpio >= 32) return;
+    layout_[gpio].bytes = 0;
+    layout_[gpio].clock_gpio = -1;
+    layout_[gpio].clock_divider = 1;
+}
+
+bool WireRecorder::SetDataGPIOClock(int data_gpio, int clock_gpio,
+                                    int clock_divider) {
+    if (!backend_->SetDataGPIOClock(data_gpio, clock_gpio, clock_divider))
+        return false;
+    layout_[data_gpio].clock_gpio = clock_gpio;
+    layout_[data_gpio].clock_divider = clock_divider;
+    return true;
+}
+
+void WireRecorder::SendBuffers() {
+    if (fd_ >= 0) {
+        const int64_t now = FrameClock::Now() / 1000;
+        if (first_frame_usec_ < 0) first_frame_usec_ = now;
+        RecordFrame(now - first_frame_usec_);
+    }
+    if (send_) backend_->SendBuffers();
+}
+
+bool WireRecorder::RecordFrame(int64_t timestamp_usec) {
+    if (fd_ < 0) return false;
+    const uint32_t format = backend_->WireFormat();
+    if (format == 0)
+        return Fail("MultiSPI implementation does not support wire frames.");
+    if (index_.empty()) {
+        wire_format_ = format;
+    } else if (format != wire_format_) {
+        return Fail("GPIO layout changed.");
+    }
+    frame_.resize(backend_->WireFrameSize());
+    backend_->GetWireFrame(&frame_[0]);
+
+    WireFileIndexEntry entry;
+    entry.timestamp_usec = timestamp_usec;
+    if (!index_.empty() && frame_ == previous_frame_) {
+        entry.offset = index_.back().offset;   // Nothing changed.
+    } else {
+        if (!WriteAt(fd_, &frame_[0], frame_.size(), file_pos_))
+            return Fail(strerror(errno));
+        entry.offset = file_pos_;
+        file_pos_ = Align(file_pos_ + frame_.size());
+        previous_frame_.swap(frame_);
+    }
+    index_.push_back(entry);
+    return true;
+}
+
+bool WireRecorder::Close() {
+    if (fd_ < 0) return true;
+    std::vector<WireFileLayoutEntry> layout;
+    for (int i = 0; i < 32; ++i) {
+        if (layout_[i].bytes > 0) layout.push_back(layout_[i]);
+    }
+
+    WireFileHeader header;
+    bzero(&header, sizeof(header));
+    memcpy(header.magic, WIRE_FILE_MAGIC, sizeof(header.magic));
+    header.version = WIRE_FILE_VERSION;
+    header.wire_format = wire_format_;
+    header.frame_size = previous_frame_.size();
+    header.frame_count = index_.size();
+    header.layout_count = layout.size();
+    header.index_offset = file_pos_;
+    header.layout_offset = (header.index_offset
+                            + index_.size() * sizeof(WireFileIndexEntry));
+    const bool success
+        = ((index_.empty() || WriteAt(fd_, &index_[0],
+                                      index_.size() * sizeof(index_[0]),
+                                      header.index_offset))
+           && (layout.empty() || WriteAt(fd_, &layout[0],
+                                         layout.size() * sizeof(layout[0]),
+                                         header.layout_offset))
+           && WriteAt(fd_, &header, sizeof(header), 0));
+    if (!success) perror("Writing recording");
+    close(fd_);
+    fd_ = -1;
+    return success;
+}
+
+WirePlayer::WirePlayer(MultiSPI *spi)
+    : spi_(spi), mapped_(NULL), mapped_size_(0), header_(NULL), index_(NULL),
+      running_(false) {
+    bzero(&stats_, sizeof(stats_));
+}
+
+WirePlayer::~WirePlayer() {
+    Close();
+}
+
+void WirePlayer::Close() {
+    if (mapped_) munmap(mapped_, mapped_size_);
+    mapped_ = NULL;
+    header_ = NULL;
+    index_ = NULL;
+}
+
+// Returns 'true' if the range is within the file.
+static bool InFile(uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && size <= file_size - offset;
+}
+
+bool WirePlayer::Open(const char *filename) {
+    Close();
+    const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(filename);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    mapped_size_ = st.st_size;
+    void *mem = mapped_size_ >= sizeof(WireFileHeader)
+        ? mmap(NULL, mapped_size_, PROT_READ, MAP_SHARED, fd, 0)
+        : MAP_FAILED;
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "%s: Can't map file.\n", filename);
+        return false;
+    }
+    mapped_ = (uint8_t*) mem;
+    header_ = (const WireFileHeader*) mapped_;
+
+    const WireFileHeader &h = *header_;
+    if (memcmp(h.magic, WIRE_FILE_MAGIC, sizeof(h.magic)) != 0
+        || h.version != WIRE_FILE_VERSION
+        || !InFile(h.index_offset,
+                   (uint64_t)h.frame_count * sizeof(WireFileIndexEntry),
+                   mapped_size_)
+        || !InFile(h.layout_offset,
+                   (uint64_t)h.layout_count * sizeof(WireFileLayoutEntry),
+                   mapped_size_)
+        || h.index_offset % sizeof(uint64_t) != 0
+        || h.layout_offset % sizeof(uint32_t) != 0) {
+        fprintf(stderr, "%s: Not a valid recording.\n", filename);
+        Close();
+        return false;
+    }
+    index_ = (const WireFileIndexEntry*) (mapped_ + h.index_offset);
+    for (uint32_t i = 0; i < h.frame_count; ++i) {
+        if (!InFile(index_[i].offset, h.frame_size, mapped_size_)
+            || index_[i].offset % FRAME_ALIGNMENT != 0) {
+            fprintf(stderr, "%s: Frame %u is broken.\n", filename, i);
+            Close();
+            return false;
+        }
+    }
+
+    const WireFileLayoutEntry *layout
+        = (const WireFileLayoutEntry*) (mapped_ + h.layout_offset);
+    for (uint32_t i = 0; i < h.layout_count; ++i) {
+        const WireFileLayoutEntry &l = layout[i];
+        if ((l.clock_gpio >= 0
+             && !spi_->SetDataGPIOClock(l.gpio, l.clock_gpio,
+                                        l.clock_divider))
+            || l.bytes <= 0 || !spi_->RegisterDataGPIO(l.gpio, l.bytes)) {
+            fprintf(stderr, "%s: Can't register GPIO %d.\n", filename,
+                    l.gpio);
+            Close();
+            return false;
+        }
+    }
+    if (spi_->WireFormat() != h.wire_format
+        || spi_->WireFrameSize() != h.frame_size) {
+        fprintf(stderr, "%s: Recorded with a different MultiSPI "
+                "implementation.\n", filename);
+        Close();
+        return false;
+    }
+
+    madvise(mapped_, mapped_size_, MADV_SEQUENTIAL);
+    spi_->Prepare();
+    return true;
+}
+
+int WirePlayer::frame_count() const {
+    return header_ ? header_->frame_count : 0;
+}
+
+int64_t WirePlayer::duration_usec() const {
+    const int count = frame_count();
+    return count > 0 ? index_[count - 1].timestamp_usec : 0;
+}
+
+const uint8_t *WirePlayer::Frame(int index) const {
+    return mapped_ + index_[index].offset;
+}
+
+// Ask the kernel to read the frame from storage while we send the
+// current one.
+void WirePlayer::Prefetch(int index) const {
+    if (index >= frame_count()) return;
+    const long page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t offset = index_[index].offset;
+    const uint64_t page_start = offset & ~(uint64_t)(page_size - 1);
+    madvise(mapped_ + page_start, offset - page_start + header_->frame_size,
+            MADV_WILLNEED);
+}
+
+bool WirePlayer::SendFrame(int index) {
+    if (index < 0 || index >= frame_count()) return false;
+    if (!spi_->SendWireFrame(Frame(index))) return false;
+    stats_.frames_sent++;
+    return true;
+}
+
+void WirePlayer::Play(float speed, bool loop) {
+    const int count = frame_count();
+    if (count == 0) return;
+    // When looping, the first frame follows the last after the average
+    // frame period.
+    const int64_t loop_usec = duration_usec()
+        + (count > 1 ? duration_usec() / (count - 1) : 0);
+    int64_t start = FrameClock::Now();
+    running_ = true;
+    do {
+        for (int i = 0; i < count && running_; ++i) {
+            Prefetch(i + 1);
+            if (speed > 0) {
+                const int64_t offset_nsec = index_[i].timestamp_usec * 1000;
+                const int64_t deadline = start + (int64_t)(offset_nsec / speed);
+                struct timespec ts;
+                ts.tv_sec = deadline / 1000000000LL;
+                ts.tv_nsec = deadline % 1000000000LL;
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                       NULL) == EINTR) {
+                }
+                const int64_t late_usec = (FrameClock::Now() - deadline) / 1000;
+                if (late_usec > stats_.max_late_usec)
+                    stats_.max_late_usec = late_usec;
+            }
+            SendFrame(i);
+        }
+        start += (int64_t)(loop_usec * 1000 / (speed > 0 ? speed : 1));
+    } while (loop && running_);
+}
+}  // namespace spixels
@@ -0,0 +1,314 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// SPI Pixels - Control SPI LED strips (spixels)
+// Copyright (C) 2016 Henner Zeller <h.zeller@acm.org>
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "multi-spi.h"
+
+#include "dma-channel.h"
+#include "ft-gpio.h"
+#include "pwm-pacer.h"
+#include "rpi-dma.h"
+#include "stats-clock.h"
+#include "wire-format.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- GPIO specific defines
+#define GPIO_REGISTER_BASE 0x200000
+#define GPIO_SET_OFFSET 0x1C
+#define GPIO_CLR_OFFSET 0x28
+#define PHYSICAL_GPIO_BUS (0x7E000000 + GPIO_REGISTER_BASE)
+
+#define DMA_CHANNEL       5
+
+// The WS2812 protocol sends each bit in 1.25usec; we split that in three
+// slots of 400ns: first slot always high, second slot high for a one-bit,
+// low for a zero-bit, last slot always low. That gives 400ns/800ns high
+// times and is well within tolerance of the WS2812 and SK6812.
+#define SLOT_NSEC 400
+
+// Each bit needs three GPIO writes, each followed by a delay.
+#define BLOCKS_PER_BIT 6
+
+// Low time at the end of the frame to latch the data. Newer WS2812B
+// variants need more than the 50usec in the original data sheet.
+#define LATCH_USEC 300
+
+namespace spixels {
+namespace {
+// MultiSPI that does not have a clock but outputs the timing-encoded
+// one-wire protocol of WS2812-type LEDs on all data pins at once.
+//
+// The DMA engine writes the GPIO set/clear registers; between these writes,
+// it is paced by the PWM peripheral. The control blocks are all set up
+// once, a frame only needs to update the per-bit clear masks.
+class WS2812MultiSPI : public MultiSPI {
+public:
+    WS2812MultiSPI();
+    virtual ~WS2812MultiSPI();
+
+    virtual bool RegisterDataGPIO(int gpio, size_t serial_byte_size);
+    virtual void UnregisterDataGPIO(int gpio);
+    virtual void SetBufferedByte(int data_gpio, size_t pos, uint8_t data);
+    virtual bool MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                   size_t count);
+    virtual void Prepare();
+    virtual void SendBuffers();
+
+    virtual uint32_t WireFormat() const;
+    virtual size_t WireFrameSize() const {
+        return 8 * serial_byte_size_ * sizeof(uint32_t);
+    }
+    virtual bool GetWireFrame(void *out) const;
+    virtual bool SendWireFrame(const void *frame);
+
+private:
+    void UpdateLayout();
+    void Send(const uint32_t *zero_bits);
+    void FinishRegistration();
+    void ReleaseDMAMemory();
+
+    ft::GPIO gpio_;
+    uint32_t data_gpios_;        // All registered data GPIOs.
+    size_t gpio_bytes_[32];      // Requested bytes per data GPIO.
+    size_t serial_byte_size_;    // Longest of all of them.
+    size_t shadow_capacity_;     // Bits allocated in shadow.
+
+    // For each bit: the GPIOs to clear after the first slot, i.e. the
+    // channels that send a zero bit.
+    uint32_t *zero_bits_shadow_;
+
+    struct UncachedMemBlock alloced_;
+    uint32_t *zero_bits_dma_;
+    uint32_t *all_gpios_dma_;
+    struct dma_cb *start_block_;
+    DMAChannel dma_channel_;
+    PWMPacer pacer_;
+    int64_t expected_transfer_usec_;
+};
+}  // end anonymous namespace
+
+WS2812MultiSPI::WS2812MultiSPI()
+    : data_gpios_(0), serial_byte_size_(0), shadow_capacity_(0),
+      zero_bits_shadow_(NULL), zero_bits_dma_(NULL), all_gpios_dma_(NULL),
+      expected_transfer_usec_(0) {
+    alloced_.mem = NULL;
+    bzero(gpio_bytes_, sizeof(gpio_bytes_));
+    bool success = gpio_.Init();
+    assert(success);  // gpio couldn't be initialized
+}
+
+WS2812MultiSPI::~WS2812MultiSPI() {
+    ReleaseDMAMemory();
+    free(zero_bits_shadow_);
+}
+
+bool WS2812MultiSPI::RegisterDataGPIO(int gpio, size_t requested_bytes) {
+    if (!gpio_.AddOutput(gpio))
+        return false;
+    data_gpios_ |= (1 << gpio);
+    gpio_bytes_[gpio] = requested_bytes;
+    UpdateLayout();
+    // (Re-)registered channels start out with all zero bits.
+    for (size_t i = 0; i < 8 * serial_byte_size_; ++i) {
+        zero_bits_shadow_[i] |= (1 << gpio);
+    }
+    return true;
+}
+
+void WS2812MultiSPI::UnregisterDataGPIO(int gpio) {
+    if (gpio < 0 || gpio >= 32 || (data_gpios_ & (1 << gpio)) == 0)
+        return;
+    data_gpios_ &= ~(1 << gpio);
+    gpio_bytes_[gpio] = 0;
+    for (size_t i = 0; i < 8 * serial_byte_size_; ++i) {
+        zero_bits_shadow_[i] &= ~(1 << gpio);
+    }
+    UpdateLayout();
+}
+
+void WS2812MultiSPI::UpdateLayout() {
+    size_t longest = 0;
+    for (int i = 0; i < 32; ++i) {
+        if (gpio_bytes_[i] > longest) longest = gpio_bytes_[i];
+    }
+    if (8 * longest > shadow_capacity_) {
+        zero_bits_shadow_ = (uint32_t*)realloc(zero_bits_shadow_,
+                                               8 * longest * sizeof(uint32_t));
+        shadow_capacity_ = 8 * longest;
+    }
+    // Channels shorter than the longest one send zero bits at the end.
+    for (size_t i = 8 * serial_byte_size_; i < 8 * longest; ++i) {
+        zero_bits_shadow_[i] = data_gpios_;
+    }
+    if (longest != serial_byte_size_) {
+        // The control block chain depends on the number of bits.
+        ReleaseDMAMemory();
+        serial_byte_size_ = longest;
+    }
+}
+
+void WS2812MultiSPI::SetBufferedByte(int data_gpio, size_t pos, uint8_t data) {
+    assert(pos < serial_byte_size_);
+    uint32_t *buffer_pos = zero_bits_shadow_ + 8 * pos;
+    for (uint8_t bit = 0x80; bit; bit >>= 1, buffer_pos++) {
+        if (data & bit) {
+            *buffer_pos &= ~(1 << data_gpio);
+        } else {
+            *buffer_pos |= (1 << data_gpio);
+        }
+    }
+}
+
+bool WS2812MultiSPI::MoveBufferedBytes(int data_gpio, size_t from, size_t to,
+                                       size_t count) {
+    assert(from + count <= serial_byte_size_);
+    assert(to + count <= serial_byte_size_);
+    const uint32_t mask = 1 << data_gpio;
+    uint32_t *const src = zero_bits_shadow_ + 8 * from;
+    uint32_t *const dst = zero_bits_shadow_ + 8 * to;
+    const size_t bits = 8 * count;
+    if (dst < src) {
+        for (size_t i = 0; i < bits; ++i)
+            dst[i] = (dst[i] & ~mask) | (src[i] & mask);
+    } else {
+        for (size_t i = bits; i > 0; --i)
+            dst[i-1] = (dst[i-1] & ~mask) | (src[i-1] & mask);
+    }
+    return true;
+}
+
+void WS2812MultiSPI::FinishRegistration() {
+    if (!pacer_.initialized()) {
+        const bool success = pacer_.Init(SLOT_NSEC);
+        assert(success);  // Could not map PWM registers.
+    }
+    if (!dma_channel_.initialized()) {
+        const bool success = dma_channel_.Init(DMA_CHANNEL);
+        assert(success);  // Could not map DMA registers.
+    }
+
+    const int bits = 8 * serial_byte_size_;
+    // One block to fill the pacer FIFO, all the bit blocks, one latch delay.
+    const int control_blocks = 1 + BLOCKS_PER_BIT * bits + 1;
+    // Constant words come after the bit data: the mask of all data GPIOs and
+    // a word to read from in pacing blocks.
+    const size_t alloc_size = (control_blocks * sizeof(struct dma_cb)
+                               + (bits + 2) * sizeof(uint32_t));
+    alloced_ = UncachedMemBlock_pool_alloc(alloc_size);
+    start_block_ = (struct dma_cb*) alloced_.mem;
+    zero_bits_dma_ = (uint32_t*) (start_block_ + control_blocks);
+    all_gpios_dma_ = zero_bits_dma_ + bits;
+    const uint32_t all_gpios_bus
+        = UncachedMemBlock_to_physical(&alloced_, all_gpios_dma_);
+    const uint32_t pace_src_bus
+        = UncachedMemBlock_to_physical(&alloced_, all_gpios_dma_ + 1);
+
+    const uint32_t gpio_set = PHYSICAL_GPIO_BUS + GPIO_SET_OFFSET;
+    const uint32_t gpio_clr = PHYSICAL_GPIO_BUS + GPIO_CLR_OFFSET;
+    struct dma_cb *cb = start_block_;
+    pacer_.SetupDelayBlock(cb++, pace_src_bus, PWMPacer::kFifoWords);
+    for (int i = 0; i < bits; ++i) {
+        const uint32_t writes[3][2] = {
+            { all_gpios_bus, gpio_set },  // Start of bit: all high.
+            { (uint32_t)UncachedMemBlock_to_physical(&alloced_,
+                                                     zero_bits_dma_ + i),
+              gpio_clr },                 // Zero bits go low early.
+            { all_gpios_bus, gpio_clr },  // End of bit: all low.
+        };
+        for (int w = 0; w < 3; ++w) {
+            cb->info   = DMA_CB_TI_NO_WIDE_BURSTS | DMA_CB_TI_WAIT_RESP;
+            cb->src    = writes[w][0];
+            cb->dst    = writes[w][1];
+            cb->length = sizeof(uint32_t);
+            cb->stride = 0;
+            ++cb;
+            pacer_.SetupDelayBlock(cb++, pace_src_bus, 1);
+        }
+    }
+    pacer_.SetupDelayBlock(cb++, pace_src_bus,
+                           LATCH_USEC * 1000 / SLOT_NSEC);
+    for (struct dma_cb *link = start_block_; link < cb - 1; ++link) {
+        link->next = UncachedMemBlock_to_physical(&alloced_, link + 1);
+    }
+    (cb - 1)->next = 0;
+}
+
+void WS2812MultiSPI::ReleaseDMAMemory() {
+    UncachedMemBlock_pool_release(&alloced_);
+    zero_bits_dma_ = NULL;
+    all_gpios_dma_ = NULL;
+    expected_transfer_usec_ = 0;
+}
+
+void WS2812MultiSPI::Prepare() {
+    if (!zero_bits_dma_) FinishRegistration();
+    // Touch all memory involved in sending.
+    memcpy(zero_bits_dma_, zero_bits_shadow_,
+           8 * serial_byte_size_ * sizeof(uint32_t));
+}
+
+void WS2812MultiSPI::SendBuffers() {
+    Send(zero_bits_shadow_);
+}
+
+void WS2812MultiSPI::Send(const uint32_t *zero_bits) {
+    if (!zero_bits_dma_) FinishRegistration();
+    const int64_t start = StatsNow();
+    memcpy(zero_bits_dma_, zero_bits, 8 * serial_byte_size_ * sizeof(uint32_t));
+    *all_gpios_dma_ = data_gpios_;  // Might have changed since setup.
+    const int64_t copied = StatsNow();
+    dma_channel_.Start(&alloced_, start_block_);
+    int64_t poll_usec;
+    expected_transfer_usec_ = dma_channel_.WaitDone(expected_transfer_usec_,
+                                                    &poll_usec);
+    const int64_t end = StatsNow();
+    AddTiming(&transfer_stats_.copy, TRACE_COPY, start, copied);
+    AddTiming(&transfer_stats_.transmit, TRACE_TRANSMIT, copied, end);
+    AddTiming(&transfer_stats_.poll, TRACE_POLL, end - poll_usec * 1000, end);
+    transfer_stats_.frames_sent++;
+    transfer_stats_.bits_sent += 8 * serial_byte_size_;
+}
+
+uint32_t WS2812MultiSPI::WireFormat() const {
+    uint32_t hash = StartWireFormat(WIRE_FORMAT_WS2812);
+    hash = HashWireFormat(hash, data_gpios_);
+    for (int gpio = 0; gpio < 32; ++gpio) {
+        if (gpio_bytes_[gpio] == 0) continue;
+        hash = HashWireFormat(hash, gpio);
+        hash = HashWireFormat(hash, gpio_bytes_[gpio]);
+    }
+    return hash;
+}
+
+bool WS2812MultiSPI::GetWireFrame(void *out) const {
+    memcpy(out, zero_bits_shadow_, WireFrameSize());
+    return true;
+}
+
+bool WS2812MultiSPI::SendWireFrame(const void *frame) {
+    Send((const uint32_t*)frame);
+    return true;
+}
+
+// Public interface
+MultiSPI *CreateWS2812MultiSPI() {
+    return new WS2812MultiSPI();
+}
+}  // namespace spixels